@@ -13,6 +13,7 @@ files = {'mex_lambda',...
         'mex_vp',...
         'mex_gmax',...
         'mex_min_spl',...
+        'mex_grid_advisor',...
         'mex_mrad_2_rAng',...
         'mex_mrad_2_sigma',...
         'mex_fwhm_2_sigma',...
@@ -33,6 +34,8 @@ files = {'mex_lambda',...
         'mex_projected_potential',...
         'mex_transmission_function',...
         'mex_multem',...
+        'mex_stem_4d_vdet',...
+        'mex_stream_dispatch',...
         'mex_wave_function'};
 
 for file=files
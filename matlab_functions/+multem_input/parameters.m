@@ -22,6 +22,7 @@ classdef parameters
       pn_nconf(1,1) uint64 {mustBePositive} = 1;                                                               % true: specific phonon configuration, false: number of frozen phonon configurations
       pn_dim(1,1) uint64 {mustBePositive} = 110;                                                               % phonon dimensions (xyz)
       pn_seed(1,1) uint64 {mustBePositive} =  300183;                                                          % Random seed(frozen phonon)
+      pn_conv_tol(1,1) double {mustBeNonnegative} = 0;                                                         % relative standard error of the frozen phonon average, 0: pn_nconf configurations (not used for 4D-STEM)
       %%%%%%%%%%%%%%%%%%%%%%% Specimen information %%%%%%%%%%%%%%%%%%%%%%%
       
       spec_atoms = [];                                                                                         % Specimen atoms
@@ -54,12 +55,15 @@ classdef parameters
       %%%%%%%%%%%%%%%%%%%%%%% Potential slicing %%%%%%%%%%%%%%%%%%%%%%%%%%
       
       potential_slicing(1,1) uint64 {mustBeLessThanOrEqual(potential_slicing,4),mustBePositive} = 1;          % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+      potential_eval(1,1) uint64 {mustBeLessThanOrEqual(potential_eval,3),mustBePositive} = 3;                % ePE_Scatter = 1, ePE_Gather = 2, ePE_Auto = 3
       islice uint64                                                                                           % retrieve the projected potential at given slices
       %%%%%%%%%%%%%%%%%%%%%% x-y sampling %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
       
       nx(1,1) double {mustBePositive} = 256;                                                                  % number of pixels in x direction
       ny(1,1) double {mustBePositive} = 256;                                                                  % number of pixels in y direction
       bwl(1,1) uint64 {mustBeLessThanOrEqual(bwl,1),mustBeNonnegative} = 0;                                   % Band-width limit, 1: true, 0:false
+      grid_auto(1,1) uint64 {mustBeLessThanOrEqual(grid_auto,1),mustBeNonnegative} = 0;                       % FFT aware nx and ny with the same box size and a sampling not coarser than lx/nx, ly/ny (ignored with a user defined incident wave, matrix detectors or an output area), 1: true, 0:false
+      bwl_pruned(1,1) uint64 {mustBeLessThanOrEqual(bwl_pruned,1),mustBeNonnegative} = 0;                     % CPU FFTs of the multislice skip the rows outside the band-width limit, 1: true, 0:false
 
       %%%%%%%%%%%%%%%%%%%%%%%% Simulation type %%%%%%%%%%%%%%%%%%%%%%%%%%%
       
@@ -196,6 +200,21 @@ classdef parameters
       scanning_y0(1,1) double = 0.00;                       % y-starting point (Angstrom)
       scanning_xe(1,1) double = 4.078;                      % x-final point (Angstrom)
       scanning_ye(1,1) double = 4.078;                      % y-final point (Angstrom)
+      %%%%%%%%%%%%%%%%%%%%%%%%%%%%% 4D-STEM %%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+      
+      stem_4d_fn char = '';                                 % output file of the diffraction patterns, empty: off
+      stem_4d_theta_max(1,1) double {mustBeNonnegative} = 0;    % maximum angle (mrad), 0: whole grid
+      stem_4d_bin(1,1) uint64 {mustBePositive} = 1;         % binning factor
+      stem_4d_f16(1,1) uint64 {mustBeLessThanOrEqual(stem_4d_f16,1),mustBeNonnegative} = 0;    % 0: float32, 1: float16
+      stem_4d_chunk(1,1) uint64 = 0;                        % scanning positions per chunk, 0: auto
+      %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% PRISM %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+      
+      stem_prism_f(1,1) uint64 = 0;                         % PRISM interpolation factor, 0: conventional multislice
+      %%%%%%%%%%%%%%%%%%%%%%%%%%%%%% probe window %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+      
+      stem_window(1,1) uint64 {mustBeLessThanOrEqual(stem_window,1),mustBeNonnegative} = 0;    % probe propagated on a window centered at the beam, 0: full grid
+      stem_window_lx(1,1) double {mustBeNonnegative} = 0;  % window size (Angstrom), 0: automatic
+      stem_window_ly(1,1) double {mustBeNonnegative} = 0;  % window size (Angstrom), 0: automatic
       %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%PED %%%%%%%%%%%%%%%%%%%%%%%%%%%%%
       
       ped_nrot(1,1) double = 360;                           % Number of orientations
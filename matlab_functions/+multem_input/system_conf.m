@@ -11,6 +11,30 @@ classdef system_conf
         cpu_ncores
         % # of CPU Threads
         cpu_nthread(1,1) uint64 {mustBePositive} = 1;
+        % # of CPU Threads that run STEM scan positions concurrently (cpu_nthread is split between them)
+        cpu_nthread_scan(1,1) uint64 {mustBePositive} = 1;
+        % # of STEM scan positions propagated together through each slice (batched fft)
+        cpu_scan_batch(1,1) uint64 {mustBePositive} = 1;
+        % # of STEM scan batches that advance together through a window of slices (cache reuse of the slices)
+        cpu_scan_tile(1,1) uint64 {mustBePositive} = 1;
+        % Cache budget (MB) of the window of slices shared by a tile, 0: last level cache of the CPU
+        cpu_cache_size(1,1) uint64 {mustBeNonnegative} = 0;
+        % # of CPU Threads that run frozen phonon configurations concurrently (cpu_nthread is split between them)
+        cpu_nthread_conf(1,1) uint64 {mustBePositive} = 1;
+        % Multislice step with the transmission and the propagator applied inside the passes of the fft, 1: true, 0:false
+        cpu_slice_fused(1,1) uint64 {mustBeLessThanOrEqual(cpu_slice_fused,1),mustBeNonnegative} = 1;
+        % Directory of the cached atomic type tables (it must exist), '': no cache
+        cache_dir char = '';
+        % Directory of the fftw wisdom files (it must exist), '': no wisdom files
+        fftw_wisdom_dir char = '';
+        % fftw planning rigor: 0: estimate, 1: measure, 2: patient, 3: exhaustive
+        fftw_rigor(1,1) uint64 {mustBeLessThanOrEqual(fftw_rigor,3)} = 1;
+        % Directory of the memory mapped file of the slices that do not fit in memory (it must exist), '': no slice file
+        slice_scratch_dir char = '';
+        % # of slices read ahead from the slice file
+        slice_prefetch(1,1) uint64 {mustBeNonnegative} = 4;
+        % # of propagator kernels kept in memory (distinct slice thickness and beam tilt), 0: computed on the fly
+        prop_cache(1,1) uint64 {mustBeNonnegative} = 4;
         % Select GPU (for Multi-GPU Setups)
         gpu_device(1,1) uint64 {mustBeNonnegative} = 0;
     end
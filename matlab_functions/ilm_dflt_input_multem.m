@@ -15,6 +15,7 @@ function [input_multem] = ilm_dflt_input_multem()
     input_multem.pn_nconf = 1;                                  % true: specific phonon configuration, false: number of frozen phonon configurations
     input_multem.pn_dim = 110;                                  % phonon dimensions (xyz)
     input_multem.pn_seed = 300183;                              % Random seed(frozen phonon)
+    input_multem.pn_conv_tol = 0;                               % relative standard error of the frozen phonon average, 0: pn_nconf configurations (not used for 4D-STEM)
 
     %%%%%%%%%%%%%%%%%%%%%%% Specimen information %%%%%%%%%%%%%%%%%%%%%%%
     input_multem.spec_atoms = [];                               % simulation box length in x direction ()
@@ -49,11 +50,14 @@ function [input_multem] = ilm_dflt_input_multem()
 
     %%%%%%%%%%%%%%%%%%%%%%% Potential slicing %%%%%%%%%%%%%%%%%%%%%%%%%%
     input_multem.potential_slicing = 1;                         % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+    input_multem.potential_eval = 3;                            % ePE_Scatter = 1, ePE_Gather = 2, ePE_Auto = 3
 
     %%%%%%%%%%%%%%%%%%%%%% x-y sampling %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
     input_multem.nx = 256;                                      % number of pixels in x direction
     input_multem.ny = 256;                                      % number of pixels in y direction
     input_multem.bwl = 0;                                       % Band-width limit, 1: true, 0:false
+    input_multem.grid_auto = 0;                                 % FFT aware nx and ny with the same box size and a sampling not coarser than lx/nx, ly/ny (ignored with a user defined incident wave, matrix detectors or an output area), 1: true, 0:false
+    input_multem.bwl_pruned = 0;                                % CPU FFTs of the multislice skip the rows outside the band-width limit, 1: true, 0:false
 
     %%%%%%%%%%%%%%%%%%%%%%%% Simulation type %%%%%%%%%%%%%%%%%%%%%%%%%%%
     % eTEMST_STEM=11, eTEMST_ISTEM=12, eTEMST_CBED=21, eTEMST_CBEI=22, 
@@ -199,8 +203,8 @@ function [input_multem] = ilm_dflt_input_multem()
     input_multem.detector.cir(1).inner_ang = 60;    			% Inner angle(mrad) 
     input_multem.detector.cir(1).outer_ang = 180;   			% Outer angle(mrad)
 
-    input_multem.detector.radial(1).x = 0;          			% radial detector angle(mrad)
-    input_multem.detector.radial(1).fx = 0;         			% radial sensitivity value
+    input_multem.detector.radial(1).x = 0;          			% radial detector angle(mrad), ascending
+    input_multem.detector.radial(1).fx = 0;         			% radial sensitivity value at x, interpolated linearly on the radial bins (0 outside x, a single value is constant)
 
     input_multem.detector.matrix(1).R = 0;          			% 2D detector angle(mrad)
     input_multem.detector.matrix(1).fR = 0;         			% 2D sensitivity value
@@ -217,6 +221,21 @@ function [input_multem] = ilm_dflt_input_multem()
     input_multem.scanning_xe = 4.078;               			% x-final point ()
     input_multem.scanning_ye = 4.078;               			% y-final point ()
 
+    %%%%%%%%%%%%%%%%%%%%%%%%%%%%% 4D-STEM %%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+    input_multem.stem_4d_fn = '';                   			% output file of the diffraction patterns, empty: off
+    input_multem.stem_4d_theta_max = 0;             			% maximum angle (mrad), 0: whole grid
+    input_multem.stem_4d_bin = 1;                   			% binning factor
+    input_multem.stem_4d_f16 = 0;                   			% 0: float32, 1: float16
+    input_multem.stem_4d_chunk = 0;                 			% scanning positions per chunk, 0: auto
+
+    %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% PRISM %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+    input_multem.stem_prism_f = 0;                  			% PRISM interpolation factor, 0: conventional multislice
+
+    %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% probe window %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+    input_multem.stem_window = 0;                   			% probe propagated on a window centered at the beam, 0: full grid
+    input_multem.stem_window_lx = 0;                			% window size (Angstrom), 0: automatic
+    input_multem.stem_window_ly = 0;                			% window size (Angstrom), 0: automatic
+
     %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%PED %%%%%%%%%%%%%%%%%%%%%%%%%%%%%
     input_multem.ped_nrot = 360;                    			% Number of orientations
     input_multem.ped_theta = 3.0;                   			% Precession angle (degrees)
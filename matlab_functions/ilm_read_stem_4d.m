@@ -0,0 +1,65 @@
+% Read a 4D-STEM store written by ilc_multem (stem_4d_fn)
+% info = ilm_read_stem_4d(fn): header, g axes (Angstrom^-1) and a memmapfile of data(ky, kx, iscan, ithk)
+% pattern = ilm_read_stem_4d(fn, iscan, ithk): diffraction pattern (nky x nkx) of a scanning position
+function [out] = ilm_read_stem_4d(fn, iscan, ithk)
+	fid = fopen(fn, 'r', 'l');
+	magic = fread(fid, 8, '*char')';
+	if(~strcmp(magic, 'MT4DSTEM'))
+		fclose(fid);
+		error('ilm_read_stem_4d: %s is not a 4D-STEM store', fn);
+	end
+
+	v = fread(fid, 10, 'int32');
+	info.version = v(1);
+	info.f16 = (v(2)==2);
+	info.nkx = v(3);
+	info.nky = v(4);
+	info.nsx = v(5);
+	info.nsy = v(6);
+	info.nthk = v(7);
+	info.n_chunk = v(8);
+	info.bin = v(9);
+
+	v = fread(fid, 6, 'double');
+	info.E_0 = v(1);
+	info.dgx = v(4);
+	info.dgy = v(5);
+	info.g_max = v(6);
+	info.gx = v(2) + (0:(info.nkx-1))*info.dgx;
+	info.gy = v(3) + (0:(info.nky-1))*info.dgy;
+
+	info.data_offset = fread(fid, 1, 'int64');
+	info.thick = fread(fid, info.nthk, 'double')';
+	fclose(fid);
+
+	dtype = ilm_ifelse(info.f16, 'uint16', 'single');
+	info.data = memmapfile(fn, 'Offset', info.data_offset, 'Format', {dtype, [info.nky, info.nkx, info.nsx*info.nsy, info.nthk], 'data'});
+
+	if(nargin<2)
+		out = info;
+		return;
+	end
+
+	if(nargin<3)
+		ithk = 1;
+	end
+
+	out = info.data.Data.data(:, :, iscan, ithk);
+	if(info.f16)
+		out = half_2_single(out);
+	end
+end
+
+function [x] = half_2_single(h)
+	h = uint32(h);
+	s = 1 - 2*single(bitshift(h, -15));
+	e = single(bitand(bitshift(h, -10), 31));
+	m = single(bitand(h, 1023));
+
+	x = s.*pow2(1 + m/1024, e - 15);
+	ii = (e==0);
+	x(ii) = s(ii).*pow2(m(ii), -24);
+	ii = (e==31);
+	x(ii) = s(ii)*inf;
+	x(ii & (m>0)) = nan;
+end
@@ -0,0 +1,83 @@
+% Frozen phonon configurations run concurrently (cpu_nthread_conf): 50 configurations of a 512x512 CBED
+% The partial outputs are added in configuration order, so the result does not depend on the number of workers
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 21;              % eTEMST_CBED=21
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+
+input_multem.pn_model = 3;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+input_multem.pn_coh_contrib = 0;
+input_multem.pn_single_conf = 0;
+input_multem.pn_nconf = 50;
+input_multem.pn_dim = 110;
+input_multem.pn_seed = 300183;
+
+na = 8; nb = 8; nc = 40; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Si001_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.thick_type = 1;                    % eTT_Whole_Spec = 1, eTT_Through_Thick = 2, eTT_Through_Slices = 3
+
+input_multem.nx = 512;
+input_multem.ny = 512;
+input_multem.bwl = 0;
+
+input_multem.E_0 = 100;
+input_multem.illumination_model = 1;
+input_multem.iw_type = 4;                       % 1: Plane_Wave, 2: Convergent_wave, 3:User_Define, 4: auto
+input_multem.iw_x = input_multem.spec_lx/2;
+input_multem.iw_y = input_multem.spec_ly/2;
+
+input_multem.cond_lens_c_10 = 1110;             % Defocus (Angstrom)
+input_multem.cond_lens_c_30 = 3.3;              % Third order spherical aberration (mm)
+input_multem.cond_lens_outer_aper_ang = 7.50;   % Outer aperture (mrad)
+input_multem.cond_lens_zero_defocus_type = 4;   % eZDT_First = 1, eZDT_User_Define = 4
+input_multem.cond_lens_zero_defocus_plane = 0;
+
+nthread_conf = [1, 2, 4, 8];
+t = zeros(size(nthread_conf));
+d = zeros(size(nthread_conf));
+for it = 1:length(nthread_conf)
+    input_multem.system_conf.cpu_nthread_conf = nthread_conf(it);
+
+    clear ilc_multem;
+    tic;
+    output_multislice = input_multem.ilc_multem;
+    t(it) = toc;
+
+    m2psi_tot = output_multislice.data(1).m2psi_tot;
+    if(it==2)
+        m2psi_ref = m2psi_tot;
+    end
+    if(it>=2)
+        d(it) = max(abs(m2psi_tot(:)-m2psi_ref(:)));
+    end
+
+    figure(1);
+    subplot(1, length(nthread_conf), it);
+    imagesc(log(1+1e5*m2psi_tot/max(m2psi_tot(:))));
+    title(['cpu\_nthread\_conf = ', num2str(nthread_conf(it))]);
+    axis image;
+    colormap hot;
+end
+
+for it = 1:length(nthread_conf)
+    disp(['cpu_nthread_conf = ', num2str(nthread_conf(it)), ': time = ', num2str(t(it), '%7.3f'), ' s, speedup = ', num2str(t(1)/t(it), '%5.2f'), ...
+        ', max. abs. difference to 2 workers = ', num2str(d(it), '%5.2e')]);
+end
@@ -0,0 +1,85 @@
+% PRISM versus conventional multislice for STEM: time and relative error for several interpolation factors
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 11;              % eTEMST_STEM=11
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+input_multem.pn_model = 1;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+
+na = 8; nb = 8; nc = 10; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au110_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.thick_type = 1;                    % eTT_Whole_Spec = 1, eTT_Through_Thick = 2, eTT_Through_Slices = 3
+
+input_multem.nx = 512;
+input_multem.ny = 512;
+input_multem.bwl = 0;
+
+input_multem.E_0 = 300;
+input_multem.illumination_model = 1;
+input_multem.cond_lens_c_10 = 14.0312;
+input_multem.cond_lens_c_30 = 1e-03;
+input_multem.cond_lens_outer_aper_ang = 21.0;
+
+input_multem.scanning_type = 2;                 % eST_Line = 1, eST_Area = 2
+input_multem.scanning_periodic = 1;
+input_multem.scanning_ns = 32;
+input_multem.scanning_x0 = 3*a;
+input_multem.scanning_y0 = 3*b;
+input_multem.scanning_xe = 4*a;
+input_multem.scanning_ye = 4*b;
+
+input_multem.detector.type = 1;                 % eDT_Circular = 1, eDT_Radial = 2, eDT_Matrix = 3
+input_multem.detector.cir(1).inner_ang = 40;    % Inner angle(mrad)
+input_multem.detector.cir(1).outer_ang = 160;   % Outer angle(mrad)
+input_multem.detector.cir(2).inner_ang = 0;     % Inner angle(mrad)
+input_multem.detector.cir(2).outer_ang = 10;    % Outer angle(mrad)
+
+% interpolation factors, 0: conventional multislice
+f = [0, 1, 2, 4];
+t = zeros(size(f));
+err = zeros(length(f), 2);
+for i_f = 1:length(f)
+    input_multem.stem_prism_f = f(i_f);
+
+    clear ilc_multem;
+    tic;
+    output_multislice = input_multem.ilc_multem;
+    t(i_f) = toc;
+
+    for idet = 1:2
+        image = output_multislice.data(1).image_tot(idet).image;
+        if(i_f==1)
+            image_ref{idet} = image;
+        end
+        err(i_f, idet) = max(abs(image(:)-image_ref{idet}(:)))/max(abs(image_ref{idet}(:)));
+
+        figure(1);
+        subplot(2, length(f), (idet-1)*length(f)+i_f);
+        imagesc(image);
+        title(['f = ', num2str(f(i_f)), ', err = ', num2str(err(i_f, idet), '%5.2e')]);
+        axis image;
+        colormap gray;
+    end
+end
+
+for i_f = 1:length(f)
+    disp(['f = ', num2str(f(i_f)), ': time = ', num2str(t(i_f), '%7.3f'), ' s, speedup = ', num2str(t(1)/t(i_f), '%5.2f'), ...
+        ', max. relative error = [', num2str(err(i_f, :), '%5.2e  '), ']']);
+end
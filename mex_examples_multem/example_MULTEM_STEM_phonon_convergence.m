@@ -0,0 +1,89 @@
+% Frozen phonon STEM with convergence control: the configurations stop once the relative standard error of the average reaches pn_conv_tol
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 11;              % eTEMST_STEM=11
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+
+input_multem.pn_model = 3;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+input_multem.pn_coh_contrib = 0;
+input_multem.pn_single_conf = 0;
+input_multem.pn_nconf = 50;                     % maximum number of configurations
+input_multem.pn_dim = 110;
+input_multem.pn_seed = 300183;
+
+na = 4; nb = 4; nc = 10; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au001_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.thick_type = 1;                    % eTT_Whole_Spec = 1, eTT_Through_Thick = 2, eTT_Through_Slices = 3
+
+input_multem.nx = 512;
+input_multem.ny = 512;
+input_multem.bwl = 0;
+
+input_multem.E_0 = 300;
+input_multem.illumination_model = 1;
+input_multem.cond_lens_c_10 = 14.0312;
+input_multem.cond_lens_c_30 = 1e-03;
+input_multem.cond_lens_outer_aper_ang = 21.0;
+
+input_multem.scanning_type = 2;                 % eST_Line = 1, eST_Area = 2
+input_multem.scanning_periodic = 1;
+input_multem.scanning_ns = 10;
+input_multem.scanning_x0 = 2*a;
+input_multem.scanning_y0 = 2*b;
+input_multem.scanning_xe = 3*a;
+input_multem.scanning_ye = 3*b;
+
+input_multem.detector.type = 1;                 % eDT_Circular = 1, eDT_Radial = 2, eDT_Matrix = 3
+input_multem.detector.cir(1).inner_ang = 60;    % Inner angle(mrad)
+input_multem.detector.cir(1).outer_ang = 180;   % Outer angle(mrad)
+
+% 0: pn_nconf configurations, then relative standard errors of the average
+tol = [0, 0.02, 0.01, 0.005];
+t = zeros(size(tol));
+for it = 1:length(tol)
+    input_multem.pn_conv_tol = tol(it);
+
+    clear ilc_multem;
+    tic;
+    output_multislice = input_multem.ilc_multem;
+    t(it) = toc;
+
+    image = output_multislice.data(1).image_tot(1).image;
+    if(it==1)
+        image_ref = image;
+        nconf = input_multem.pn_nconf;
+        err = 0;
+    else
+        nconf = output_multislice.pn_nconf;
+        err = output_multislice.pn_conv_err;
+    end
+    d_ref = max(abs(image(:)-image_ref(:)))/max(abs(image_ref(:)));
+
+    figure(1);
+    subplot(1, length(tol), it);
+    imagesc(image);
+    title(['tol = ', num2str(tol(it)), ', nconf = ', num2str(nconf)]);
+    axis image;
+    colormap gray;
+
+    disp(['tol = ', num2str(tol(it), '%5.3f'), ': nconf = ', num2str(nconf), ', error = ', num2str(err, '%5.2e'), ...
+        ', time = ', num2str(t(it), '%7.3f'), ' s, max. relative difference = ', num2str(d_ref, '%5.2e')]);
+end
@@ -0,0 +1,88 @@
+% Probe window versus full grid multislice for STEM on a large supercell: time and relative error (Au110 24x34 cells, ~98x98 Angstrom)
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 11;              % eTEMST_STEM=11
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+input_multem.pn_model = 1;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+
+na = 24; nb = 34; nc = 10; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au110_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.thick_type = 1;                    % eTT_Whole_Spec = 1, eTT_Through_Thick = 2, eTT_Through_Slices = 3
+
+input_multem.nx = 2048;
+input_multem.ny = 2048;
+input_multem.bwl = 0;
+
+input_multem.E_0 = 300;
+input_multem.illumination_model = 1;
+input_multem.cond_lens_c_10 = 14.0312;
+input_multem.cond_lens_c_30 = 1e-03;
+input_multem.cond_lens_outer_aper_ang = 21.0;
+
+input_multem.scanning_type = 2;                 % eST_Line = 1, eST_Area = 2
+input_multem.scanning_periodic = 1;
+input_multem.scanning_ns = 16;
+input_multem.scanning_x0 = 12*a;
+input_multem.scanning_y0 = 17*b;
+input_multem.scanning_xe = 13*a;
+input_multem.scanning_ye = 18*b;
+
+input_multem.detector.type = 1;                 % eDT_Circular = 1, eDT_Radial = 2, eDT_Matrix = 3
+input_multem.detector.cir(1).inner_ang = 40;    % Inner angle(mrad)
+input_multem.detector.cir(1).outer_ang = 160;   % Outer angle(mrad)
+input_multem.detector.cir(2).inner_ang = 0;     % Inner angle(mrad)
+input_multem.detector.cir(2).outer_ang = 10;    % Outer angle(mrad)
+
+% 0: full grid, 1: automatic window, then user defined windows (Angstrom)
+window = [0, 1, 1, 1];
+window_l = [0, 0, 40, 25];
+t = zeros(size(window));
+err = zeros(length(window), 2);
+for iw = 1:length(window)
+    input_multem.stem_window = window(iw);
+    input_multem.stem_window_lx = window_l(iw);
+    input_multem.stem_window_ly = window_l(iw);
+
+    clear ilc_multem;
+    tic;
+    output_multislice = input_multem.ilc_multem;
+    t(iw) = toc;
+
+    for idet = 1:2
+        image = output_multislice.data(1).image_tot(idet).image;
+        if(iw==1)
+            image_ref{idet} = image;
+        end
+        err(iw, idet) = max(abs(image(:)-image_ref{idet}(:)))/max(abs(image_ref{idet}(:)));
+
+        figure(1);
+        subplot(2, length(window), (idet-1)*length(window)+iw);
+        imagesc(image);
+        title(['window = ', num2str(window(iw)), ', l = ', num2str(window_l(iw)), ', err = ', num2str(err(iw, idet), '%5.2e')]);
+        axis image;
+        colormap gray;
+    end
+end
+
+for iw = 1:length(window)
+    disp(['window = ', num2str(window(iw)), ', l = ', num2str(window_l(iw)), ': time = ', num2str(t(iw), '%7.3f'), ' s, speedup = ', num2str(t(1)/t(iw), '%5.2f'), ...
+        ', max. relative error = [', num2str(err(iw, :), '%5.2e  '), ']']);
+end
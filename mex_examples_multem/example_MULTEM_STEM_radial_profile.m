@@ -0,0 +1,73 @@
+% Full radial profile for STEM (eDT_Radial): one simulation, any number of virtual annular detectors
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 11;              % eTEMST_STEM=11
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+input_multem.pn_model = 1;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+
+na = 8; nb = 8; nc = 10; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au110_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.thick_type = 1;                    % eTT_Whole_Spec = 1, eTT_Through_Thick = 2, eTT_Through_Slices = 3
+
+input_multem.nx = 512;
+input_multem.ny = 512;
+input_multem.bwl = 0;
+
+input_multem.E_0 = 300;
+input_multem.illumination_model = 1;
+input_multem.cond_lens_c_10 = 14.0312;
+input_multem.cond_lens_c_30 = 1e-03;
+input_multem.cond_lens_outer_aper_ang = 21.0;
+
+input_multem.scanning_type = 2;                 % eST_Line = 1, eST_Area = 2
+input_multem.scanning_periodic = 1;
+input_multem.scanning_ns = 32;
+input_multem.scanning_x0 = 3*a;
+input_multem.scanning_y0 = 3*b;
+input_multem.scanning_xe = 4*a;
+input_multem.scanning_ye = 4*b;
+
+input_multem.detector.type = 2;                 % eDT_Circular = 1, eDT_Radial = 2, eDT_Matrix = 3
+input_multem.detector.radial(1).x = 0;          % the profile is recorded whatever the sensitivity
+input_multem.detector.radial(1).fx = 0;
+
+clear ilc_multem;
+tic;
+output_multislice = input_multem.ilc_multem;
+toc;
+
+% radial_g: 1 x nr (Ang^-1), radial_tot: ns x nr for each thickness
+g = output_multislice.radial_g;
+theta = ilm_rAng_2_mrad(input_multem.E_0, g);                    % mrad
+ns = [length(output_multislice.y), length(output_multislice.x)];
+
+% virtual annular detectors, all from the same simulation
+det = [0, 20; 20, 40; 40, 160; 80, 200];
+for idet = 1:size(det, 1)
+    ii = (theta>=det(idet, 1)) & (theta<det(idet, 2));
+    image = reshape(sum(output_multislice.data(1).radial_tot(:, ii), 2), ns);
+    figure(1);
+    subplot(1, size(det, 1), idet);
+    imagesc(image);
+    title(['[', num2str(det(idet, 1)), ', ', num2str(det(idet, 2)), '] mrad']);
+    axis image;
+    colormap gray;
+end
@@ -0,0 +1,77 @@
+% Tiled STEM scan for a thick specimen (cpu_scan_tile)
+% Blocks of probe positions advance together through a window of slices so that
+% the stored transmission functions are reused from cache
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.cpu_nthread_scan = 1;
+input_multem.system_conf.cpu_scan_batch = 4;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 11;              % eTEMST_STEM=11
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+input_multem.pn_model = 1;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+
+na = 8; nb = 8; nc = 80; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au110_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.thick_type = 1;                    % eTT_Whole_Spec = 1, eTT_Through_Thick = 2, eTT_Through_Slices = 3
+
+input_multem.nx = 512;
+input_multem.ny = 512;
+input_multem.bwl = 0;
+
+input_multem.E_0 = 300;
+input_multem.illumination_model = 1;
+input_multem.cond_lens_c_10 = 14.0312;
+input_multem.cond_lens_c_30 = 1e-03;
+input_multem.cond_lens_outer_aper_ang = 21.0;
+
+input_multem.scanning_type = 2;                 % eST_Line = 1, eST_Area = 2
+input_multem.scanning_periodic = 1;
+input_multem.scanning_ns = 32;
+input_multem.scanning_x0 = 3*a;
+input_multem.scanning_y0 = 3*b;
+input_multem.scanning_xe = 4*a;
+input_multem.scanning_ye = 4*b;
+
+input_multem.detector.type = 1;                 % eDT_Circular = 1, eDT_Radial = 2, eDT_Matrix = 3
+input_multem.detector.cir(1).inner_ang = 40;
+input_multem.detector.cir(1).outer_ang = 160;
+
+scan_tile = [1, 2, 4, 8, 16];
+t = zeros(size(scan_tile));
+for ib = 1:length(scan_tile)
+    input_multem.system_conf.cpu_scan_tile = scan_tile(ib);
+    clear ilc_multem;
+    tic;
+    output_multislice = input_multem.ilc_multem;
+    t(ib) = toc;
+    if(ib==1)
+        image_1 = output_multislice.data(1).image_tot(1).image;
+    end
+    ee = max(abs(output_multislice.data(1).image_tot(1).image(:)-image_1(:)));
+    disp([scan_tile(ib), t(ib), t(1)/t(ib), ee])
+end
+
+[~, ib] = min(t);
+disp(['optimal cpu_scan_tile = ', num2str(scan_tile(ib))])
+
+figure(1);
+semilogx(scan_tile, t(1)./t, '-or');
+xlabel('cpu\_scan\_tile');
+ylabel('speedup');
@@ -0,0 +1,52 @@
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.pn_model = 1;                  % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+
+% wide specimen: ~10^5 atoms per slice
+na = 160; nb = 160; nc = 2; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au001_xtl(na, nb, nc, ncu, rmsd_3d);
+
+input_multem.nx = 4096; 
+input_multem.ny = 4096;
+input_multem.islice = 1;
+
+nthread = [1, 2, 4, 8, 16, 32, 64];
+potential_eval = [1, 2];                        % ePE_Scatter = 1, ePE_Gather = 2, ePE_Auto = 3
+t = zeros(length(potential_eval), length(nthread));
+for ieval = 1:length(potential_eval)
+    input_multem.potential_eval = potential_eval(ieval);
+    for ithread = 1:length(nthread)
+        input_multem.system_conf.cpu_nthread = nthread(ithread); 
+        clear ilc_projected_potential;
+        tic;
+        ouput_multislice = input_multem.ilc_projected_potential;
+        t(ieval, ithread) = toc;
+        if((ieval==1) && (ithread==1))
+            V_1 = ouput_multislice.V;
+        end
+        disp([potential_eval(ieval), nthread(ithread), t(ieval, ithread), t(ieval, 1)/t(ieval, ithread), max(abs(ouput_multislice.V(:)-V_1(:)))])
+    end
+end
+
+figure(1); 
+loglog(nthread, t(1, 1)./nthread, '-k', nthread, t(1, :), '-or', nthread, t(2, :), '-sb');
+xlabel('cpu threads');
+ylabel('time (s)');
+legend('ideal', 'scatter', 'gather');
@@ -0,0 +1,59 @@
+% Time per slice of an exit wave multislice run on 1024x1024 and 2048x2048 grids with the propagator kernels
+% computed on the fly (system_conf.prop_cache = 0) and kept in memory (system_conf.prop_cache = 4)
+% The specimen has a single slice thickness, so the cache holds one kernel for the whole run
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'crystalline_materials'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+input_multem = multem_input.parameters;         % Load default values;
+
+input_multem.system_conf.precision = 1;                     % eP_Float = 1, eP_double = 2
+input_multem.system_conf.device = 1;                        % eD_CPU = 1, eD_GPU = 2
+input_multem.system_conf.cpu_nthread = 8;
+input_multem.system_conf.gpu_device = 0;
+
+input_multem.simulation_type = 52;              % eTEMST_EWRS=52
+input_multem.pn_model = 1;                      % ePM_Still_Atom = 1, ePM_Absorptive = 2, ePM_Frozen_Phonon = 3
+input_multem.interaction_model = 1;             % eESIM_Multislice = 1, eESIM_Phase_Object = 2, eESIM_Weak_Phase_Object = 3
+input_multem.potential_slicing = 1;             % ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+input_multem.potential_type = 6;                % ePT_Doyle_0_4 = 1, ePT_Peng_0_4 = 2, ePT_Peng_0_12 = 3, ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6
+
+input_multem.iw_type = 1;                       % 1: Plane_Wave, 2: Convergent_wave, 3:User_Define, 4: auto
+input_multem.E_0 = 300;
+input_multem.theta = 0.0;
+input_multem.phi = 0.0;
+input_multem.bwl = 0;
+
+na = 8; nb = 8; nc = 40; ncu = 2; rmsd_3d = 0.085;
+
+[input_multem.spec_atoms, input_multem.spec_lx...
+, input_multem.spec_ly, input_multem.spec_lz...
+, a, b, c, input_multem.spec_dz] = Au001_xtl(na, nb, nc, ncu, rmsd_3d);
+
+[~, Slice] = ilc_spec_slicing(input_multem.toStruct);
+n_slice = size(Slice, 1);
+
+n_grid = [1024, 2048];
+prop_cache = [0, 4];
+t_slice = zeros(length(n_grid), length(prop_cache));
+for ig = 1:length(n_grid)
+    input_multem.nx = n_grid(ig);
+    input_multem.ny = n_grid(ig);
+    for ic = 1:length(prop_cache)
+        input_multem.system_conf.prop_cache = prop_cache(ic);
+        clear ilc_multem;
+        tic;
+        output_multislice = input_multem.ilc_multem;
+        t_slice(ig, ic) = toc/n_slice;
+        if(ic==1)
+            psi_1 = output_multislice.data.psi_coh;
+        end
+        ee = max(abs(output_multislice.data.psi_coh(:)-psi_1(:)));
+        disp(['nx = ny = ', num2str(n_grid(ig)), ', prop_cache = ', num2str(prop_cache(ic)), ...
+            ', time per slice = ', num2str(1e3*t_slice(ig, ic), '%6.2f'), ' ms, speedup = ', ...
+            num2str(t_slice(ig, 1)/t_slice(ig, ic), '%4.2f'), ', max |dpsi| = ', num2str(ee)])
+    end
+end
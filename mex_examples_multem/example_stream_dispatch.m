@@ -0,0 +1,26 @@
+% Time per dispatch of a host kernel on a 64x64 grid: persistent worker pool of Stream<e_host>
+% against creating and joining the threads on every call (the dispatch before the pool)
+% Copyright 2021 Ivan Lobato <Ivanlh20@gmail.com>
+
+clear; clc;
+addpath([fileparts(pwd) filesep 'mex_bin'])
+addpath([fileparts(pwd) filesep 'matlab_functions'])
+
+nx = 64;
+ny = 64;
+n_iter = 10000;
+
+nthread = [2, 4, 8, 16];
+t_pool = zeros(size(nthread));
+t_spawn = zeros(size(nthread));
+for ithread = 1:length(nthread)
+    [t_pool(ithread), t_spawn(ithread)] = ilc_stream_dispatch(nthread(ithread), nx, ny, n_iter);
+    disp(['nthread = ', num2str(nthread(ithread)), ', pool = ', num2str(t_pool(ithread), '%6.2f'), ...
+        ' us, spawn = ', num2str(t_spawn(ithread), '%6.2f'), ' us, ratio = ', num2str(t_spawn(ithread)/t_pool(ithread), '%5.1f')])
+end
+
+figure(1);
+semilogy(nthread, t_spawn, '-or', nthread, t_pool, '-sb');
+xlabel('cpu threads');
+ylabel('time per dispatch (us)');
+legend('threads per call', 'worker pool');
@@ -176,6 +176,7 @@ void run_propagate(mt::System_Configuration &system_conf, const mxArray *mx_inpu
 	input_multislice.system_conf = system_conf;
 
 	mt::Stream<dev> stream(system_conf.nstream);
+	mt::set_fftw_config(system_conf.fftw_wisdom_dir, system_conf.fftw_rigor);
 	mt::FFT<T, dev> fft_2d;
 	fft_2d.create_plan_2d(input_multislice.grid_2d.ny, input_multislice.grid_2d.nx, system_conf.nstream);
 
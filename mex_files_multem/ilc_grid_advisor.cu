@@ -0,0 +1,93 @@
+/**
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful, 
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#include "types.cuh"
+#include "matlab_types.cuh"
+#include "fft.cuh"
+#include "grid_advisor.cuh"
+
+#include <mex.h>
+#include "matlab_mex.cuh"
+
+using mt::rmatrix_r;
+
+// [nx, ny, t_fft] = ilc_grid_advisor(system_conf, lx, ly, dx, dy, n_grid)
+template <class T, mt::eDevice dev>
+void run_grid_advisor(mt::System_Configuration &system_conf, int nrhs, const mxArray *prhs[], int nlhs, mxArray *plhs[])
+{
+	int idx_0 = (system_conf.active)?1:0;
+
+	auto lx = mx_get_scalar<double>(prhs[idx_0+0]);
+	auto ly = mx_get_scalar<double>(prhs[idx_0+1]);
+	auto dx = mx_get_scalar<double>(prhs[idx_0+2]);
+	auto dy = mx_get_scalar<double>(prhs[idx_0+3]);
+	auto n_grid = (nrhs > idx_0+4)?mx_get_scalar<int>(prhs[idx_0+4]):8;
+
+	mt::set_fftw_config(system_conf.fftw_wisdom_dir, system_conf.fftw_rigor);
+
+	mt::Grid_Advisor<T, dev> grid_advisor;
+	grid_advisor.set_input_data(system_conf.cpu_nthread);
+	auto grids = grid_advisor(lx, ly, dx, dy, n_grid);
+
+	/******************************************************************/
+	auto rnx = mx_create_matrix<rmatrix_r>(grids.size(), 1, plhs[0]);
+	for(auto ig = 0; ig < grids.size(); ig++)
+	{
+		rnx[ig] = grids[ig].nx;
+	}
+
+	if(nlhs > 1)
+	{
+		auto rny = mx_create_matrix<rmatrix_r>(grids.size(), 1, plhs[1]);
+		for(auto ig = 0; ig < grids.size(); ig++)
+		{
+			rny[ig] = grids[ig].ny;
+		}
+	}
+
+	if(nlhs > 2)
+	{
+		auto rt = mx_create_matrix<rmatrix_r>(grids.size(), 1, plhs[2]);
+		for(auto ig = 0; ig < grids.size(); ig++)
+		{
+			rt[ig] = grids[ig].time;
+		}
+	}
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	auto system_conf = mt::read_system_conf(prhs[0]);
+
+	if(system_conf.is_float_host())
+	{
+		run_grid_advisor<float, mt::e_host>(system_conf, nrhs, prhs, nlhs, plhs);
+	}
+	else if(system_conf.is_double_host())
+	{
+		run_grid_advisor<double, mt::e_host>(system_conf, nrhs, prhs, nlhs, plhs);
+	}
+	else if(system_conf.is_float_device())
+	{
+		run_grid_advisor<float, mt::e_device>(system_conf, nrhs, prhs, nlhs, plhs);
+	}
+	else if(system_conf.is_double_device())
+	{
+		run_grid_advisor<double, mt::e_device>(system_conf, nrhs, prhs, nlhs, plhs);
+	}
+}
@@ -26,6 +26,7 @@
 #include "output_multislice.hpp"
 #include "atomic_data_mt.hpp"
 #include "tem_simulation.cuh"
+#include "grid_advisor.cuh"
 #include "timing.cuh"
 
 #include <mex.h>
@@ -34,6 +35,35 @@
 using mt::rmatrix_r;
 using mt::rmatrix_c;
 
+/* the FFT aware grid keeps the user grid when an input is given in its pixels: the user defined
+ * incident wave, the matrix detectors (STEM) and the output area (not STEM/EELS)
+ */
+template <class TInput_Multislice>
+bool is_grid_auto(const mxArray *mx_input_multislice, TInput_Multislice &input_multislice)
+{
+	if (!input_multislice.grid_auto || input_multislice.is_user_define_wave())
+	{
+		return false;
+	}
+
+	if (input_multislice.is_STEM())
+	{
+		mxArray *mx_detector = mxGetField(mx_input_multislice, 0, "detector");
+		return mx_get_scalar_field<mt::eDetector_Type>(mx_detector, "type") != mt::eDT_Matrix;
+	}
+	else if (input_multislice.is_EELS())
+	{
+		return true;
+	}
+
+	auto ix_0 = mx_get_scalar_field<int>(mx_input_multislice, "output_area_ix_0");
+	auto iy_0 = mx_get_scalar_field<int>(mx_input_multislice, "output_area_iy_0");
+	auto ix_e = mx_get_scalar_field<int>(mx_input_multislice, "output_area_ix_e");
+	auto iy_e = mx_get_scalar_field<int>(mx_input_multislice, "output_area_iy_e");
+
+	return (ix_0 == ix_e) && (iy_0 == iy_e);
+}
+
 template <class TInput_Multislice>
 void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice &input_multislice, bool full = true)
 {
@@ -57,6 +87,10 @@ void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice
 	input_multislice.pn_nconf = mx_get_scalar_field<int>(mx_input_multislice, "pn_nconf");
 	input_multislice.pn_dim.set(mx_get_scalar_field<int>(mx_input_multislice, "pn_dim"));
 	input_multislice.pn_seed = mx_get_scalar_field<int>(mx_input_multislice, "pn_seed");
+	if (mx_field_exits(mx_input_multislice, "pn_conv_tol"))
+	{
+		input_multislice.pn_conv_tol = mx_get_scalar_field<T_r>(mx_input_multislice, "pn_conv_tol");
+	}
 
 	/**************************** Specimen *****************************/
 	auto lx = mx_get_scalar_field<T_r>(mx_input_multislice, "spec_lx");
@@ -111,6 +145,7 @@ void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice
 
 		/************************ Potential slicing ************************/
 		input_multislice.potential_slicing = mx_get_scalar_field<mt::ePotential_Slicing>(mx_input_multislice, "potential_slicing");
+		input_multislice.potential_eval = mx_get_scalar_field<mt::ePotential_Eval>(mx_input_multislice, "potential_eval");
 	}
 
 	/************************** xy sampling ****************************/
@@ -120,10 +155,26 @@ void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice
 
 	input_multislice.grid_2d.set_input_data(nx, ny, lx, ly, dz, bwl, pbc_xy);
 
+	if (mx_field_exits(mx_input_multislice, "grid_auto"))
+	{
+		input_multislice.grid_auto = mx_get_scalar_field<bool>(mx_input_multislice, "grid_auto");
+	}
+
+	if (mx_field_exits(mx_input_multislice, "bwl_pruned"))
+	{
+		input_multislice.bwl_pruned = mx_get_scalar_field<bool>(mx_input_multislice, "bwl_pruned");
+	}
+
 	/************************ Incident wave ****************************/
 	auto iw_type = mx_get_scalar_field<mt::eIncident_Wave_Type>(mx_input_multislice, "iw_type");
 	input_multislice.set_incident_wave_type(iw_type);
 
+	// FFT aware grid size
+	if (full && is_grid_auto(mx_input_multislice, input_multislice))
+	{
+		mt::adjust_grid_2d<T_r>(input_multislice.system_conf, input_multislice.grid_2d);
+	}
+
 	if (input_multislice.is_user_define_wave() && full)
 	{
 		auto iw_psi = mx_get_matrix_field<rmatrix_c>(mx_input_multislice, "iw_psi");
@@ -303,12 +354,41 @@ void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice
 				input_multislice.detector.resize(ndetector);
 				for (auto i = 0; i < input_multislice.detector.size(); i++)
 				{
-					// auto x = mx_get_matrix_field<rmatrix_r>(mx_detector, i, "x");
-					// mt::assign(x, input_multislice.detector.x[i]);
-					// mt::scale(input_multislice.detector.x[i], 1.0/lambda);
-
+					/* the sensitivity fx(x), x in mrad ascending, is interpolated linearly on the centers
+					 * g_k = (k+1/2)*dg of the det_radial_nr() radial bins; it is zero outside [x_0, x_e]
+					 * and a single value is a constant sensitivity
+					 */
+					auto x = mx_get_matrix_field<rmatrix_r>(mx_detector, i, "x");
 					auto fx = mx_get_matrix_field<rmatrix_r>(mx_detector, i, "fx");
-					mt::assign(fx, input_multislice.detector.fx[i]);
+					int n_x = std::min(x.m_size, fx.m_size);
+
+					int nr = input_multislice.det_radial_nr();
+					T_r dg = input_multislice.det_radial_dg();
+					mt::Vector<T_r, mt::e_host> fx_r(nr, T_r(0));
+					for (auto ir = 0, ix = 0; (n_x > 0) && (ir < nr); ir++)
+					{
+						double x_r = asin(std::min(1.0, (ir+0.5)*dg*lambda))/mt::c_mrad_2_rad;
+						if (n_x == 1)
+						{
+							fx_r[ir] = fx[0];
+							continue;
+						}
+
+						if ((x_r < x[0]) || (x[n_x-1] < x_r))
+						{
+							continue;
+						}
+
+						while ((ix < n_x-2) && (x[ix+1] < x_r))
+						{
+							ix++;
+						}
+
+						double dx = x[ix+1]-x[ix];
+						double t = (dx > 0)?(x_r-x[ix])/dx:0;
+						fx_r[ir] = (1-t)*fx[ix] + t*fx[ix+1];
+					}
+					input_multislice.detector.fx[i].assign(fx_r.begin(), fx_r.end());
 				}
 			}
 		}
@@ -334,6 +414,30 @@ void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice
 		}
 		break;
 		}
+
+		/************************** 4D-STEM output ***************************/
+		if (mx_field_exits(mx_input_multislice, "stem_4d_fn"))
+		{
+			input_multislice.stem_4d.fn = mx_get_string_field(mx_input_multislice, "stem_4d_fn");
+			input_multislice.stem_4d.g_max = mt::rad_2_rAngs(input_multislice.E_0, mx_get_scalar_field<T_r>(mx_input_multislice, "stem_4d_theta_max")*mt::c_mrad_2_rad);	// maximum angle (mrad-->Angs^-1)
+			input_multislice.stem_4d.bin = mx_get_scalar_field<int>(mx_input_multislice, "stem_4d_bin");
+			input_multislice.stem_4d.f16 = mx_get_scalar_field<bool>(mx_input_multislice, "stem_4d_f16");
+			input_multislice.stem_4d.n_chunk = mx_get_scalar_field<int>(mx_input_multislice, "stem_4d_chunk");
+		}
+
+		/****************************** PRISM ********************************/
+		if (mx_field_exits(mx_input_multislice, "stem_prism_f"))
+		{
+			input_multislice.stem_prism_f = mx_get_scalar_field<int>(mx_input_multislice, "stem_prism_f");
+		}
+
+		/**************************** probe window ****************************/
+		if (mx_field_exits(mx_input_multislice, "stem_window"))
+		{
+			input_multislice.stem_window = mx_get_scalar_field<bool>(mx_input_multislice, "stem_window");
+			input_multislice.stem_window_lx = mx_get_scalar_field<T_r>(mx_input_multislice, "stem_window_lx");
+			input_multislice.stem_window_ly = mx_get_scalar_field<T_r>(mx_input_multislice, "stem_window_ly");
+		}
 	}
 	else if (input_multislice.is_PED())
 	{
@@ -393,18 +497,50 @@ void set_struct_multislice(TOutput_Multislice &output_multislice, mxArray *&mx_o
 	mx_create_set_matrix_field<rmatrix_r>(mx_output_multislice, "y", 1, output_multislice.y.size(), output_multislice.y);
 	mx_create_set_matrix_field<rmatrix_r>(mx_output_multislice, "thick", 1, output_multislice.thick.size(), output_multislice.thick);
 
+	// frozen phonon convergence control: configurations averaged and relative standard error
+	if (output_multislice.pn_nconf_run > 0)
+	{
+		mxAddField(mx_output_multislice, "pn_nconf");
+		mx_create_set_scalar_field<rmatrix_r>(mx_output_multislice, "pn_nconf", output_multislice.pn_nconf_run);
+		mxAddField(mx_output_multislice, "pn_conv_err");
+		mx_create_set_scalar_field<rmatrix_r>(mx_output_multislice, "pn_conv_err", output_multislice.pn_conv_err);
+	}
+
+	// slice storage: memory type (1: transmission, 2: potential, 4: half transmission, 5: phase, 6: 16 bit potential) and error bound
+	if (output_multislice.slice_mem_type != mt::eSMT_none)
+	{
+		mxAddField(mx_output_multislice, "slice_mem_type");
+		mx_create_set_scalar_field<rmatrix_r>(mx_output_multislice, "slice_mem_type", output_multislice.slice_mem_type);
+		mxAddField(mx_output_multislice, "slice_mem_err");
+		mx_create_set_scalar_field<rmatrix_r>(mx_output_multislice, "slice_mem_err", output_multislice.slice_mem_err);
+	}
+
 	if (output_multislice.is_STEM() || output_multislice.is_EELS())
 	{
+		// radial detector: full radial profile (scanning size x nr) for each thickness
+		bool is_radial = output_multislice.radial_tot.size() > 0;
+
 		mxArray *mx_field_data;
-		const char *field_names_data_full[] = { "image_tot", "image_coh" };
-		const char *field_names_data_partial[] = { "image_tot" };
+		const char *field_names_data_full[] = { "image_tot", "image_coh", "radial_tot" };
+		const char *field_names_data_partial[] = { "image_tot", "radial_tot" };
 		const char **field_names_data = (output_multislice.pn_coh_contrib) ? field_names_data_full : field_names_data_partial;
-		int number_of_fields_data = (output_multislice.pn_coh_contrib) ? 2 : 1;
+		int number_of_fields_data = ((output_multislice.pn_coh_contrib) ? 2 : 1) + ((is_radial) ? 1 : 0);
 		mwSize dims_data[2] = { 1, output_multislice.thick.size() };
 
 		mx_field_data = mxCreateStructArray(2, dims_data, number_of_fields_data, field_names_data);
 		mxSetField(mx_output_multislice, 0, "data", mx_field_data);
 
+		if (is_radial)
+		{
+			mxAddField(mx_output_multislice, "radial_g");
+			mx_create_set_matrix_field<rmatrix_r>(mx_output_multislice, "radial_g", 1, output_multislice.nr, output_multislice.radial_g);
+
+			for (auto ithk = 0; ithk < output_multislice.thick.size(); ithk++)
+			{
+				mx_create_set_matrix_field<rmatrix_r>(mx_field_data, ithk, "radial_tot", output_multislice.nxy(), output_multislice.nr, output_multislice.radial_tot[ithk]);
+			}
+		}
+
 		mxArray *mx_field_detector_tot;
 		mxArray *mx_field_detector_coh;
 		const char *field_names_detector[] = { "image" };
@@ -484,9 +620,11 @@ template <class T, mt::eDevice dev>
 void run_multislice(mt::System_Configuration &system_conf, const mxArray *mx_input_multislice, 
 mxArray *&mx_output_multislice)
 {
+	mt::set_fftw_config(system_conf.fftw_wisdom_dir, system_conf.fftw_rigor);
+
 	mt::Input_Multislice<T> input_multislice;
-	read_input_multislice(mx_input_multislice, input_multislice);
 	input_multislice.system_conf = system_conf;
+	read_input_multislice(mx_input_multislice, input_multislice);
 
 	mt::Stream<dev> stream(system_conf.nstream);
 
@@ -496,6 +634,12 @@ mxArray *&mx_output_multislice)
 	mt::Multislice<T, dev> tem_simulation;
 	tem_simulation.set_input_data(&input_multislice, &stream, &fft_2d);
 
+	if (tem_simulation.is_stem_4d_error())
+	{
+		fft_2d.cleanup();
+		mexErrMsgIdAndTxt("multem:stem_4d", "The 4D-STEM file '%s' can not be created", input_multislice.stem_4d.fn.c_str());
+	}
+
 	mt::Output_Multislice<T> output_multislice;
 	output_multislice.set_input_data(&input_multislice);
 
@@ -94,6 +94,7 @@ void read_input_multislice(const mxArray *mx_input_multislice, TInput_Multislice
 
 	/************************ Potential slicing ************************/
 	input_multislice.potential_slicing = mx_get_scalar_field<mt::ePotential_Slicing>(mx_input_multislice, "potential_slicing");
+	input_multislice.potential_eval = mx_get_scalar_field<mt::ePotential_Eval>(mx_input_multislice, "potential_eval");
 
 	/************************** xy sampling ****************************/
 	auto nx = mx_get_scalar_field<int>(mx_input_multislice, "nx");
@@ -0,0 +1,86 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#include "types.cuh"
+#include "matlab_types.cuh"
+#include "cgpu_fcns.cuh"
+#include "stem_4d.cuh"
+
+#include <mex.h>
+#include "matlab_mex.cuh"
+
+using mt::rmatrix_r;
+
+/* virtual detector images from a 4D-STEM store
+ * data = ilc_stem_4d_vdet(fn, det, ithk)
+ * det: [inner_ang, outer_ang] (mrad) of one annular detector per row, or a nky x nkx mask
+ * data(iDet).image: scanning image of each detector
+ */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*************************Input data**************************/
+	auto fn = mx_get_string(prhs[0]);
+	auto det = mx_get_matrix<rmatrix_r>(prhs[1]);
+	auto ithk = (nrhs > 2) ? mx_get_scalar<int>(prhs[2])-1 : 0;
+
+	mt::STEM_4D_Reader reader;
+	if(!reader.open(fn))
+	{
+		mxArray *mx_empty;
+		mx_create_matrix<rmatrix_r>(0, 0, mx_empty);
+		plhs[0] = mx_empty;
+		return;
+	}
+
+	auto &header = reader.header;
+	ithk = max(0, min(ithk, header.nthk-1));
+
+	std::vector<std::vector<float>> mask;
+	if((det.rows == header.nky) && (det.cols == header.nkx))
+	{
+		mask.resize(1);
+		mask[0].assign(det.real, det.real + header.npix());
+	}
+	else
+	{
+		mask.resize(det.rows);
+		for(auto iDet = 0; iDet < det.rows; iDet++)
+		{
+			auto g_inner = mt::rad_2_rAngs(header.E_0, det.real[iDet]*mt::c_mrad_2_rad);
+			auto g_outer = mt::rad_2_rAngs(header.E_0, det.real[det.rows+iDet]*mt::c_mrad_2_rad);
+			header.annular_mask(g_inner, g_outer, mask[iDet]);
+		}
+	}
+
+	std::vector<std::vector<float>> image;
+	reader.virtual_image(ithk, mask, image);
+
+	/************************Output data**************************/
+	const char *field_names_data[] = { "image" };
+	mwSize dims_data[2] = { 1, mask.size() };
+	plhs[0] = mxCreateStructArray(2, dims_data, 1, field_names_data);
+
+	for(auto iDet = 0; iDet < image.size(); iDet++)
+	{
+		auto image_o = mx_create_matrix_field<rmatrix_r>(plhs[0], iDet, "image", header.nsy, header.nsx);
+		for(auto iscan = 0; iscan < header.ns(); iscan++)
+		{
+			image_o.real[iscan] = image[iDet][iscan];
+		}
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful, 
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "types.cuh"
+#include "matlab_types.cuh"
+#include "stream.cuh"
+
+#include <mex.h>
+#include "matlab_mex.cuh"
+
+using mt::rmatrix_r;
+
+/* Dispatch of the host streams before the worker pool: nstream-1 threads are created for each
+ * call, the calling thread runs the last range and the threads are joined and their array is
+ * allocated again, as Stream<e_host>::exec_vector and synchronize did.
+ */
+struct Stream_Spawn
+{
+	public:
+		Stream_Spawn(int nstream_i): nstream(nstream_i), nxy(0), stream(nullptr)
+		{
+			stream = new std::thread[nstream-1];
+		}
+
+		~Stream_Spawn()
+		{
+			delete [] stream;
+		}
+
+		void set_grid(const int &nx, const int &ny)
+		{
+			nxy = nx*ny;
+		}
+
+		template <class TFn, class... TArgs>
+		void exec_vector(TFn &fn, TArgs &...arg)
+		{
+			auto thr_fn_v = [&](const int &ixy_0, const int &ixy_e)
+			{
+				for(auto ixy = ixy_0; ixy < ixy_e; ixy++)
+				{
+					fn(ixy, arg...);
+				}
+			};
+
+			int qnxy = nxy/nstream;
+			for(auto istream = 0; istream < nstream-1; istream++)
+			{
+				stream[istream] = std::thread(thr_fn_v, istream*qnxy, (istream+1)*qnxy);
+			}
+
+			thr_fn_v((nstream-1)*qnxy, nxy);
+
+			for(auto istream = 0; istream < nstream-1; istream++)
+			{
+				stream[istream].join();
+			}
+			delete [] stream;
+			stream = new std::thread[nstream-1];
+		}
+
+	private:
+		int nstream;
+		int nxy;
+		std::thread *stream;
+};
+
+// time per dispatch (us) of exec_vector with a trivial kernel
+template <class TStream>
+double time_dispatch(TStream &stream, const int &nx, const int &ny, const int &n_iter)
+{
+	std::vector<double> M(nx*ny, 0);
+	auto thr_add = [](const int &ixy, std::vector<double> &M)
+	{
+		M[ixy] += 1;
+	};
+
+	stream.set_grid(nx, ny);
+	stream.exec_vector(thr_add, M);
+
+	auto t_0 = std::chrono::high_resolution_clock::now();
+	for(auto iter = 0; iter < n_iter; iter++)
+	{
+		stream.exec_vector(thr_add, M);
+	}
+	auto t_e = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::micro>(t_e - t_0).count()/n_iter;
+}
+
+// [t_pool, t_spawn] = ilc_stream_dispatch(nthread, nx, ny, n_iter)
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	auto nthread = std::max(2, mx_get_scalar<int>(prhs[0]));
+	auto nx = (nrhs > 1)?mx_get_scalar<int>(prhs[1]):64;
+	auto ny = (nrhs > 2)?mx_get_scalar<int>(prhs[2]):64;
+	auto n_iter = (nrhs > 3)?mx_get_scalar<int>(prhs[3]):10000;
+
+	mt::Stream<mt::e_host> stream_pool(nthread);
+	auto t_pool = time_dispatch(stream_pool, nx, ny, n_iter);
+
+	Stream_Spawn stream_spawn(nthread);
+	auto t_spawn = time_dispatch(stream_spawn, nx, ny, n_iter);
+
+	/******************************************************************/
+	auto rt_pool = mx_create_scalar<rmatrix_r>(plhs[0]);
+	rt_pool[0] = t_pool;
+
+	if(nlhs > 1)
+	{
+		auto rt_spawn = mx_create_scalar<rmatrix_r>(plhs[1]);
+		rt_spawn[0] = t_spawn;
+	}
+}
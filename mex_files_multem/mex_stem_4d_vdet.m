@@ -0,0 +1,4 @@
+clc; clear all;
+addpath( '../matlab_functions')
+
+ilm_mex('release', 'ilc_stem_4d_vdet.cpp', '../src');
\ No newline at end of file
@@ -0,0 +1,4 @@
+clc; clear all;
+addpath( '../matlab_functions')
+  
+ilm_mex('release', 'ilc_stream_dispatch.cu', '../src');
\ No newline at end of file
@@ -0,0 +1,305 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef ATOM_TYPE_CACHE_H
+#define ATOM_TYPE_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <random>
+
+#include "math.cuh"
+#include "types.cuh"
+
+namespace mt
+{
+	/* On-disk cache of the atomic types: one file per atomic number and (precision, potential_type, Vrl, nR, dR_min).
+	 * The key is stored in the file header and checked on reading. Files are written to a temporary name
+	 * and renamed, so concurrent processes sharing the directory never read a partial file.
+	 */
+	template <class T>
+	class Atom_Type_Cache
+	{
+		public:
+			using T_r = T;
+			using TAtom_Type = Atom_Type<T, e_host>;
+
+			Atom_Type_Cache(): potential_type(ePT_Lobato_0_12), Vrl(c_Vrl), nR(c_nR), dR_min(0){}
+
+			void set_input_data(const std::string &dir_i, const ePotential_Type &potential_type_i,
+			const double &Vrl_i, const int &nR_i, const double &dR_min_i)
+			{
+				dir = dir_i;
+				potential_type = potential_type_i;
+				Vrl = Vrl_i;
+				nR = nR_i;
+				dR_min = dR_min_i;
+			}
+
+			bool is_enabled() const
+			{
+				return !dir.empty();
+			}
+
+			bool read(const int &Z, TAtom_Type &atom_type)
+			{
+				if(!is_enabled())
+				{
+					return false;
+				}
+
+				std::ifstream file(get_fn(Z), std::ios::in | std::ios::binary);
+				if(!file.is_open())
+				{
+					return false;
+				}
+
+				Header header;
+				file.read(reinterpret_cast<char*>(&header), sizeof(Header));
+				if(!file || !is_header(header, Z))
+				{
+					return false;
+				}
+
+				TAtom_Type atom_type_r;
+				get(file, atom_type_r.Z);
+				get(file, atom_type_r.m);
+				get(file, atom_type_r.A);
+				get(file, atom_type_r.rn_e);
+				get(file, atom_type_r.rn_c);
+				get(file, atom_type_r.ra_e);
+				get(file, atom_type_r.ra_c);
+
+				int64_t n_coef = 0;
+				get(file, n_coef);
+				if(!file || (n_coef < 0) || (n_coef > c_nAtomsIons))
+				{
+					return false;
+				}
+
+				atom_type_r.coef.resize(n_coef);
+				for(auto &coef: atom_type_r.coef)
+				{
+					get(file, coef.charge);
+					get(file, coef.tag);
+					get(file, coef.R_min);
+					get(file, coef.R_max);
+					get(file, coef.R_tap);
+					get(file, coef.tap_cf);
+					get(file, coef.feg.cl);
+					get(file, coef.feg.cnl);
+					get(file, coef.fxg.cl);
+					get(file, coef.fxg.cnl);
+					get(file, coef.Pr.cl);
+					get(file, coef.Pr.cnl);
+					get(file, coef.Vr.cl);
+					get(file, coef.Vr.cnl);
+					get(file, coef.VR.cl);
+					get(file, coef.VR.cnl);
+					get(file, coef.R);
+					get(file, coef.R2);
+					get(file, coef.ciVR.c0);
+					get(file, coef.ciVR.c1);
+					get(file, coef.ciVR.c2);
+					get(file, coef.ciVR.c3);
+				}
+
+				if(!file)
+				{
+					return false;
+				}
+
+				atom_type.assign(atom_type_r);
+
+				return true;
+			}
+
+			void write(const int &Z, TAtom_Type &atom_type)
+			{
+				if(!is_enabled())
+				{
+					return;
+				}
+
+				auto fn = get_fn(Z);
+				std::random_device rd;
+				auto fn_tmp = fn + ".tmp" + std::to_string(rd());
+
+				std::ofstream file(fn_tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+				if(!file.is_open())
+				{
+					return;
+				}
+
+				Header header = get_header(Z);
+				file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+				put(file, atom_type.Z);
+				put(file, atom_type.m);
+				put(file, atom_type.A);
+				put(file, atom_type.rn_e);
+				put(file, atom_type.rn_c);
+				put(file, atom_type.ra_e);
+				put(file, atom_type.ra_c);
+
+				put(file, static_cast<int64_t>(atom_type.coef.size()));
+				for(auto &coef: atom_type.coef)
+				{
+					put(file, coef.charge);
+					put(file, coef.tag);
+					put(file, coef.R_min);
+					put(file, coef.R_max);
+					put(file, coef.R_tap);
+					put(file, coef.tap_cf);
+					put(file, coef.feg.cl);
+					put(file, coef.feg.cnl);
+					put(file, coef.fxg.cl);
+					put(file, coef.fxg.cnl);
+					put(file, coef.Pr.cl);
+					put(file, coef.Pr.cnl);
+					put(file, coef.Vr.cl);
+					put(file, coef.Vr.cnl);
+					put(file, coef.VR.cl);
+					put(file, coef.VR.cnl);
+					put(file, coef.R);
+					put(file, coef.R2);
+					put(file, coef.ciVR.c0);
+					put(file, coef.ciVR.c1);
+					put(file, coef.ciVR.c2);
+					put(file, coef.ciVR.c3);
+				}
+
+				file.close();
+
+				// the file becomes visible complete, or not at all
+				if(file.fail() || (std::rename(fn_tmp.c_str(), fn.c_str()) != 0))
+				{
+					std::remove(fn_tmp.c_str());
+				}
+			}
+
+		private:
+			static const int c_version = 1;
+
+			struct Header
+			{
+				char magic[8];
+				int32_t version;
+				int32_t size_T;
+				int32_t potential_type;
+				int32_t nR;
+				int32_t Z;
+				int32_t reserved;
+				double Vrl;
+				double dR_min;
+			};
+
+			Header get_header(const int &Z) const
+			{
+				Header header;
+				std::memset(&header, 0, sizeof(Header));
+				std::memcpy(header.magic, "MTATYPE ", 8);
+				header.version = c_version;
+				header.size_T = sizeof(T);
+				header.potential_type = static_cast<int32_t>(potential_type);
+				header.nR = nR;
+				header.Z = Z;
+				header.Vrl = Vrl;
+				header.dR_min = dR_min;
+
+				return header;
+			}
+
+			bool is_header(const Header &header_r, const int &Z) const
+			{
+				auto header = get_header(Z);
+				return std::memcmp(&header, &header_r, sizeof(Header)) == 0;
+			}
+
+			// FNV-1a hash of the key
+			std::string get_fn(const int &Z) const
+			{
+				auto header = get_header(Z);
+				auto p = reinterpret_cast<const unsigned char*>(&header);
+
+				uint64_t hash = 14695981039346656037ull;
+				for(auto ib = 0; ib < sizeof(Header); ib++)
+				{
+					hash = (hash ^ p[ib])*1099511628211ull;
+				}
+
+				char name[64];
+				std::snprintf(name, sizeof(name), "atom_type_%03d_%016llx.bin", Z, static_cast<unsigned long long>(hash));
+
+				auto sep = ((dir.back() == '/') || (dir.back() == '\\'))?"":"/";
+				return dir + sep + name;
+			}
+
+			template <class U>
+			void put(std::ostream &out, const U &v)
+			{
+				out.write(reinterpret_cast<const char*>(&v), sizeof(U));
+			}
+
+			void put(std::ostream &out, const Vector<T, e_host> &v)
+			{
+				put(out, static_cast<int64_t>(v.size()));
+				if(v.size() > 0)
+				{
+					out.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(T));
+				}
+			}
+
+			template <class U>
+			void get(std::istream &in, U &v)
+			{
+				in.read(reinterpret_cast<char*>(&v), sizeof(U));
+			}
+
+			void get(std::istream &in, Vector<T, e_host> &v)
+			{
+				int64_t n = 0;
+				get(in, n);
+				if(!in || (n < 0) || (n > c_size_max))
+				{
+					in.setstate(std::ios::failbit);
+					return;
+				}
+
+				v.resize(n);
+				if(n > 0)
+				{
+					in.read(reinterpret_cast<char*>(v.data()), n*sizeof(T));
+				}
+			}
+
+			static const int64_t c_size_max = 1048576; 		// maximum size of a table read from a file
+
+			std::string dir; 								// cache directory, empty: no cache
+			ePotential_Type potential_type;
+			double Vrl;
+			int nR;
+			double dR_min;
+	};
+
+} // namespace mt
+
+#endif
@@ -633,19 +633,12 @@ namespace mt
 				auto gauss_eval = [](Stream<e_host> &stream, Grid_2d<T> &grid_2d, 
 				Vector<Gauss_Sp<T>, e_host> &gauss, TVector_r &M_o)
 				{
-					if(stream.n_act_stream<= 0)
+					auto thr_gauss_eval = [&](const int &istream)
 					{
-						return;
-					}
-
-					for(auto istream = 0; istream < stream.n_act_stream-1; istream++)
-					{
-						stream[istream] = std::thread(std::bind(host_detail::gauss_eval<T>, std::ref(stream), std::ref(grid_2d), std::ref(gauss[istream]), std::ref(M_o)));
-					}
-
-					host_detail::gauss_eval<T>(stream, grid_2d, gauss[stream.n_act_stream-1], M_o);
+						host_detail::gauss_eval<T>(stream, grid_2d, gauss[istream], M_o);
+					};
 
-					stream.synchronize();
+					stream.exec_istream(thr_gauss_eval);
 				};
 
 				mt::fill(*stream, Im, 0.0);
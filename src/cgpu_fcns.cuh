@@ -21,6 +21,7 @@
 
 #include <type_traits>
 #include <algorithm>
+#include <cstdint>
 
 #include "math.cuh"
 #include "types.cuh"
@@ -33,6 +34,7 @@
 #include <thrust/transform.h>
 #include <thrust/reduce.h>
 #include <thrust/transform_reduce.h>
+#include <thrust/inner_product.h>
 #include <thrust/functional.h>
 #include <thrust/for_each.h>
 #include <thrust/sort.h>
@@ -258,6 +260,70 @@ namespace mt
 			sum_v = t;
 		}
 
+		/* float <-> IEEE half precision bits with round to nearest even
+		 * F. Giesen, https:// gist.github.com/rygorous/2156668
+		 */
+		DEVICE_CALLABLE FORCE_INLINE 
+		uint16_t float_to_half(const float &x)
+		{
+			union { float f; uint32_t u; } v, denorm_magic;
+			v.f = x;
+			denorm_magic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+
+			const uint32_t sign = v.u & 0x80000000u;
+			v.u ^= sign;
+
+			uint32_t h;
+			if(v.u >= ((127 + 16) << 23))
+			{
+				// inf or nan
+				h = (v.u > (255u << 23))?0x7e00:0x7c00;
+			}
+			else if(v.u < (113 << 23))
+			{
+				// subnormal or zero
+				v.f += denorm_magic.f;
+				h = v.u - denorm_magic.u;
+			}
+			else
+			{
+				const uint32_t mant_odd = (v.u >> 13) & 1;
+				v.u += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff;
+				v.u += mant_odd;
+				h = v.u >> 13;
+			}
+
+			return static_cast<uint16_t>(h | (sign >> 16));
+		}
+
+		DEVICE_CALLABLE FORCE_INLINE 
+		float half_to_float(const uint16_t &h)
+		{
+			union { float f; uint32_t u; } v, magic;
+			magic.u = 113 << 23;
+			const uint32_t shifted_exp = 0x7c00 << 13;
+
+			v.u = (h & 0x7fff) << 13;
+			const uint32_t exp = shifted_exp & v.u;
+			v.u += (127 - 15) << 23;
+
+			if(exp == shifted_exp)
+			{
+				// inf or nan
+				v.u += (128 - 16) << 23;
+			}
+			else if(exp == 0)
+			{
+				// subnormal or zero
+				v.u += 1 << 23;
+				v.f -= magic.f;
+			}
+
+			v.u |= static_cast<uint32_t>(h & 0x8000) << 16;
+
+			return v.f;
+		}
+
 		template <class TFn, class T>
 		inline
 		T Root_Finder(TFn fn, T x0, T xe, const T Tol = 1e-8, const int itMax = 200)
@@ -1844,6 +1910,18 @@ namespace mt
 			psi_o[ixy] = polar(m, theta)*psi_i[ixy];
 		}
 
+		template <class TGrid, class TVector_c>
+		DEVICE_CALLABLE FORCE_INLINE 
+		void propagator_kernel(const int &ix, const int &iy, const TGrid &grid_2d, const Value_type<TGrid> &w, 
+		const Value_type<TGrid> &gx_0, const Value_type<TGrid> &gy_0, TVector_c &prop_o)
+		{
+			const int ixy = grid_2d.ind_col(ix, iy);
+			const auto m = grid_2d.bwl_factor_shift(ix, iy)/grid_2d.nxy_r();
+			const auto theta = w*grid_2d.g2_shift(ix, iy, gx_0, gy_0);
+
+			prop_o[ixy] = polar(m, theta);
+		}
+
 		/********************* phase shifts real space **********************/
 		template <class TGrid, class TVector_c>
 		DEVICE_CALLABLE FORCE_INLINE 
@@ -1988,6 +2066,49 @@ namespace mt
 			fPsi_o[ixy] = v;
 		}
 
+		// shifted probe from a probe at the origin: the position enters exp_i_chi as a separable phase ramp
+		template <class TGrid, class TVector_c>
+		DEVICE_CALLABLE FORCE_INLINE 
+		void add_shift_probe(const int &ix, const int &iy, const TGrid &grid_2d, TVector_c &ex, 
+		TVector_c &ey, TVector_c &fPsi_i, TVector_c &fPsi_o)
+		{
+			int ixy = grid_2d.ind_col(ix, iy);
+			fPsi_o[ixy] += fPsi_i[ixy]*ex[ix]*ey[iy];
+		}
+
+		// PRISM: adds the weighted S-matrix beams to pixel (jx, jy) of the probe window starting at (ix_0, iy_0)
+		template <class TGrid, class TVector_c>
+		DEVICE_CALLABLE FORCE_INLINE 
+		void add_smatrix_beams(const int &jx, const int &jy, const TGrid &grid_2d, const TGrid &grid_w, 
+		const int &ix_0, const int &iy_0, TVector_c &coef, TVector_c &S, TVector_c &psi_w)
+		{
+			using T_c = Value_type<TVector_c>;
+
+			const int ix = (ix_0 + jx) % grid_2d.nx;
+			const int iy = (iy_0 + jy) % grid_2d.ny;
+			const long long ixy = grid_2d.ind_col(ix, iy);
+			const long long nxy = grid_2d.nxy();
+
+			T_c sum = 0;
+			for(auto ib = 0; ib < coef.size(); ib++)
+			{
+				sum += coef[ib]*S[ib*nxy+ixy];
+			}
+			psi_w[grid_w.ind_col(jx, jy)] += sum;
+		}
+
+		// probe window: multiplies pixel (jx, jy) of the window starting at (ix_0, iy_0) by the transmission function of the full grid
+		template <class TGrid, class TVector_c>
+		DEVICE_CALLABLE FORCE_INLINE 
+		void multiply_window(const int &jx, const int &jy, const TGrid &grid_2d, const TGrid &grid_w, 
+		const int &ix_0, const int &iy_0, TVector_c &trans, TVector_c &psi_w)
+		{
+			const int ix = (ix_0 + jx) % grid_2d.nx;
+			const int iy = (iy_0 + jy) % grid_2d.ny;
+
+			psi_w[grid_w.ind_col(jx, jy)] *= trans[grid_2d.ind_col(ix, iy)];
+		}
+
 		template <class TGrid, class TVector_c>
 		DEVICE_CALLABLE FORCE_INLINE 
 		void apply_CTF(const int &ix, const int &iy, const TGrid &grid_2d, const Lens<Value_type<TGrid>> &lens, 
@@ -3299,6 +3420,110 @@ namespace mt
 				}
 			}
 		};
+
+		/******************** compressed slice storage *********************/
+		// complex number as two half precision numbers: real part in the low bits
+		template <class T>
+		struct encode_half_complex
+		{
+			DEVICE_CALLABLE
+			uint32_t operator()(const complex<T> &x) const 
+			{ 
+				return static_cast<uint32_t>(host_device_detail::float_to_half(static_cast<float>(x.real())))
+					| (static_cast<uint32_t>(host_device_detail::float_to_half(static_cast<float>(x.imag()))) << 16);
+			}
+		};
+
+		template <class T>
+		struct decode_half_complex
+		{
+			DEVICE_CALLABLE
+			complex<T> operator()(const uint32_t &x) const 
+			{ 
+				return complex<T>(host_device_detail::half_to_float(static_cast<uint16_t>(x & 0xffff)), 
+					host_device_detail::half_to_float(static_cast<uint16_t>(x >> 16)));
+			}
+		};
+
+		template <class T>
+		struct error_half_complex
+		{
+			DEVICE_CALLABLE
+			T operator()(const complex<T> &x) const 
+			{ 
+				return abs(x - decode_half_complex<T>()(encode_half_complex<T>()(x)));
+			}
+		};
+
+		// phase w*V of a unit modulus transmission function on 2^16 levels of [0, 2*pi)
+		template <class T>
+		struct encode_phase
+		{
+			const T w;
+			encode_phase(T w_i): w(w_i){}
+
+			template <class U>
+			DEVICE_CALLABLE
+			uint16_t operator()(const U &x) const 
+			{ 
+				const T c_i2Pi = 0.159154943091895335769;
+				T f = w*x*c_i2Pi;
+				f = f - floor(f);
+				return static_cast<uint16_t>(static_cast<uint32_t>(floor(f*T(65536) + T(0.5))) & 0xffff);
+			}
+		};
+
+		template <class T>
+		struct decode_phase
+		{
+			DEVICE_CALLABLE
+			complex<T> operator()(const uint16_t &x) const 
+			{ 
+				const T c_2Pi = 6.283185307179586476925;
+				return euler(T(x)*(c_2Pi/T(65536)));
+			}
+		};
+
+		// potential on 2^16 levels of [V_0, V_0 + 65535*dV]
+		template <class T>
+		struct encode_quantized
+		{
+			const T V_0;
+			const T idV;
+			encode_quantized(T V_0_i, T dV_i): V_0(V_0_i), idV((dV_i > 0)?1/dV_i:0){}
+
+			template <class U>
+			DEVICE_CALLABLE
+			uint16_t operator()(const U &x) const 
+			{ 
+				T q = floor((x - V_0)*idV + T(0.5));
+				return static_cast<uint16_t>((q < 0)?0:((q > T(65535))?65535:q));
+			}
+		};
+
+		template <class T>
+		struct decode_quantized
+		{
+			const T V_0;
+			const T dV;
+			decode_quantized(T V_0_i, T dV_i): V_0(V_0_i), dV(dV_i){}
+
+			DEVICE_CALLABLE
+			T operator()(const uint16_t &x) const 
+			{ 
+				return V_0 + T(x)*dV;
+			}
+		};
+
+		template <class T>
+		struct error_complex
+		{
+			DEVICE_CALLABLE
+			T operator()(const complex<T> &x, const complex<T> &y) const 
+			{ 
+				return abs(x - y);
+			}
+		};
 	} // namespace functor
 
 	template <class TVector>
@@ -20,6 +20,7 @@
 #define CGPU_RAND_H
 
 #include <random>
+#include <cstdint>
 
 #include "math.cuh"
 #include "types.cuh"
@@ -400,6 +401,94 @@ namespace mt
 			std::normal_distribution<T> randn_z;
 	};
 
+	/****************** Philox4x32-10 counter-based generator ******************/
+	// Salmon et al., Parallel random numbers: as easy as 1, 2, 3 (SC11)
+	struct Philox_4x32
+	{
+		public:
+			DEVICE_CALLABLE FORCE_INLINE
+			static void gen(uint32_t ctr[4], uint32_t key[2])
+			{
+				for(auto ir = 0; ir < 10; ir++)
+				{
+					round(ctr, key);
+					key[0] += c_w0;
+					key[1] += c_w1;
+				}
+			}
+
+		private:
+			static const uint32_t c_m0 = 0xD2511F53u;
+			static const uint32_t c_m1 = 0xCD9E8D57u;
+			static const uint32_t c_w0 = 0x9E3779B9u;
+			static const uint32_t c_w1 = 0xBB67AE85u;
+
+			DEVICE_CALLABLE FORCE_INLINE
+			static void round(uint32_t ctr[4], const uint32_t key[2])
+			{
+				uint64_t p0 = static_cast<uint64_t>(c_m0)*ctr[0];
+				uint64_t p1 = static_cast<uint64_t>(c_m1)*ctr[2];
+
+				uint32_t c0 = static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0];
+				uint32_t c2 = static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1];
+
+				ctr[0] = c0;
+				ctr[1] = static_cast<uint32_t>(p1);
+				ctr[2] = c2;
+				ctr[3] = static_cast<uint32_t>(p0);
+			}
+	};
+
+	/************** counter-based normal 3d distribution ***************/
+	/* the values of item idx of the configuration iconf are a function of (seed, iconf, idx):
+	 * they can be evaluated in any order, on any device and for any single configuration
+	 */
+	template <class T>
+	struct Philox_Randn_3d
+	{
+		public:
+			using value_type = T;
+
+			Philox_Randn_3d(): m_seed(300183), m_iconf(1), m_bx(true), m_by(true), m_bz(true){}
+
+			void seed(int seed, int iconf=1)
+			{
+				m_seed = seed;
+				m_iconf = max(1, iconf);
+			}
+
+			void set_activation(const bool &bx, const bool &by, const bool &bz)
+			{
+				m_bx = bx;
+				m_by = by;
+				m_bz = bz;
+			}
+
+			DEVICE_CALLABLE
+			r3d<T> operator()(const int &idx, const T &x, const T &y, const T &z) const
+			{
+				uint32_t ctr[4] = {static_cast<uint32_t>(idx), static_cast<uint32_t>(m_iconf), 0u, 0u};
+				uint32_t key[2] = {static_cast<uint32_t>(m_seed), 0x4D554C54u};
+				Philox_4x32::gen(ctr, key);
+
+				// Box-Muller transform: uniforms in (0, 1]
+				const T c_u = T(2.3283064365386963e-10);
+				T r_0 = sqrt(T(-2)*log(c_u*(T(ctr[0])+T(1))));
+				T r_1 = sqrt(T(-2)*log(c_u*(T(ctr[2])+T(1))));
+				T theta_0 = c_2Pi*c_u*T(ctr[1]);
+				T theta_1 = c_2Pi*c_u*T(ctr[3]);
+
+				return r3d<T>((m_bx)?(x*r_0*cos(theta_0)):0, (m_by)?(y*r_0*sin(theta_0)):0, (m_bz)?(z*r_1*cos(theta_1)):0);
+			}
+
+		private:
+			int m_seed;
+			int m_iconf;
+			bool m_bx;
+			bool m_by;
+			bool m_bz;
+	};
+
 	/***************************************************************/
 
 	// add Gaussian noise
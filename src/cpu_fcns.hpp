@@ -229,36 +229,37 @@ namespace mt
 			}
 		}
 
-		// Cubic polynomial evaluation
+		// Cubic polynomial evaluation: only the (pbc) pixels inside range are written
 		template <class T>
-		void eval_cubic_poly(Stream<e_host> &stream, Grid_2d<T> &grid_2d, Atom_Vp<T> &atom, rVector<T> M_o)
+		void eval_cubic_poly(const Range_2d &range, Grid_2d<T> &grid_2d, Atom_Vp<T> &atom, rVector<T> M_o)
 		{
 			for (auto ix_0 = 0; ix_0 < atom.nx; ix_0++)
 			{
-				int iyc = 0;
+				const int ix = ix_0 + atom.ix_0;
+				const int ix_pbc = grid_2d.iRx_pbc(ix);
+				if ((ix_pbc < range.ix_0) || (range.ix_e <= ix_pbc))
+				{
+					continue;
+				}
+
 				for (auto iy_0 = 0; iy_0 < atom.ny; iy_0++)
 				{
-					int ix = ix_0 + atom.ix_0;
-					int iy = iy_0 + atom.iy_0;
-					const auto R2 = grid_2d.R2(ix, iy, atom.x, atom.y);
+					const int iy = iy_0 + atom.iy_0;
+					const int iy_pbc = grid_2d.iRy_pbc(iy);
+					if ((iy_pbc < range.iy_0) || (range.iy_e <= iy_pbc))
+					{
+						continue;
+					}
 
+					const auto R2 = grid_2d.R2(ix, iy, atom.x, atom.y);
 					if (R2 < atom.R2_max)
 					{
 						const T V = atom.occ*host_device_detail::eval_cubic_poly(R2, atom);
-						const int ixy = grid_2d.ind_col_pbc_shift(ix, iy);
+						const int ixy = grid_2d.iRx_shift(ix_pbc)*grid_2d.ny + grid_2d.iRy_shift(iy_pbc);
 
-						atom.iv[iyc] = ixy;
-						atom.v[iyc] = V;
-						iyc++;
+						M_o.V[ixy] += V;
 					}
 				}
-
-				stream.stream_mutex.lock();
-				for (auto iy_0 = 0; iy_0 < iyc; iy_0++)
-				{
-					M_o.V[atom.iv[iy_0]] += atom.v[iy_0];
-				}
-				stream.stream_mutex.unlock();
 			}
 		}
 
@@ -599,6 +600,22 @@ namespace mt
 		scale(stream, w_i, M_io, M_io);
 	}
 
+	// M_o = fn(M_i), element wise
+	template <class TVector_1, class TVector_2, class TFunctor>
+	enable_if_host_vector_and_host_vector<TVector_1, TVector_2, void>
+	transform_vector(Stream<e_host> &stream, TVector_1 &M_i, TVector_2 &M_o, TFunctor fn)
+	{
+		auto thr_transform = [&](const Range_2d &range)
+		{
+			thrust::transform(M_i.begin() + range.ixy_0, M_i.begin() + range.ixy_e,
+				M_o.begin() + range.ixy_0, fn);
+		};
+
+		stream.set_n_act_stream(M_o.size());
+		stream.set_grid(1, M_o.size());
+		stream.exec(thr_transform);
+	}
+
 	template <class TVector_1, class TVector_2>
 	enable_if_host_vector_and_host_vector<TVector_1, TVector_2, void>
 	square(Stream<e_host> &stream, TVector_1 &M_i, TVector_2 &M_o)
@@ -774,6 +791,29 @@ namespace mt
 		multiply(stream, M_i, M_io, M_io);
 	}
 
+	// M_io holds M_io.size()/M_i.size() consecutive arrays, all of them are multiplied by M_i.
+	// Each thread applies its block of M_i to every array, so M_i is read from memory once.
+	template <class TVector_1, class TVector_2>
+	enable_if_host_vector_and_host_vector<TVector_1, TVector_2, void>
+		multiply_batch(Stream<e_host> &stream, TVector_1 &M_i, TVector_2 &M_io)
+	{
+		using value_type = Value_type<TVector_2>;
+		int n_batch = M_io.size()/M_i.size();
+		auto thr_multiply_batch = [&](const Range_2d &range)
+		{
+			for(auto ib = 0; ib < n_batch; ib++)
+			{
+				auto M_b = M_io.begin() + ib*M_i.size();
+				thrust::transform(M_i.begin() + range.ixy_0, M_i.begin() + range.ixy_e,
+					M_b + range.ixy_0, M_b + range.ixy_0, functor::multiply<value_type>());
+			}
+		};
+
+		stream.set_n_act_stream(M_i.size());
+		stream.set_grid(1, M_i.size());
+		stream.exec(thr_multiply_batch);
+	}
+
 	template <class TVector>
 	enable_if_host_vector<TVector, Value_type<TVector>>
 		sum(Stream<e_host> &stream, TVector &M_i)
@@ -994,16 +1034,12 @@ namespace mt
 	enable_if_host_vector<TVector_r, void>
 		subtract_atom(Stream<e_host> &stream, TGrid &grid_2d, Vector<Atom_Sa<Value_type<TGrid>>, e_host> &atom_Ip, TVector_r &M_i)
 	{
-		if (stream.n_act_stream <= 0)
+		auto thr_subtract_atom = [&](const int &istream)
 		{
-			return;
-		}
+			host_detail::subtract_atom<typename TVector_r::value_type>(stream, grid_2d, atom_Ip[istream], M_i);
+		};
 
-		for (auto istream = 0; istream < stream.n_act_stream; istream++)
-		{
-			stream[istream] = std::thread(std::bind(host_detail::subtract_atom<typename TVector_r::value_type>, std::ref(stream), std::ref(grid_2d), std::ref(atom_Ip[istream]), std::ref(M_i)));
-		}
-		stream.synchronize();
+		stream.exec_istream(thr_subtract_atom);
 	}
 
 	// Linear projected potential: V and zV
@@ -1013,11 +1049,6 @@ namespace mt
 	{
 		using TAtom = Value_type<TVAtom>;
 
-		if (stream.n_act_stream <= 0)
-		{
-			return;
-		}
-
 		auto thr_linear_Vz = [](const ePotential_Type &potential_type, TQ1 &qz, TAtom &atom)
 		{
 			if (atom.charge == 0)
@@ -1070,14 +1101,12 @@ namespace mt
 			}
 		};
 
-		for (auto istream = 0; istream < stream.n_act_stream - 1; istream++)
+		auto thr_fn = [&](const int &istream)
 		{
-			stream[istream] = std::thread(std::bind(thr_linear_Vz, potential_type, std::ref(qz), std::ref(vatom[istream])));
-		}
-
-		thr_linear_Vz(potential_type, qz, vatom[stream.n_act_stream - 1]);
+			thr_linear_Vz(potential_type, qz, vatom[istream]);
+		};
 
-		stream.synchronize();
+		stream.exec_istream(thr_fn);
 	}
 
 	// Get Local interpolation coefficients
@@ -1087,19 +1116,12 @@ namespace mt
 	{
 		using TAtom = Value_type<TVAtom>;
 
-		if (stream.n_act_stream <= 0)
+		auto thr_cubic_poly_coef = [&](const int &istream)
 		{
-			return;
-		}
-
-		for (auto istream = 0; istream < stream.n_act_stream - 1; istream++)
-		{
-			stream[istream] = std::thread(std::bind(host_detail::cubic_poly_coef<TAtom>, std::ref(vatom[istream])));
-		}
-
-		host_detail::cubic_poly_coef<TAtom>(vatom[stream.n_act_stream - 1]);
+			host_detail::cubic_poly_coef<TAtom>(vatom[istream]);
+		};
 
-		stream.synchronize();
+		stream.exec_istream(thr_cubic_poly_coef);
 	}
 
 	template <class TGrid, class TVector>
@@ -1210,6 +1232,41 @@ namespace mt
 		return sum;
 	}
 
+	// radial histogram of |M_i|^2: ir_i holds the bin of each pixel (-1: not binned)
+	template <class TGrid, class TVector_i, class TVector_c>
+	enable_if_host_vector_and_host_vector<TVector_i, TVector_c, void>
+		sum_square_over_radial_bins(Stream<e_host> &stream, TGrid &grid_2d, TVector_i &ir_i, TVector_c &M_i, 
+			Vector<Value_type<TGrid>, e_host> &hist_o)
+	{
+		using T_r = Value_type<TGrid>;
+
+		thrust::fill(hist_o.begin(), hist_o.end(), T_r(0));
+
+		auto thr_sum_square_over_radial_bins = [&](const Range_2d &range)
+		{
+			Vector<T_r, e_host> hist_partial(hist_o.size(), T_r(0));
+			for(auto ixy = range.ixy_0; ixy < range.ixy_e; ixy++)
+			{
+				const int ir = ir_i[ixy];
+				if(ir >= 0)
+				{
+					hist_partial[ir] += norm(M_i[ixy]);
+				}
+			}
+
+			stream.stream_mutex.lock();
+			for(auto ir = 0; ir < hist_o.size(); ir++)
+			{
+				hist_o[ir] += hist_partial[ir];
+			}
+			stream.stream_mutex.unlock();
+		};
+
+		stream.set_n_act_stream(grid_2d.nxy());
+		stream.set_grid(1, grid_2d.nxy());
+		stream.exec(thr_sum_square_over_radial_bins);
+	}
+
 	template <class TGrid, class TVector_c>
 	enable_if_host_vector<TVector_c, void>
 		bandwidth_limit(Stream<e_host> &stream, TGrid &grid_2d, TVector_c &M_io)
@@ -1240,6 +1297,16 @@ namespace mt
 		stream.exec_matrix(host_device_detail::propagate<TGrid, TVector_c>, grid_2d, w, gxu, gyu, psi_i, psi_o);
 	}
 
+	template <class TGrid, class TVector_c>
+	enable_if_host_vector<TVector_c, void>
+		propagator_kernel(Stream<e_host> &stream, TGrid &grid_2d, Value_type<TGrid> w,
+			Value_type<TGrid> gxu, Value_type<TGrid> gyu, TVector_c &prop_o)
+	{
+		stream.set_n_act_stream(grid_2d.nx);
+		stream.set_grid(grid_2d.nx, grid_2d.ny);
+		stream.exec_matrix(host_device_detail::propagator_kernel<TGrid, TVector_c>, grid_2d, w, gxu, gyu, prop_o);
+	}
+
 	template <class TGrid, class TVector_1, class TVector_2>
 	enable_if_host_vector_and_host_vector<TVector_1, TVector_2, void>
 		transmission_function(Stream<e_host> &stream, TGrid &grid_2d, eElec_Spec_Int_Model elec_spec_int_model,
@@ -1271,6 +1338,36 @@ namespace mt
 		mt::scale(stream, sqrt(1.0 / total), fPsi_o);
 	}
 
+	template <class TGrid, class TVector_c>
+	enable_if_host_vector<TVector_c, void>
+		add_shift_probe(Stream<e_host> &stream, TGrid &grid_2d, TVector_c &ex, TVector_c &ey, 
+			TVector_c &fPsi_i, TVector_c &fPsi_o)
+	{
+		stream.set_n_act_stream(grid_2d.nx);
+		stream.set_grid(grid_2d.nx, grid_2d.ny);
+		stream.exec_matrix(host_device_detail::add_shift_probe<TGrid, TVector_c>, grid_2d, ex, ey, fPsi_i, fPsi_o);
+	}
+
+	template <class TGrid, class TVector_c>
+	enable_if_host_vector<TVector_c, void>
+		add_smatrix_beams(Stream<e_host> &stream, TGrid &grid_2d, TGrid &grid_w, int ix_0, int iy_0, 
+			TVector_c &coef, TVector_c &S, TVector_c &psi_w)
+	{
+		stream.set_n_act_stream(grid_w.nx);
+		stream.set_grid(grid_w.nx, grid_w.ny);
+		stream.exec_matrix(host_device_detail::add_smatrix_beams<TGrid, TVector_c>, grid_2d, grid_w, ix_0, iy_0, coef, S, psi_w);
+	}
+
+	template <class TGrid, class TVector_c>
+	enable_if_host_vector<TVector_c, void>
+		multiply_window(Stream<e_host> &stream, TGrid &grid_2d, TGrid &grid_w, int ix_0, int iy_0, 
+			TVector_c &trans, TVector_c &psi_w)
+	{
+		stream.set_n_act_stream(grid_w.nx);
+		stream.set_grid(grid_w.nx, grid_w.ny);
+		stream.exec_matrix(host_device_detail::multiply_window<TGrid, TVector_c>, grid_2d, grid_w, ix_0, iy_0, trans, psi_w);
+	}
+
 	template <class TGrid, class TVector_c>
 	enable_if_host_vector<TVector_c, void>
 		apply_CTF(Stream<e_host> &stream, TGrid &grid_2d, Lens<Value_type<TGrid>> &lens, Value_type<TGrid> gxu, Value_type<TGrid> gyu, TVector_c &fPsi_i, TVector_c &fPsi_o)
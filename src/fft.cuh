@@ -23,6 +23,13 @@
 #include "types.cuh"
 #include <fftw3.h>
 
+#include <cstdio>
+#include <string>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <random>
+
 #include <cuda.h>
 #include <cuda_runtime.h>
 #include <cufft.h>
@@ -35,9 +42,265 @@
 
 namespace mt
 {
+	enum eFFTW_Plan
+	{
+		eFFTW_1d = 1, eFFTW_1d_batch = 2, eFFTW_2d = 3, eFFTW_2d_batch = 4, eFFTW_1d_stride = 5, eFFTW_1d_stride_unaligned = 6, 
+		eFFTW_1d_batch_unaligned = 7
+	};
+
+	template <class T>
+	struct FFTW_Api;
+
+	template <>
+	struct FFTW_Api<float>
+	{
+		using TPlan = fftwf_plan;
+
+		static const char* wisdom_name() { return "fftwf.wisdom"; }
+
+		static void init_threads() { fftwf_init_threads(); }
+
+		static void plan_with_nthreads(int nthread) { fftwf_plan_with_nthreads(nthread); }
+
+		static void destroy_plan(TPlan plan) { fftwf_destroy_plan(plan); }
+
+		static int import_wisdom(const char *fn) { return fftwf_import_wisdom_from_filename(fn); }
+
+		static int export_wisdom(const char *fn) { return fftwf_export_wisdom_to_filename(fn); }
+
+		using TComplex = fftwf_complex;
+
+		// in-place 1d transforms of length n: element stride and distance between transforms
+		static TPlan plan_many_dft(int n, int how_many, TComplex *V, int stride, int dist, int sign, unsigned flags)
+		{
+			return fftwf_plan_many_dft(1, &n, how_many, V, nullptr, stride, dist, V, nullptr, stride, dist, sign, flags);
+		}
+
+		static void execute_dft(TPlan plan, TComplex *V) { fftwf_execute_dft(plan, V, V); }
+	};
+
+	template <>
+	struct FFTW_Api<double>
+	{
+		using TPlan = fftw_plan;
+
+		static const char* wisdom_name() { return "fftw.wisdom"; }
+
+		static void init_threads() { fftw_init_threads(); }
+
+		static void plan_with_nthreads(int nthread) { fftw_plan_with_nthreads(nthread); }
+
+		static void destroy_plan(TPlan plan) { fftw_destroy_plan(plan); }
+
+		static int import_wisdom(const char *fn) { return fftw_import_wisdom_from_filename(fn); }
+
+		static int export_wisdom(const char *fn) { return fftw_export_wisdom_to_filename(fn); }
+
+		using TComplex = fftw_complex;
+
+		// in-place 1d transforms of length n: element stride and distance between transforms
+		static TPlan plan_many_dft(int n, int how_many, TComplex *V, int stride, int dist, int sign, unsigned flags)
+		{
+			return fftw_plan_many_dft(1, &n, how_many, V, nullptr, stride, dist, V, nullptr, stride, dist, sign, flags);
+		}
+
+		static void execute_dft(TPlan plan, TComplex *V) { fftw_execute_dft(plan, V, V); }
+	};
+
+	/* Process-wide fftw plans: a plan is created once for each (transform, nx, ny, nz, nthread, rigor)
+	 * and shared by all the host FFTs of the process, across simulations. The fftw planner is not
+	 * thread safe, so plans are created under the registry lock; the new-array execution of a plan is.
+	 * The wisdom file of the directory is read before the first plan, merged with the file on disk
+	 * and written to a temporary name and renamed after each new plan.
+	 */
+	template <class T>
+	class FFTW_Plan_Registry
+	{
+		public:
+			using TPlan = typename FFTW_Api<T>::TPlan;
+
+			static FFTW_Plan_Registry<T>& instance()
+			{
+				static FFTW_Plan_Registry<T> registry;
+				return registry;
+			}
+
+			~FFTW_Plan_Registry()
+			{
+				clear();
+			}
+
+			// wisdom directory (empty: no wisdom files) and fftw planning flag
+			void set_config(const std::string &wisdom_dir_i, const unsigned &rigor_i)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if(wisdom_dir_i != wisdom_dir)
+				{
+					wisdom_dir = wisdom_dir_i;
+					bb_wisdom = false;
+				}
+				rigor = rigor_i;
+			}
+
+			// create(rigor, plan_forward, plan_backward) is only called for a new key
+			template <class TCreate>
+			void get(const eFFTW_Plan &type, const int &nx, const int &ny, const int &nz, const int &nthread,
+			TCreate create, TPlan &plan_forward, TPlan &plan_backward)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				Key key{type, nx, ny, nz, max(1, nthread), rigor};
+				auto it = plans.find(key);
+				if(it == plans.end())
+				{
+					import_wisdom();
+
+					Plan plan;
+					FFTW_Api<T>::plan_with_nthreads(key.nthread);
+					create(rigor, plan.forward, plan.backward);
+					it = plans.emplace(key, plan).first;
+
+					export_wisdom();
+				}
+
+				plan_forward = it->second.forward;
+				plan_backward = it->second.backward;
+			}
+
+			bool contains(const eFFTW_Plan &type, const int &nx, const int &ny, const int &nz, const int &nthread)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				return plans.find(Key{type, nx, ny, nz, max(1, nthread), rigor}) != plans.end();
+			}
+
+			// the plans of the key must not be in use
+			void release(const eFFTW_Plan &type, const int &nx, const int &ny, const int &nz, const int &nthread)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				auto it = plans.find(Key{type, nx, ny, nz, max(1, nthread), rigor});
+				if(it != plans.end())
+				{
+					FFTW_Api<T>::destroy_plan(it->second.forward);
+					FFTW_Api<T>::destroy_plan(it->second.backward);
+					plans.erase(it);
+				}
+			}
+
+			void clear()
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				for(auto &it: plans)
+				{
+					FFTW_Api<T>::destroy_plan(it.second.forward);
+					FFTW_Api<T>::destroy_plan(it.second.backward);
+				}
+				plans.clear();
+			}
+
+		private:
+			struct Key
+			{
+				int type;
+				int nx;
+				int ny;
+				int nz;
+				int nthread;
+				unsigned rigor;
+
+				bool operator<(const Key &key) const
+				{
+					return std::tie(type, nx, ny, nz, nthread, rigor) < std::tie(key.type, key.nx, key.ny, key.nz, key.nthread, key.rigor);
+				}
+			};
+
+			struct Plan
+			{
+				TPlan forward;
+				TPlan backward;
+			};
+
+			FFTW_Plan_Registry(): rigor(FFTW_MEASURE), bb_wisdom(false)
+			{
+				FFTW_Api<T>::init_threads();
+			}
+
+			FFTW_Plan_Registry(const FFTW_Plan_Registry<T>&) = delete;
+
+			FFTW_Plan_Registry<T>& operator=(const FFTW_Plan_Registry<T>&) = delete;
+
+			std::string wisdom_fn() const
+			{
+				auto sep = ((wisdom_dir.back() == '/') || (wisdom_dir.back() == '\\'))?"":"/";
+				return wisdom_dir + sep + FFTW_Api<T>::wisdom_name();
+			}
+
+			void import_wisdom()
+			{
+				if(wisdom_dir.empty() || bb_wisdom)
+				{
+					return;
+				}
+
+				FFTW_Api<T>::import_wisdom(wisdom_fn().c_str());
+				bb_wisdom = true;
+			}
+
+			// the wisdom added by other processes is merged before the file is replaced
+			void export_wisdom()
+			{
+				if(wisdom_dir.empty())
+				{
+					return;
+				}
+
+				auto fn = wisdom_fn();
+				FFTW_Api<T>::import_wisdom(fn.c_str());
+
+				std::random_device rd;
+				auto fn_tmp = fn + ".tmp" + std::to_string(rd());
+				if(FFTW_Api<T>::export_wisdom(fn_tmp.c_str()) == 0)
+				{
+					std::remove(fn_tmp.c_str());
+					return;
+				}
+
+				if(std::rename(fn_tmp.c_str(), fn.c_str()) != 0)
+				{
+					// rename does not replace an existing file on every platform
+					std::remove(fn.c_str());
+					if(std::rename(fn_tmp.c_str(), fn.c_str()) != 0)
+					{
+						std::remove(fn_tmp.c_str());
+					}
+				}
+			}
+
+			std::mutex mutex;
+			std::map<Key, Plan> plans;
+
+			std::string wisdom_dir; 			// wisdom directory, empty: no wisdom files
+			unsigned rigor; 					// FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT or FFTW_EXHAUSTIVE
+			bool bb_wisdom; 					// wisdom file of the directory imported
+	};
+
+	/* fftw configuration of the host FFTs of the process
+	 * rigor: 0: estimate, 1: measure, 2: patient, 3: exhaustive
+	 */
+	inline void set_fftw_config(const std::string &wisdom_dir, const int &rigor)
+	{
+		const unsigned flags[] = {FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT, FFTW_EXHAUSTIVE};
+		auto flag = flags[min(max(0, rigor), 3)];
+
+		FFTW_Plan_Registry<float>::instance().set_config(wisdom_dir, flag);
+		FFTW_Plan_Registry<double>::instance().set_config(wisdom_dir, flag);
+	}
+
 	template <class T, eDevice dev>
 	struct FFT;
-
 	template <>
 	struct FFT<float, e_host>
 	{
@@ -47,29 +310,21 @@ namespace mt
 
 			static const eDevice device = e_host;
 
-			FFT(): plan_forward(nullptr), plan_backward(nullptr){ fftwf_init_threads(); }
+			FFT(): plan_forward(nullptr), plan_backward(nullptr){}
 
 			~FFT()
 			{
 				destroy_plan();
 			}
 
+			// the plans belong to the registry and stay valid for other FFTs
 			void cleanup()
 			{
 				destroy_plan();
-				fftwf_cleanup_threads();
 			}
 
 			void destroy_plan()
 			{
-				if(plan_backward == nullptr)
-				{
-					return;
-				}
-
-				fftwf_destroy_plan(plan_forward);
-				fftwf_destroy_plan(plan_backward);
-
 				plan_backward = plan_forward = nullptr;
 			}
 
@@ -77,86 +332,82 @@ namespace mt
 			{
 				destroy_plan();
 
-				fftwf_import_wisdom_from_filename("fftwf_1d.wisdom");
-
-				fftwf_plan_with_nthreads(nThread);
-
-				TVector_c M(nx);
+				auto create = [&](const unsigned &rigor, fftwf_plan &plan_f, fftwf_plan &plan_b)
+				{
+					TVector_c M(nx);
 
-				fftwf_complex *V = reinterpret_cast<fftwf_complex*>(M.data());
+					fftwf_complex *V = reinterpret_cast<fftwf_complex*>(M.data());
 
-				plan_forward = fftwf_plan_dft_1d(nx, V, V, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftwf_plan_dft_1d(nx, V, V, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftwf_plan_dft_1d(nx, V, V, FFTW_FORWARD, rigor);
+					plan_b = fftwf_plan_dft_1d(nx, V, V, FFTW_BACKWARD, rigor);
+				};
 
-				fftwf_export_wisdom_to_filename("fftwf_1d.wisdom");
+				FFTW_Plan_Registry<float>::instance().get(eFFTW_1d, nx, 1, 1, nThread, create, plan_forward, plan_backward);
 			}
 
 			void create_plan_1d_batch(const int &ny, const int &nx, int nThread=1)
 			{
 				destroy_plan();
 
-				fftwf_import_wisdom_from_filename("fftwf_1d_batch.wisdom");
+				auto create = [&](const unsigned &rigor, fftwf_plan &plan_f, fftwf_plan &plan_b)
+				{
+					TVector_c M(nx*ny);
 
-				fftwf_plan_with_nthreads(nThread);
+					auto V = reinterpret_cast<fftwf_complex*>(M.data());
 
-				TVector_c M(nx*ny);
+					int rank = 1;						// Dimensionality of the transform (1, 2, or 3). 
+					int n[] = {ny};						// 1d transforms of length nx*ny
+					int how_many = nx;
+					int idist = ny, odist = ny;			// distance between two successive input elements in the least significant
+					int istride = 1, ostride = 1;		// distance between two elements in the same column
+					int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
 
-				auto V = reinterpret_cast<fftwf_complex*>(M.data());
+					plan_f = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, rigor);
+					plan_b = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, rigor);
+				};
 
-				int rank = 1;						// Dimensionality of the transform (1, 2, or 3). 
-				int n[] = {ny};						// 1d transforms of length nx*ny
-				int how_many = nx;
-				int idist = ny, odist = ny;			// distance between two successive input elements in the least significant
-				int istride = 1, ostride = 1;		// distance between two elements in the same column
-				int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
-
-				plan_forward = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, FFTW_MEASURE);
-
-				fftwf_export_wisdom_to_filename("fftwf_1d_batch.wisdom");
+				FFTW_Plan_Registry<float>::instance().get(eFFTW_1d_batch, nx, ny, 1, nThread, create, plan_forward, plan_backward);
 			}
 
 			void create_plan_2d(const int &ny, const int &nx, int nThread)
 			{
 				destroy_plan();
 
-				fftwf_import_wisdom_from_filename("fftwf_2d.wisdom");
-
-				fftwf_plan_with_nthreads(nThread);
-
-				TVector_c M(nx*ny);
+				auto create = [&](const unsigned &rigor, fftwf_plan &plan_f, fftwf_plan &plan_b)
+				{
+					TVector_c M(nx*ny);
 
-				auto V = reinterpret_cast<fftwf_complex*>(M.data());
+					auto V = reinterpret_cast<fftwf_complex*>(M.data());
 
-				plan_forward = fftwf_plan_dft_2d(nx, ny, V, V, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftwf_plan_dft_2d(nx, ny, V, V, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftwf_plan_dft_2d(nx, ny, V, V, FFTW_FORWARD, rigor);
+					plan_b = fftwf_plan_dft_2d(nx, ny, V, V, FFTW_BACKWARD, rigor);
+				};
 
-				fftwf_export_wisdom_to_filename("fftwf_2d.wisdom");
+				FFTW_Plan_Registry<float>::instance().get(eFFTW_2d, nx, ny, 1, nThread, create, plan_forward, plan_backward);
 			}
 
 			void create_plan_2d_batch(const int &ny, const int &nx, const int &nz, int nThread)
 			{
 				destroy_plan();
 
-				fftwf_import_wisdom_from_filename("fftwf_2d_batch.wisdom");
-
-				fftwf_plan_with_nthreads(nThread);
-
-				TVector_c M(nx*ny*nz);
+				auto create = [&](const unsigned &rigor, fftwf_plan &plan_f, fftwf_plan &plan_b)
+				{
+					TVector_c M(nx*ny*nz);
 
-				auto V = reinterpret_cast<fftwf_complex*>(M.data());
+					auto V = reinterpret_cast<fftwf_complex*>(M.data());
 
-				int rank = 2;						// Dimensionality of the transform (1, 2, or 3). 
-				int n[] = {nx, ny};					// 2d transforms of length nx*ny
-				int how_many = nz;
-				int idist = nx*ny, odist = nx*ny;	// distance between two successive input elements in the least significant
-				int istride = 1, ostride = 1;		// distance between two elements in the same column
-				int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
+					int rank = 2;						// Dimensionality of the transform (1, 2, or 3). 
+					int n[] = {nx, ny};					// 2d transforms of length nx*ny
+					int how_many = nz;
+					int idist = nx*ny, odist = nx*ny;	// distance between two successive input elements in the least significant
+					int istride = 1, ostride = 1;		// distance between two elements in the same column
+					int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
 
-				plan_forward = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, rigor);
+					plan_b = fftwf_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, rigor);
+				};
 
-				fftwf_export_wisdom_to_filename("fftwf_2d_batch.wisdom");
+				FFTW_Plan_Registry<float>::instance().get(eFFTW_2d_batch, nx, ny, nz, nThread, create, plan_forward, plan_backward);
 			}
 
 			template <class TVector>
@@ -208,29 +459,21 @@ namespace mt
 
 			static const eDevice device = e_host;
 
-			FFT(): plan_forward(nullptr), plan_backward(nullptr){ fftw_init_threads(); }
+			FFT(): plan_forward(nullptr), plan_backward(nullptr){}
 
 			~FFT()
 			{
 				destroy_plan();
 			}
 
+			// the plans belong to the registry and stay valid for other FFTs
 			void cleanup()
 			{
 				destroy_plan();
-				fftw_cleanup_threads();
 			}
 
 			void destroy_plan()
 			{
-				if(plan_backward == nullptr)
-				{
-					return;
-				}
-
-				fftw_destroy_plan(plan_forward);
-				fftw_destroy_plan(plan_backward);
-
 				plan_backward = plan_forward = nullptr;
 			}
 
@@ -238,86 +481,82 @@ namespace mt
 			{
 				destroy_plan();
 
-				fftw_import_wisdom_from_filename("fftw_1d.wisdom");
-
-				fftw_plan_with_nthreads(nThread);
-
-				TVector_c M(nx);
+				auto create = [&](const unsigned &rigor, fftw_plan &plan_f, fftw_plan &plan_b)
+				{
+					TVector_c M(nx);
 
-				auto V = reinterpret_cast<fftw_complex*>(M.data());
+					auto V = reinterpret_cast<fftw_complex*>(M.data());
 
-				plan_forward = fftw_plan_dft_1d(nx, V, V, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftw_plan_dft_1d(nx, V, V, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftw_plan_dft_1d(nx, V, V, FFTW_FORWARD, rigor);
+					plan_b = fftw_plan_dft_1d(nx, V, V, FFTW_BACKWARD, rigor);
+				};
 
-				fftw_export_wisdom_to_filename("fftw_1d.wisdom");
+				FFTW_Plan_Registry<double>::instance().get(eFFTW_1d, nx, 1, 1, nThread, create, plan_forward, plan_backward);
 			}
 
 			void create_plan_1d_batch(const int &ny, const int &nx, int nThread=1)
 			{
 				destroy_plan();
 
-				fftw_import_wisdom_from_filename("fftw_1d_batch.wisdom");
-
-				fftw_plan_with_nthreads(nThread);
-
-				TVector_c M(nx*ny);
+				auto create = [&](const unsigned &rigor, fftw_plan &plan_f, fftw_plan &plan_b)
+				{
+					TVector_c M(nx*ny);
 
-				auto V = reinterpret_cast<fftw_complex*>(M.data());
+					auto V = reinterpret_cast<fftw_complex*>(M.data());
 
-				int rank = 1;						// Dimensionality of the transform (1, 2, or 3). 
-				int n[] = {ny};						// 1d transforms of length nx*ny
-				int how_many = nx;
-				int idist = ny, odist = ny;			// distance between two successive input elements in the least significant
-				int istride = 1, ostride = 1;		// distance between two elements in the same column
-				int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
+					int rank = 1;						// Dimensionality of the transform (1, 2, or 3). 
+					int n[] = {ny};						// 1d transforms of length nx*ny
+					int how_many = nx;
+					int idist = ny, odist = ny;			// distance between two successive input elements in the least significant
+					int istride = 1, ostride = 1;		// distance between two elements in the same column
+					int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
 
-				plan_forward = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, rigor);
+					plan_b = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, rigor);
+				};
 
-				fftw_export_wisdom_to_filename("fftw_1d_batch.wisdom");
+				FFTW_Plan_Registry<double>::instance().get(eFFTW_1d_batch, nx, ny, 1, nThread, create, plan_forward, plan_backward);
 			}
 
 			void create_plan_2d(const int &ny, const int &nx, int nThread)
 			{
 				destroy_plan();
 
-				fftw_import_wisdom_from_filename("fftw_2d.wisdom");
-
-				fftw_plan_with_nthreads(nThread);
-
-				TVector_c M(nx*ny);
+				auto create = [&](const unsigned &rigor, fftw_plan &plan_f, fftw_plan &plan_b)
+				{
+					TVector_c M(nx*ny);
 
-				auto V = reinterpret_cast<fftw_complex*>(M.data());
+					auto V = reinterpret_cast<fftw_complex*>(M.data());
 
-				plan_forward = fftw_plan_dft_2d(nx, ny, V, V, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftw_plan_dft_2d(nx, ny, V, V, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftw_plan_dft_2d(nx, ny, V, V, FFTW_FORWARD, rigor);
+					plan_b = fftw_plan_dft_2d(nx, ny, V, V, FFTW_BACKWARD, rigor);
+				};
 
-				fftw_export_wisdom_to_filename("fftw_2d.wisdom");
+				FFTW_Plan_Registry<double>::instance().get(eFFTW_2d, nx, ny, 1, nThread, create, plan_forward, plan_backward);
 			}
 
 			void create_plan_2d_batch(const int &ny, const int &nx, const int &nz, int nThread)
 			{
 				destroy_plan();
 
-				fftwf_import_wisdom_from_filename("fftw_2d_batch.wisdom");
-
-				fftwf_plan_with_nthreads(nThread);
-
-				TVector_c M(nx*ny*nz);
+				auto create = [&](const unsigned &rigor, fftw_plan &plan_f, fftw_plan &plan_b)
+				{
+					TVector_c M(nx*ny*nz);
 
-				auto V = reinterpret_cast<fftw_complex*>(M.data());
+					auto V = reinterpret_cast<fftw_complex*>(M.data());
 
-				int rank = 2;						// Dimensionality of the transform (1, 2, or 3). 
-				int n[] = {nx, ny};					// 2d transforms of length nx*ny
-				int how_many = nz;
-				int idist = nx*ny, odist = nx*ny;	// distance between two successive input elements in the least significant
-				int istride = 1, ostride = 1;		// distance between two elements in the same column
-				int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
+					int rank = 2;						// Dimensionality of the transform (1, 2, or 3). 
+					int n[] = {nx, ny};					// 2d transforms of length nx*ny
+					int how_many = nz;
+					int idist = nx*ny, odist = nx*ny;	// distance between two successive input elements in the least significant
+					int istride = 1, ostride = 1;		// distance between two elements in the same column
+					int *inembed = n, *onembed = n;		// Pointer of size rank that indicates the storage dimensions
 
-				plan_forward = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, FFTW_MEASURE);
-				plan_backward = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, FFTW_MEASURE);
+					plan_f = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_FORWARD, rigor);
+					plan_b = fftw_plan_many_dft(rank, n, how_many, V, inembed, istride, idist, V, onembed, ostride, odist, FFTW_BACKWARD, rigor);
+				};
 
-				fftwf_export_wisdom_to_filename("fftwf_2d_batch.wisdom");
+				FFTW_Plan_Registry<double>::instance().get(eFFTW_2d_batch, nx, ny, nz, nThread, create, plan_forward, plan_backward);
 			}
 
 			template <class TVector>
@@ -360,6 +599,140 @@ namespace mt
 			fftw_plan plan_backward;
 	};
 
+	/* 2d transform of a band limited wave on the host. The spectrum vanishes on the rows |ky| > ny_c,
+	 * so the transform is split into a pass of 1d transforms along y on the nx columns and a pass
+	 * along x restricted to the rows [0, ny_c] and [ny-ny_c, ny). The forward transform returns the
+	 * spectrum with the rows |ky| > ny_c set to zero and the inverse transform takes them as zero.
+	 */
+	template <class T>
+	struct FFT_Pruned
+	{
+		public:
+			using value_type = T;
+			using TPlan = typename FFTW_Api<T>::TPlan;
+			using TComplex = typename FFTW_Api<T>::TComplex;
+			using TVector_c = Vector<complex<T>, e_host>;
+
+			static const eDevice device = e_host;
+
+			FFT_Pruned(): nx(0), ny(0), ny_c(0),
+				plan_y_forward(nullptr), plan_y_backward(nullptr), plan_x0_forward(nullptr),
+				plan_x0_backward(nullptr), plan_xe_forward(nullptr), plan_xe_backward(nullptr){}
+
+			void destroy_plan()
+			{
+				nx = ny = ny_c = 0;
+				plan_y_forward = plan_y_backward = nullptr;
+				plan_x0_forward = plan_x0_backward = nullptr;
+				plan_xe_forward = plan_xe_backward = nullptr;
+			}
+
+			// false when the rows cover the grid and there is nothing to prune
+			bool create_plan_2d(const int &ny_i, const int &nx_i, const int &ny_c_i, int nThread)
+			{
+				destroy_plan();
+
+				if((ny_c_i < 1) || (2*ny_c_i+1 >= ny_i))
+				{
+					return false;
+				}
+
+				nx = nx_i;
+				ny = ny_i;
+				ny_c = ny_c_i;
+
+				auto &registry = FFTW_Plan_Registry<T>::instance();
+
+				// columns: same plans as FFT::create_plan_1d_batch(ny, nx)
+				auto create_y = [&](const unsigned &rigor, TPlan &plan_f, TPlan &plan_b)
+				{
+					TVector_c M(nx*ny);
+					auto V = reinterpret_cast<TComplex*>(M.data());
+
+					plan_f = FFTW_Api<T>::plan_many_dft(ny, nx, V, 1, ny, FFTW_FORWARD, rigor);
+					plan_b = FFTW_Api<T>::plan_many_dft(ny, nx, V, 1, ny, FFTW_BACKWARD, rigor);
+				};
+				registry.get(eFFTW_1d_batch, nx, ny, 1, nThread, create_y, plan_y_forward, plan_y_backward);
+
+				// rows [0, ny_c]
+				auto create_x0 = [&](const unsigned &rigor, TPlan &plan_f, TPlan &plan_b)
+				{
+					TVector_c M(nx*ny);
+					auto V = reinterpret_cast<TComplex*>(M.data());
+
+					plan_f = FFTW_Api<T>::plan_many_dft(nx, ny_c+1, V, ny, 1, FFTW_FORWARD, rigor);
+					plan_b = FFTW_Api<T>::plan_many_dft(nx, ny_c+1, V, ny, 1, FFTW_BACKWARD, rigor);
+				};
+				registry.get(eFFTW_1d_stride, nx, ny, ny_c+1, nThread, create_x0, plan_x0_forward, plan_x0_backward);
+
+				// rows [ny-ny_c, ny): they start at an offset of the array
+				auto create_xe = [&](const unsigned &rigor, TPlan &plan_f, TPlan &plan_b)
+				{
+					TVector_c M(nx*ny);
+					auto V = reinterpret_cast<TComplex*>(M.data()) + (ny-ny_c);
+
+					plan_f = FFTW_Api<T>::plan_many_dft(nx, ny_c, V, ny, 1, FFTW_FORWARD, rigor | FFTW_UNALIGNED);
+					plan_b = FFTW_Api<T>::plan_many_dft(nx, ny_c, V, ny, 1, FFTW_BACKWARD, rigor | FFTW_UNALIGNED);
+				};
+				registry.get(eFFTW_1d_stride_unaligned, nx, ny, ny_c, nThread, create_xe, plan_xe_forward, plan_xe_backward);
+
+				return true;
+			}
+
+			bool is_pruned() const
+			{
+				return ny_c > 0;
+			}
+
+			int get_ny_c() const
+			{
+				return ny_c;
+			}
+
+			template <class TVector>
+			void forward(TVector &M_io)
+			{
+				auto V_io = reinterpret_cast<TComplex*>(M_io.data());
+				FFTW_Api<T>::execute_dft(plan_y_forward, V_io);
+				FFTW_Api<T>::execute_dft(plan_x0_forward, V_io);
+				FFTW_Api<T>::execute_dft(plan_xe_forward, V_io + (ny-ny_c));
+				zero_rows(M_io);
+			}
+
+			template <class TVector>
+			void inverse(TVector &M_io)
+			{
+				auto V_io = reinterpret_cast<TComplex*>(M_io.data());
+				FFTW_Api<T>::execute_dft(plan_x0_backward, V_io);
+				FFTW_Api<T>::execute_dft(plan_xe_backward, V_io + (ny-ny_c));
+				FFTW_Api<T>::execute_dft(plan_y_backward, V_io);
+			}
+
+		private:
+			template <class TVector>
+			void zero_rows(TVector &M_io)
+			{
+				using T_c = typename TVector::value_type;
+
+				for(auto ix = 0; ix < nx; ix++)
+				{
+					auto it = M_io.begin() + ix*ny;
+					std::fill(it + (ny_c+1), it + (ny-ny_c), T_c(0));
+				}
+			}
+
+			int nx;
+			int ny;
+			int ny_c; 								// last row of the band limited spectrum
+
+			TPlan plan_y_forward;
+			TPlan plan_y_backward;
+			TPlan plan_x0_forward;
+			TPlan plan_x0_backward;
+			TPlan plan_xe_forward;
+			TPlan plan_xe_backward;
+	};
+
 	template <>
 	struct FFT<float, e_device>
 	{
@@ -0,0 +1,159 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef FP_CONVERGENCE_H
+#define FP_CONVERGENCE_H
+
+#include "math.cuh"
+#include "types.cuh"
+#include "input_multislice.cuh"
+
+namespace mt
+{
+	/* Convergence control of the frozen phonon average: the running mean and variance of the
+	 * configurations are tracked for each output value (detector intensities per scanning position,
+	 * or m2psi_tot pixels). The relative standard error of the average is
+	 * 		err = sqrt(sum_i var_i/n)/sqrt(sum_i mean_i^2)
+	 * and the configurations stop once err <= pn_conv_tol, or after pn_nconf configurations.
+	 * 4D-STEM runs average all the configurations: the stored patterns are written with the
+	 * weight 1/pn_nconf and can not be rescaled afterwards.
+	 */
+	template <class T>
+	class FP_Convergence
+	{
+		public:
+			using T_r = T;
+
+			FP_Convergence(): input_multislice(nullptr), b_enabled(false), n_conf(0), err(0){}
+
+			static bool is_enabled(Input_Multislice<T_r> &input_multislice_i)
+			{
+				return input_multislice_i.is_frozen_phonon() && (input_multislice_i.pn_conv_tol > 0)
+					&& (input_multislice_i.number_conf() > 1) && (input_multislice_i.pn_nconf_w == 0)
+					&& !(input_multislice_i.is_STEM() && input_multislice_i.pn_coh_contrib)
+					&& !input_multislice_i.is_STEM_4D();
+			}
+
+			void set_input_data(Input_Multislice<T_r> *input_multislice_i)
+			{
+				input_multislice = input_multislice_i;
+				b_enabled = is_enabled(*input_multislice);
+				init();
+			}
+
+			void init()
+			{
+				n_conf = 0;
+				err = 0;
+				data.clear();
+				data_0.clear();
+				mean.clear();
+				m2.clear();
+			}
+
+			/* adds the last configuration summed to the output: it returns true when the
+			 * average has converged and no more configurations are needed
+			 */
+			template <class TOutput_multislice>
+			bool operator()(TOutput_multislice &output_multislice)
+			{
+				if(!b_enabled)
+				{
+					return false;
+				}
+
+				output_multislice.get_conf_data(data);
+
+				if(n_conf == 0)
+				{
+					data_0.assign(data.size(), T_r(0));
+					mean.assign(data.size(), 0.0);
+					m2.assign(data.size(), 0.0);
+				}
+
+				// Welford update with the contribution of the last configuration
+				n_conf++;
+				double sum_var = 0;
+				double sum_mean = 0;
+				for(auto i = 0; i < data.size(); i++)
+				{
+					double x = data[i] - data_0[i];
+					double dx = x - mean[i];
+					mean[i] += dx/n_conf;
+					m2[i] += dx*(x - mean[i]);
+					data_0[i] = data[i];
+
+					sum_var += m2[i];
+					sum_mean += mean[i]*mean[i];
+				}
+
+				if(n_conf < 2)
+				{
+					return false;
+				}
+
+				sum_var /= (n_conf-1)*n_conf;
+				err = (sum_mean > 0)?sqrt(sum_var/sum_mean):0;
+
+				return (n_conf >= c_nconf_min) && (err <= input_multislice->pn_conv_tol);
+			}
+
+			/* the configurations are weighted by 1/pn_nconf: the sums are rescaled when the
+			 * average converged before the last configuration
+			 */
+			template <class TOutput_multislice>
+			void set_output(TOutput_multislice &output_multislice)
+			{
+				if(!b_enabled || (n_conf == 0))
+				{
+					return;
+				}
+
+				output_multislice.pn_nconf_run = n_conf;
+				output_multislice.pn_conv_err = err;
+
+				int nconf = input_multislice->number_conf();
+				if(n_conf < nconf)
+				{
+					output_multislice.scale_conf(T_r(nconf)/T_r(n_conf));
+				}
+			}
+
+			bool is_enabled() const
+			{
+				return b_enabled;
+			}
+
+		private:
+			static const int c_nconf_min = 4; 		// minimum number of configurations before stopping
+
+			Input_Multislice<T_r> *input_multislice;
+			bool b_enabled;
+
+			int n_conf; 							// configurations averaged
+			double err; 							// relative standard error of the average
+
+			host_vector<T_r> data; 					// configuration sums
+			host_vector<T_r> data_0; 				// configuration sums of the previous configuration
+			host_vector<double> mean; 				// running mean of a configuration
+			host_vector<double> m2; 				// running sum of squared deviations
+	};
+
+} // namespace mt
+
+#endif
@@ -580,6 +580,31 @@ namespace mt
 			}
 		}
 
+		// radial histogram of |M_i|^2
+		template <class TGrid, class T>
+		__global__ void sum_square_over_radial_bins(TGrid grid_2d, rVector<int> ir_i, rVector<T> M_i, rVector<Value_type<TGrid>> hist_o)
+		{ 
+			int iy_0 = threadIdx.x + blockIdx.x*blockDim.x;
+			int ix_0 = threadIdx.y + blockIdx.y*blockDim.y;
+
+			int ix = ix_0;
+			while (ix < grid_2d.nx)
+			{
+				int iy = iy_0;
+				while (iy < grid_2d.ny)
+				{
+					const int ixy = grid_2d.ind_col(ix, iy);
+					const int ir = ir_i[ixy];
+					if(ir >= 0)
+					{
+						atomicAdd(&(hist_o.V[ir]), norm(M_i[ixy]));
+					}
+					iy += blockDim.x*gridDim.x;
+				}
+				ix += blockDim.y*gridDim.y;
+			}
+		}
+
 		// Anti-Aliasing, scale with cut-off (2/3)g_max
 		template <class TGrid, class T>
 		__global__ void bandwidth_limit(TGrid grid_2d, rVector<T> M_io)
@@ -619,6 +644,19 @@ namespace mt
 			}
 		}
 
+		template <class TGrid, class T>
+		__global__ void propagator_kernel(TGrid grid_2d, Value_type<TGrid> w, 
+		Value_type<TGrid> gxu, Value_type<TGrid> gyu, rVector<T> prop_o)
+		{
+			int iy = threadIdx.x + blockIdx.x*blockDim.x;
+			int ix = threadIdx.y + blockIdx.y*blockDim.y;
+
+			if((ix < grid_2d.nx) && (iy < grid_2d.ny))
+			{
+				host_device_detail::propagator_kernel(ix, iy, grid_2d, w, gxu, gyu, prop_o);
+			}
+		}
+
 		/***********************************************************************/
 		// phase factor 1d
 		template <class TGrid, class T>
@@ -748,6 +786,48 @@ namespace mt
 			}
 		}
 
+		// Shifted convergent incident wave in Fourier space
+		template <class TGrid, class T>
+		__global__ void add_shift_probe(TGrid grid_2d, rVector<T> ex, rVector<T> ey, 
+		rVector<T> fPsi_i, rVector<T> fPsi_o)
+		{
+			int iy = threadIdx.x + blockIdx.x*blockDim.x;
+			int ix = threadIdx.y + blockIdx.y*blockDim.y;
+
+			if((ix < grid_2d.nx) && (iy < grid_2d.ny))
+			{	
+				host_device_detail::add_shift_probe(ix, iy, grid_2d, ex, ey, fPsi_i, fPsi_o);
+			}
+		}
+
+		// PRISM probe window from the S-matrix beams
+		template <class TGrid, class T>
+		__global__ void add_smatrix_beams(TGrid grid_2d, TGrid grid_w, int ix_0, int iy_0, 
+		rVector<T> coef, rVector<T> S, rVector<T> psi_w)
+		{
+			int jy = threadIdx.x + blockIdx.x*blockDim.x;
+			int jx = threadIdx.y + blockIdx.y*blockDim.y;
+
+			if((jx < grid_w.nx) && (jy < grid_w.ny))
+			{	
+				host_device_detail::add_smatrix_beams(jx, jy, grid_2d, grid_w, ix_0, iy_0, coef, S, psi_w);
+			}
+		}
+
+		// probe window times the transmission function of the full grid
+		template <class TGrid, class T>
+		__global__ void multiply_window(TGrid grid_2d, TGrid grid_w, int ix_0, int iy_0, 
+		rVector<T> trans, rVector<T> psi_w)
+		{
+			int jy = threadIdx.x + blockIdx.x*blockDim.x;
+			int jx = threadIdx.y + blockIdx.y*blockDim.y;
+
+			if((jx < grid_w.nx) && (jy < grid_w.ny))
+			{	
+				host_device_detail::multiply_window(jx, jy, grid_2d, grid_w, ix_0, iy_0, trans, psi_w);
+			}
+		}
+
 		// Apply Coherent transfer function
 		template <class TGrid, class T>
 		__global__ void apply_CTF(TGrid grid_2d, Lens<Value_type<TGrid>> lens, 
@@ -1159,6 +1239,14 @@ namespace mt
 		scale(stream, w_i, M_io, M_io);
 	}
 
+	// M_o = fn(M_i), element wise
+	template <class TVector_1, class TVector_2, class TFunctor>
+	enable_if_device_vector_and_device_vector<TVector_1, TVector_2, void>
+	transform_vector(Stream<e_device> &stream, TVector_1 &M_i, TVector_2 &M_o, TFunctor fn)
+	{
+		thrust::transform(M_i.begin(), M_i.end(), M_o.begin(), fn);
+	}
+
 	template <class TVector_1, class TVector_2>
 	enable_if_device_vector_and_device_vector<TVector_1, TVector_2, void>
 	square(Stream<e_device> &stream, TVector_1 &M_i, TVector_2 &M_o)
@@ -1254,6 +1342,20 @@ namespace mt
 		multiply(stream, M_i, M_io, M_io);
 	}
 
+	// M_io holds M_io.size()/M_i.size() consecutive arrays, all of them are multiplied by M_i
+	template <class TVector_1, class TVector_2>
+	enable_if_device_vector_and_device_vector<TVector_1, TVector_2, void>
+	multiply_batch(Stream<e_device> &stream, TVector_1 &M_i, TVector_2 &M_io)
+	{
+		using value_type = Value_type<TVector_2>;
+		int n_batch = M_io.size()/M_i.size();
+		for(auto ib = 0; ib < n_batch; ib++)
+		{
+			auto M_b = M_io.begin() + ib*M_i.size();
+			thrust::transform(M_i.begin(), M_i.end(), M_b, M_b, functor::multiply<value_type>());
+		}
+	}
+
 	template <class TVector>
 	enable_if_device_vector<TVector, Value_type<TVector>>
 	sum(Stream<e_device> &stream, TVector &M_i)
@@ -1559,6 +1661,19 @@ namespace mt
 		return sum(stream, sum_t);
 	}
 
+	template <class TGrid, class TVector_i, class TVector_c>
+	enable_if_device_vector_and_device_vector<TVector_i, TVector_c, void>
+	sum_square_over_radial_bins(Stream<e_device> &stream, TGrid &grid_2d, TVector_i &ir_i, TVector_c &M_i, 
+	Vector<Value_type<TGrid>, e_host> &hist_o)
+	{
+		device_vector<Value_type<TGrid>> hist(hist_o.size(), 0);
+
+		auto grid_bt = grid_2d.cuda_grid(dim3(c_thrnxny, c_thrnxny));
+
+		device_detail::sum_square_over_radial_bins<TGrid, typename TVector_c::value_type><<<grid_bt.Blk, grid_bt.Thr>>>(grid_2d, ir_i, M_i, hist);
+		thrust::copy(hist.begin(), hist.end(), hist_o.begin());
+	}
+
 	template <class TGrid, class TVector_1, class TVector_2>
 	enable_if_device_vector_and_device_vector<TVector_1, TVector_2, Value_type<TGrid>>
 	sum_square_over_Det(Stream<e_device> &stream, TGrid &grid_2d, TVector_1 &S_i, TVector_2 &M_i)
@@ -1598,6 +1713,15 @@ namespace mt
 		device_detail::propagate<TGrid, typename TVector_c::value_type><<<grid_bt.Blk, grid_bt.Thr>>>(grid_2d, w, gxu, gyu, psi_i, psi_o);
 	}
 
+	template <class TGrid, class TVector_c>
+	enable_if_device_vector<TVector_c, void>
+	propagator_kernel(Stream<e_device> &stream, TGrid &grid_2d, Value_type<TGrid> w, 
+	Value_type<TGrid> gxu, Value_type<TGrid> gyu, TVector_c &prop_o)
+	{
+		auto grid_bt = grid_2d.cuda_grid();
+		device_detail::propagator_kernel<TGrid, typename TVector_c::value_type><<<grid_bt.Blk, grid_bt.Thr>>>(grid_2d, w, gxu, gyu, prop_o);
+	}
+
 	template <class TGrid, class TVector_1, class TVector_2>
 	enable_if_device_vector_and_device_vector<TVector_1, TVector_2, void>
 	transmission_function(Stream<e_device> &stream, TGrid &grid_2d, eElec_Spec_Int_Model elec_spec_int_model, 
@@ -1624,6 +1748,36 @@ namespace mt
 		scale(stream, sqrt(1.0/total), fPsi_o);
 	}
 
+	template <class TGrid, class TVector_c>
+	enable_if_device_vector<TVector_c, void>
+	add_shift_probe(Stream<e_device> &stream, TGrid &grid_2d, TVector_c &ex, TVector_c &ey, 
+	TVector_c &fPsi_i, TVector_c &fPsi_o)
+	{
+		auto grid_bt = grid_2d.cuda_grid();
+
+		device_detail::add_shift_probe<TGrid, typename TVector_c::value_type><<<grid_bt.Blk, grid_bt.Thr>>>(grid_2d, ex, ey, fPsi_i, fPsi_o);
+	}
+
+	template <class TGrid, class TVector_c>
+	enable_if_device_vector<TVector_c, void>
+	add_smatrix_beams(Stream<e_device> &stream, TGrid &grid_2d, TGrid &grid_w, int ix_0, int iy_0, 
+	TVector_c &coef, TVector_c &S, TVector_c &psi_w)
+	{
+		auto grid_bt = grid_w.cuda_grid();
+
+		device_detail::add_smatrix_beams<TGrid, typename TVector_c::value_type><<<grid_bt.Blk, grid_bt.Thr>>>(grid_2d, grid_w, ix_0, iy_0, coef, S, psi_w);
+	}
+
+	template <class TGrid, class TVector_c>
+	enable_if_device_vector<TVector_c, void>
+	multiply_window(Stream<e_device> &stream, TGrid &grid_2d, TGrid &grid_w, int ix_0, int iy_0, 
+	TVector_c &trans, TVector_c &psi_w)
+	{
+		auto grid_bt = grid_w.cuda_grid();
+
+		device_detail::multiply_window<TGrid, typename TVector_c::value_type><<<grid_bt.Blk, grid_bt.Thr>>>(grid_2d, grid_w, ix_0, iy_0, trans, psi_w);
+	}
+
 	template <class TGrid, class TVector_c>
 	enable_if_device_vector<TVector_c, void>
 	apply_CTF(Stream<e_device> &stream, TGrid &grid_2d, Lens<Value_type<TGrid>> &lens, Value_type<TGrid> gxu, Value_type<TGrid> gyu, TVector_c &fPsi_i, TVector_c &fPsi_o)
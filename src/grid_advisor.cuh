@@ -0,0 +1,251 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef GRID_ADVISOR_H
+#define GRID_ADVISOR_H
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+#include "math.cuh"
+#include "types.cuh"
+#include "traits.cuh"
+#include "fft.cuh"
+#include "timing.cuh"
+
+namespace mt
+{
+	/* FFT aware grid sizes: the candidate sizes of an axis are the even 7-smooth numbers from the
+	 * number of pixels required by the sampling up to (1+c_n_range) times it. The time per point of a
+	 * size is measured once per process with a batch of 1d transforms (the host plans come from the
+	 * plan registry), and the time of a 2d transform of (nx, ny) is estimated as
+	 * 		nx*ny*(t(nx) + t(ny))
+	 * since it is a pass of 1d transforms along each axis.
+	 */
+	template <class T, eDevice dev>
+	class Grid_Advisor
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+
+			static const eDevice device = dev;
+
+			struct Grid_Size
+			{
+				int nx;
+				int ny;
+				double time; 									// estimated time of a 2d transform (ms)
+			};
+
+			Grid_Advisor(): nthread(1){}
+
+			void set_input_data(const int &nthread_i)
+			{
+				nthread = max(1, nthread_i);
+			}
+
+			// grid sizes of the box (lx, ly) with a sampling not coarser than (dRx, dRy), fastest first
+			std::vector<Grid_Size> operator()(const T_r &lx, const T_r &ly, const T_r &dRx, const T_r &dRy, const int &n_grid = c_n_grid)
+			{
+				auto nx_c = candidates(lx, dRx);
+				auto ny_c = candidates(ly, dRy);
+
+				std::vector<Grid_Size> grids;
+				grids.reserve(nx_c.size()*ny_c.size());
+				for(auto nx: nx_c)
+				{
+					for(auto ny: ny_c)
+					{
+						grids.push_back({nx, ny, double(nx)*double(ny)*(time(nx) + time(ny))});
+					}
+				}
+
+				std::stable_sort(grids.begin(), grids.end(), [](const Grid_Size &a, const Grid_Size &b){ return a.time < b.time; });
+
+				if(grids.size() > max(1, n_grid))
+				{
+					grids.resize(max(1, n_grid));
+				}
+
+				return grids;
+			}
+
+			// the fastest grid with the box size and a sampling not coarser than the one of grid_2d
+			template <class TGrid>
+			bool adjust(TGrid &grid_2d)
+			{
+				auto grids = operator()(grid_2d.lx, grid_2d.ly, grid_2d.dRx, grid_2d.dRy, 1);
+				if(grids.empty() || ((grids[0].nx == grid_2d.nx) && (grids[0].ny == grid_2d.ny)))
+				{
+					return false;
+				}
+
+				grid_2d.set_input_data(grids[0].nx, grids[0].ny, grid_2d.lx, grid_2d.ly, grid_2d.dz,
+				grid_2d.bwl, grid_2d.pbc_xy, grid_2d.Rx_0, grid_2d.Ry_0);
+
+				return true;
+			}
+
+		private:
+			static const int c_n_grid = 8; 						// number of proposed grids
+			static const int c_n_points = 262144; 				// points of a calibration batch
+			static const int c_n_rep = 3; 						// calibration repetitions, the fastest one is kept
+			static constexpr double c_n_range = 0.25; 			// relative range of the candidate sizes
+
+			std::vector<int> candidates(const T_r &l, const T_r &dR)
+			{
+				// the required size is the user size when dR = l/n
+				int n_0 = max(2, static_cast<int>(ceil(l/dR - 1e-3)));
+				int n_e = static_cast<int>(ceil(n_0*(1 + c_n_range)));
+
+				std::vector<int> n_c;
+				for(auto n = n_0 + (n_0 % 2); n <= n_e; n += 2)
+				{
+					if(is_smooth(n))
+					{
+						n_c.push_back(n);
+					}
+				}
+
+				if(n_c.empty())
+				{
+					n_c.push_back(n_0);
+				}
+
+				return n_c;
+			}
+
+			static bool is_smooth(int n)
+			{
+				for(auto p: {2, 3, 5, 7})
+				{
+					while(n % p == 0)
+					{
+						n /= p;
+					}
+				}
+				return n == 1;
+			}
+
+			// time per point of a 1d transform of size n (ms), measured once per process
+			double time(const int &n)
+			{
+				static std::mutex mutex;
+				static std::map<std::pair<int, int>, double> time_n;
+
+				// calibrations run one at a time
+				std::lock_guard<std::mutex> lock(mutex);
+
+				auto key = std::make_pair(n, nthread);
+				auto it = time_n.find(key);
+				if(it != time_n.end())
+				{
+					return it->second;
+				}
+
+				int n_batch = max(1, c_n_points/n);
+				bool bb_release = is_plan_new(n, n_batch);
+
+				FFT<T_r, dev> fft_1d;
+				fft_1d.create_plan_1d_batch(n, n_batch, nthread);
+
+				Vector<T_c, dev> M(n*n_batch, T_c(0));
+
+				// warm up
+				fft_1d.forward(M);
+				fft_1d.inverse(M);
+
+				Timing<dev> timing;
+				double t_min = 0;
+				for(auto irep = 0; irep < c_n_rep; irep++)
+				{
+					timing.tic();
+					fft_1d.forward(M);
+					fft_1d.inverse(M);
+					timing.toc();
+
+					double t = timing.elapsed_ms();
+					t_min = (irep == 0)?t:min(t_min, t);
+				}
+				fft_1d.cleanup();
+
+				if(bb_release)
+				{
+					release_plan(n, n_batch);
+				}
+
+				double t = t_min/(2.0*n*n_batch);
+				time_n[key] = t;
+
+				return t;
+			}
+
+			/* calibration plans are released from the host plan registry, unless a plan of the same
+			 * key was already there (calibrations are serialized by the mutex of time)
+			 */
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, bool>
+			is_plan_new(const int &n, const int &n_batch)
+			{
+				return !FFTW_Plan_Registry<T_r>::instance().contains(eFFTW_1d_batch, n_batch, n, 1, nthread);
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, bool>
+			is_plan_new(const int &n, const int &n_batch)
+			{
+				return false;
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			release_plan(const int &n, const int &n_batch)
+			{
+				FFTW_Plan_Registry<T_r>::instance().release(eFFTW_1d_batch, n_batch, n, 1, nthread);
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			release_plan(const int &n, const int &n_batch){}
+
+			int nthread;
+	};
+
+	// FFT aware grid of the device of the simulation
+	template <class T, class TGrid>
+	bool adjust_grid_2d(System_Configuration &system_conf, TGrid &grid_2d)
+	{
+		if(system_conf.is_device())
+		{
+			Grid_Advisor<T, e_device> grid_advisor;
+			return grid_advisor.adjust(grid_2d);
+		}
+		else
+		{
+			Grid_Advisor<T, e_host> grid_advisor;
+			grid_advisor.set_input_data(system_conf.cpu_nthread);
+			return grid_advisor.adjust(grid_2d);
+		}
+	}
+
+} // namespace mt
+
+#endif
@@ -39,7 +39,7 @@ namespace mt
 
 			static const eDevice device = dev;
 
-			Incident_Wave(): input_multislice(nullptr), stream(nullptr), fft_2d(nullptr){}
+			Incident_Wave(): input_multislice(nullptr), stream(nullptr), fft_2d(nullptr), probe_tick(0){}
 
 			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Stream<dev> *stream_i, FFT<T_r, dev> *fft2_i)
 			{
@@ -55,7 +55,7 @@ namespace mt
 				}
 				else if(input_multislice->is_convergent_wave())
 				{
-					fpsi_0.resize(input_multislice->grid_2d.nxy());
+					set_probe_cache();
 				}
 			}
 
@@ -76,13 +76,23 @@ namespace mt
 						input_multislice->cond_lens.set_defocus(f_s);
 
 						mt::fill(*stream, psi, T_c(0));
+
+						auto fprobe = get_probe(gxu, gyu);
 						for(auto ib=0; ib<x_b.size(); ib++)
 						{
 							auto x = input_multislice->grid_2d.exp_factor_Rx(x_b[ib]);
 							auto y = input_multislice->grid_2d.exp_factor_Ry(y_b[ib]);
 
-							mt::probe(*stream, input_multislice->grid_2d, input_multislice->cond_lens, x, y, gxu, gyu, fpsi_0);
-							mt::add(*stream, fpsi_0, psi);
+							if(fprobe != nullptr)
+							{
+								set_phase_ramp(x, y, gxu, gyu);
+								mt::add_shift_probe(*stream, input_multislice->grid_2d, ex, ey, *fprobe, psi);
+							}
+							else
+							{
+								mt::probe(*stream, input_multislice->grid_2d, input_multislice->cond_lens, x, y, gxu, gyu, fpsi_0);
+								mt::add(*stream, fpsi_0, psi);
+							}
 						}
 						fft_2d->inverse(psi);
 
@@ -131,11 +141,131 @@ namespace mt
 			}
 
 		private:
+			static constexpr double c_probe_memory_fraction = 0.0625; 	// fraction of the free memory used by the cache
+
+			struct Probe_Entry
+			{
+				T_r c_10;
+				T_r gxu;
+				T_r gyu;
+				unsigned long long tick; 							// last use, 0: empty
+				Vector<T_c, dev> fprobe;
+
+				void clear()
+				{
+					c_10 = gxu = gyu = 0;
+					tick = 0;
+				}
+
+				bool is_empty() const
+				{
+					return tick == 0;
+				}
+
+				bool is_equal(const T_r &c_10_i, const T_r &gxu_i, const T_r &gyu_i) const
+				{
+					return !is_empty() && (c_10 == c_10_i) && (gxu == gxu_i) && (gyu == gyu_i);
+				}
+			};
+
+			// one entry per defocus: the temporal incoherence quadrature points get their own entries
+			void set_probe_cache()
+			{
+				auto nxy = input_multislice->grid_2d.nxy();
+				int n_probe_max = (input_multislice->is_illu_mod_full_integration())?input_multislice->cond_lens.ti_npts:1;
+
+				double free_memory = get_free_memory<dev>() - 10;
+				int n_probe = static_cast<int>(floor(c_probe_memory_fraction*max(0.0, free_memory)*1048576.0/(nxy*sizeof(T_c))));
+				n_probe = min(n_probe, max(1, n_probe_max));
+
+				probe_cache.resize(n_probe);
+				for(auto &probe_entry: probe_cache)
+				{
+					probe_entry.clear();
+					probe_entry.fprobe.resize(nxy);
+				}
+				probe_tick = 0;
+
+				if(probe_cache.empty())
+				{
+					fpsi_0.resize(nxy);
+				}
+				else
+				{
+					ex.resize(input_multislice->grid_2d.nx);
+					ey.resize(input_multislice->grid_2d.ny);
+					ex_h.resize(input_multislice->grid_2d.nx);
+					ey_h.resize(input_multislice->grid_2d.ny);
+				}
+			}
+
+			// returns the normalized probe at the origin for the current lens, exp(i*chi) is only 
+			// evaluated on a miss, which rebuilds the least recently used entry
+			Vector<T_c, dev>* get_probe(const T_r &gxu, const T_r &gyu)
+			{
+				if(probe_cache.empty())
+				{
+					return nullptr;
+				}
+
+				const T_r c_10 = input_multislice->cond_lens.c_10;
+
+				auto it_lru = probe_cache.begin();
+				for(auto it = probe_cache.begin(); it != probe_cache.end(); it++)
+				{
+					if(it->is_equal(c_10, gxu, gyu))
+					{
+						it->tick = ++probe_tick;
+						return &(it->fprobe);
+					}
+
+					if(it->tick < it_lru->tick)
+					{
+						it_lru = it;
+					}
+				}
+
+				it_lru->c_10 = c_10;
+				it_lru->gxu = gxu;
+				it_lru->gyu = gyu;
+				it_lru->tick = ++probe_tick;
+				mt::probe(*stream, input_multislice->grid_2d, input_multislice->cond_lens, T_r(0), T_r(0), gxu, gyu, it_lru->fprobe);
+
+				return &(it_lru->fprobe);
+			}
+
+			// separable phase ramp exp(i*(x*gx + y*gy)) of the probe position
+			void set_phase_ramp(const T_r &x, const T_r &y, const T_r &gxu, const T_r &gyu)
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+
+				for(auto ix = 0; ix < grid_2d.nx; ix++)
+				{
+					ex_h[ix] = euler(x*(grid_2d.gx_shift(ix)+gxu));
+				}
+
+				for(auto iy = 0; iy < grid_2d.ny; iy++)
+				{
+					ey_h[iy] = euler(y*(grid_2d.gy_shift(iy)+gyu));
+				}
+
+				thrust::copy(ex_h.begin(), ex_h.end(), ex.begin());
+				thrust::copy(ey_h.begin(), ey_h.end(), ey.begin());
+			}
+
 			Input_Multislice<T_r> *input_multislice;
 			Stream<dev> *stream;
 			FFT<T_r, dev> *fft_2d;
 
 			Vector<T_c, dev> fpsi_0;
+
+			std::vector<Probe_Entry> probe_cache;
+			unsigned long long probe_tick;
+
+			Vector<T_c, e_host> ex_h;
+			Vector<T_c, e_host> ey_h;
+			Vector<T_c, dev> ex;
+			Vector<T_c, dev> ey;
 	};
 
 } // namespace mt
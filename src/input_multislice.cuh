@@ -471,6 +471,8 @@ namespace mt
 		int pn_seed; 										// Random seed(frozen phonon)
 		int pn_nconf; 										// true: single phonon configuration, false: number of frozen phonon configurations
 		int fp_iconf_0;										// initial configuration
+		int pn_nconf_w; 									// configurations of the phonon weight (configuration workers), 0: pn_nconf
+		T pn_conv_tol; 										// relative standard error of the frozen phonon average, 0: pn_nconf configurations
 
 		Atom_Data<T> atoms; 								// atoms
 		bool is_crystal;
@@ -484,8 +486,11 @@ namespace mt
 		host_vector<T> thick; 								// Array of thickes
 
 		ePotential_Slicing potential_slicing; 				// ePS_Planes = 1, ePS_dz_Proj = 2, ePS_dz_Sub = 3, ePS_Auto = 4
+		ePotential_Eval potential_eval; 					// ePE_Scatter = 1, ePE_Gather = 2, ePE_Auto = 3
 
 		Grid_2d<T> grid_2d; 								// grid information
+		bool grid_auto; 									// FFT aware grid size with the same box size: true, false
+		bool bwl_pruned; 									// FFTs restricted to the band limited rows: true, false
 
 		Range_2d output_area;								// Output region information
 
@@ -511,6 +516,12 @@ namespace mt
 
 		Detector<T, e_host> detector; 						// STEM Detectors
 
+		STEM_4D<T> stem_4d; 								// 4D-STEM output
+		int stem_prism_f; 									// PRISM interpolation factor, 0: conventional multislice
+		bool stem_window; 									// probe propagated on a window of the grid centered at the beam
+		T stem_window_lx; 									// window size (Angstrom), 0: automatic
+		T stem_window_ly; 									// window size (Angstrom), 0: automatic
+
 		EELS<T> eels_fr; 									// EELS
 
 		eOperation_Mode operation_mode;						// eOM_Normal = 1, eOM_Advanced = 2
@@ -534,17 +545,20 @@ namespace mt
 		bool dp_Shift; 										// Shift diffraction pattern
 
 		Input_Multislice() :simulation_type(eTEMST_EWRS), pn_model(ePM_Still_Atom), interaction_model(eESIM_Multislice),
-			potential_slicing(ePS_Planes), potential_type(ePT_Lobato_0_12), fp_dist(1), pn_seed(300183),
-			pn_single_conf(false), pn_nconf(1), fp_iconf_0(1), spec_rot_theta(0), spec_rot_u0(0, 0, 1),
+			potential_slicing(ePS_Planes), potential_eval(ePE_Auto), potential_type(ePT_Lobato_0_12), fp_dist(1), pn_seed(300183),
+			pn_single_conf(false), pn_nconf(1), fp_iconf_0(1), pn_nconf_w(0), pn_conv_tol(0), spec_rot_theta(0), spec_rot_u0(0, 0, 1),
 			spec_rot_center_type(eRPT_geometric_center), spec_rot_center_p(1, 0, 0), illumination_model(eIM_Partial_Coherent),
 			temporal_spatial_incoh(eTSI_Temporal_Spatial), thick_type(eTT_Whole_Spec),
 			operation_mode(eOM_Normal), pn_coh_contrib(false), slice_storage(false), reverse_multislice(false),
 			mul_sign(1), E_0(300), lambda(0), theta(0), phi(0), nrot(1), Vrl(c_Vrl), nR(c_nR), iw_type(eIWT_Plane_Wave),
-			is_crystal(false), islice(0), dp_Shift(false) {};
+			is_crystal(false), islice(0), dp_Shift(false), stem_prism_f(0), 
+			stem_window(false), stem_window_lx(0), stem_window_ly(0), grid_auto(false), bwl_pruned(false) {};
 
 		template <class TInput_Multislice>
 		void assign(TInput_Multislice &input_multislice)
 		{
+			system_conf = input_multislice.system_conf;
+
 			interaction_model = input_multislice.interaction_model;
 			potential_type = input_multislice.potential_type;
 
@@ -562,6 +576,9 @@ namespace mt
 			pn_seed = input_multislice.pn_seed;
 			pn_single_conf = input_multislice.pn_single_conf;
 			pn_nconf = input_multislice.pn_nconf;
+			fp_iconf_0 = input_multislice.fp_iconf_0;
+			pn_nconf_w = input_multislice.pn_nconf_w;
+			pn_conv_tol = input_multislice.pn_conv_tol;
 
 			atoms = input_multislice.atoms;
 			is_crystal = input_multislice.is_crystal;
@@ -575,8 +592,12 @@ namespace mt
 			thick = input_multislice.thick;
 
 			potential_slicing = input_multislice.potential_slicing;
+			potential_eval = input_multislice.potential_eval;
 
 			grid_2d = input_multislice.grid_2d;
+			grid_auto = input_multislice.grid_auto;
+			bwl_pruned = input_multislice.bwl_pruned;
+			output_area = input_multislice.output_area;
 
 			simulation_type = input_multislice.simulation_type;
 
@@ -586,6 +607,7 @@ namespace mt
 			iw_y = input_multislice.iw_y;
 
 			E_0 = input_multislice.E_0;
+			lambda = input_multislice.lambda;
 			theta = input_multislice.theta;
 			phi = input_multislice.phi;
 			nrot = input_multislice.nrot;
@@ -598,6 +620,11 @@ namespace mt
 
 			scanning = input_multislice.scanning;
 			detector = input_multislice.detector;
+			stem_4d = input_multislice.stem_4d;
+			stem_prism_f = input_multislice.stem_prism_f;
+			stem_window = input_multislice.stem_window;
+			stem_window_lx = input_multislice.stem_window_lx;
+			stem_window_ly = input_multislice.stem_window_ly;
 
 			eels_fr = input_multislice.eels_fr;
 
@@ -627,6 +654,8 @@ namespace mt
 
 			fp_iconf_0 = (!is_frozen_phonon()) ? 1 : (pn_single_conf) ? pn_nconf : 1;
 
+			pn_conv_tol = (!is_frozen_phonon() || pn_single_conf) ? 0 : max(T(0), pn_conv_tol);
+
 			islice = max(0, islice);
 
 			if (isZero(Vrl))
@@ -647,6 +676,27 @@ namespace mt
 			}
 			scanning.set_grid();
 
+			if (!is_STEM())
+			{
+				stem_4d.set_default();
+			}
+			stem_4d.g_max = max(T(0), stem_4d.g_max);
+			stem_4d.bin = max(1, stem_4d.bin);
+			stem_4d.n_chunk = max(0, stem_4d.n_chunk);
+
+			// the probe window (nx/f, ny/f) has to tile the grid
+			stem_prism_f = (is_STEM()) ? max(0, stem_prism_f) : 0;
+			while ((stem_prism_f > 1) && ((grid_2d.nx % stem_prism_f != 0) || (grid_2d.ny % stem_prism_f != 0)))
+			{
+				stem_prism_f--;
+			}
+
+			stem_window = is_STEM() && stem_window;
+
+			bwl_pruned = bwl_pruned && grid_2d.bwl;
+			stem_window_lx = max(T(0), stem_window_lx);
+			stem_window_ly = max(T(0), stem_window_ly);
+
 			lambda = get_lambda(E_0);
 
 			// tem_simulation sign
@@ -896,7 +946,7 @@ namespace mt
 
 		T get_phonon_rot_weight() const
 		{
-			int nconf = (!is_frozen_phonon() || pn_single_conf) ? 1 : pn_nconf;
+			int nconf = (!is_frozen_phonon() || pn_single_conf) ? 1 : (pn_nconf_w > 0) ? pn_nconf_w : pn_nconf;
 			return 1.0 / static_cast<T>(nconf*nrot);
 		}
 
@@ -1003,6 +1053,16 @@ namespace mt
 			return mt::is_subslicing(interaction_model, potential_slicing);
 		}
 
+		bool is_potential_scatter() const
+		{
+			return potential_eval == mt::ePE_Scatter;
+		}
+
+		bool is_potential_gather() const
+		{
+			return potential_eval == mt::ePE_Gather;
+		}
+
 		bool is_subslicing_whole_spec() const
 		{
 			return mt::is_subslicing_whole_spec(interaction_model, potential_slicing, thick_type);
@@ -1299,6 +1359,22 @@ namespace mt
 			return detector.is_detector_radial();
 		}
 
+		// radial detector: |g| is binned with dg_min up to the largest circle inside the grid
+		int det_radial_nr() const
+		{
+			return max(1, static_cast<int>(floor(grid_2d.g_max()/grid_2d.dg_min())));
+		}
+
+		T det_radial_dg() const
+		{
+			return grid_2d.dg_min();
+		}
+
+		bool is_STEM_4D() const
+		{
+			return is_STEM() && stem_4d.is_enable();
+		}
+
 		bool is_detector_matrix() const
 		{
 			return detector.is_detector_matrix();
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <type_traits>
 #include <cmath>
+#include <string>
 
 #include "types.cuh"
 #include "traits.cuh"
@@ -138,6 +139,25 @@ T mx_get_scalar_field(const mxArray *mxB, const char *field_name)
 	return mx_get_scalar_field<T>(mxB, 0, field_name);
 }
 
+inline std::string mx_get_string(const mxArray *mxB)
+{
+	if((mxB==nullptr) || !mxIsChar(mxB))
+	{
+		return std::string();
+	}
+
+	char *str = mxArrayToString(mxB);
+	std::string s(str);
+	mxFree(str);
+
+	return s;
+}
+
+inline std::string mx_get_string_field(const mxArray *mxB, const char *field_name)
+{
+	return mx_get_string(mxGetField(mxB, 0, field_name));
+}
+
 /**************************************************************************/
 template <class T>
 T mx_get_matrix_field(const mxArray *mxB, const int &idx, const char *field_name)
@@ -271,6 +291,54 @@ namespace mt
 			system_conf.cpu_ncores = 1; 
 			//system_conf.cpu_ncores = mx_get_scalar_field<int>(mx_input, "cpu_ncores"); 
 			system_conf.cpu_nthread = mx_get_scalar_field<int>(mx_input, "cpu_nthread"); 
+			if(mx_field_exits(mx_input, "cpu_nthread_scan"))
+			{
+				system_conf.cpu_nthread_scan = mx_get_scalar_field<int>(mx_input, "cpu_nthread_scan"); 
+			}
+			if(mx_field_exits(mx_input, "cpu_scan_batch"))
+			{
+				system_conf.cpu_scan_batch = mx_get_scalar_field<int>(mx_input, "cpu_scan_batch"); 
+			}
+			if(mx_field_exits(mx_input, "cpu_scan_tile"))
+			{
+				system_conf.cpu_scan_tile = mx_get_scalar_field<int>(mx_input, "cpu_scan_tile"); 
+			}
+			if(mx_field_exits(mx_input, "cpu_cache_size"))
+			{
+				system_conf.cpu_cache_size = mx_get_scalar_field<int>(mx_input, "cpu_cache_size"); 
+			}
+			if(mx_field_exits(mx_input, "cpu_nthread_conf"))
+			{
+				system_conf.cpu_nthread_conf = mx_get_scalar_field<int>(mx_input, "cpu_nthread_conf"); 
+			}
+			if(mx_field_exits(mx_input, "cpu_slice_fused"))
+			{
+				system_conf.cpu_slice_fused = mx_get_scalar_field<int>(mx_input, "cpu_slice_fused"); 
+			}
+			if(mx_field_exits(mx_input, "cache_dir"))
+			{
+				system_conf.cache_dir = mx_get_string_field(mx_input, "cache_dir"); 
+			}
+			if(mx_field_exits(mx_input, "fftw_wisdom_dir"))
+			{
+				system_conf.fftw_wisdom_dir = mx_get_string_field(mx_input, "fftw_wisdom_dir"); 
+			}
+			if(mx_field_exits(mx_input, "fftw_rigor"))
+			{
+				system_conf.fftw_rigor = mx_get_scalar_field<int>(mx_input, "fftw_rigor"); 
+			}
+			if(mx_field_exits(mx_input, "slice_scratch_dir"))
+			{
+				system_conf.slice_scratch_dir = mx_get_string_field(mx_input, "slice_scratch_dir"); 
+			}
+			if(mx_field_exits(mx_input, "slice_prefetch"))
+			{
+				system_conf.slice_prefetch = mx_get_scalar_field<int>(mx_input, "slice_prefetch"); 
+			}
+			if(mx_field_exits(mx_input, "prop_cache"))
+			{
+				system_conf.prop_cache = mx_get_scalar_field<int>(mx_input, "prop_cache"); 
+			}
 			system_conf.gpu_device = mx_get_scalar_field<int>(mx_input, "gpu_device");
 			system_conf.gpu_nstream = 0; 
 			//system_conf.gpu_nstream = mx_get_scalar_field<int>(mx_input, "gpu_nstream"); 
@@ -34,6 +34,7 @@
 	#endif
 #endif
 #include <cstddef>
+#include <initializer_list>
 
 #include <thread>
 #include <vector>
@@ -122,6 +123,36 @@ namespace mt
 		return free;
 	}
 
+	// size of the last level cache (MB), 0 when it is not known
+	inline
+	double get_cache_size()
+	{
+		double size = 0;
+#if defined(__APPLE__)
+		for(auto name: {"hw.l3cachesize", "hw.l2cachesize"})
+		{
+			int64_t size_b = 0;
+			size_t len = sizeof(size_b);
+			if((sysctlbyname(name, &size_b, &len, NULL, 0) == 0) && (size_b > 0))
+			{
+				size = static_cast<double>(size_b)/1048576.0;
+				break;
+			}
+		}
+#elif !defined(_WIN32) && defined(_SC_LEVEL3_CACHE_SIZE)
+		for(auto name: {_SC_LEVEL3_CACHE_SIZE, _SC_LEVEL2_CACHE_SIZE})
+		{
+			long size_b = sysconf(name);
+			if(size_b > 0)
+			{
+				size = static_cast<double>(size_b)/1048576.0;
+				break;
+			}
+		}
+#endif
+		return size;
+	}
+
 	inline
 	void get_device_properties(std::vector<Device_Properties> &device_properties)
 	{
@@ -103,7 +103,7 @@ namespace mt
 		using TVector_dc = device_vector<complex<T>>;
 
 		Output_Multislice() : Input_Multislice<T_r>(), output_type(eTEMOT_m2psi_tot), 
-		ndetector(0), nx(0), ny(0), dx(0), dy(0), dr(0), n_thk(0), n_thk_d(0) {}
+		ndetector(0), nx(0), ny(0), dx(0), dy(0), dr(0), nr(0), pn_nconf_run(0), pn_conv_err(0), slice_mem_type(eSMT_none), slice_mem_err(0), n_thk(0), n_thk_d(0) {}
 
 		template <class TOutput_Multislice>
 		void assign(TOutput_Multislice &output_multislice)
@@ -122,6 +122,20 @@ namespace mt
 			y = output_multislice.y;
 			r = output_multislice.r;
 
+			nr = output_multislice.nr;
+			radial_g = output_multislice.radial_g;
+
+			pn_nconf_run = output_multislice.pn_nconf_run;
+			pn_conv_err = output_multislice.pn_conv_err;
+			slice_mem_type = output_multislice.slice_mem_type;
+			slice_mem_err = output_multislice.slice_mem_err;
+
+			radial_tot.resize(output_multislice.radial_tot.size());
+			for (auto ithk = 0; ithk < output_multislice.radial_tot.size(); ithk++)
+			{
+				radial_tot[ithk] = output_multislice.radial_tot[ithk];
+			}
+
 			image_tot.resize(output_multislice.image_tot.size());
 			for (auto ithk = 0; ithk < output_multislice.image_tot.size(); ithk++)
 			{
@@ -208,6 +222,19 @@ namespace mt
 			r.clear();
 			r.shrink_to_fit();
 
+			nr = 0;
+
+			radial_g.clear();
+			radial_g.shrink_to_fit();
+
+			pn_nconf_run = 0;
+			pn_conv_err = 0;
+			slice_mem_type = eSMT_none;
+			slice_mem_err = 0;
+
+			radial_tot.clear();
+			radial_tot.shrink_to_fit();
+
 			image_tot.clear();
 			image_tot.shrink_to_fit();
 
@@ -448,6 +475,8 @@ namespace mt
 
 			set_output_type();
 
+			set_radial_output();
+
 			switch (output_type)
 			{
 				case eTEMOT_image_tot_coh:
@@ -633,6 +662,11 @@ namespace mt
 
 		void init()
 		{
+			for (auto ithk = 0; ithk < radial_tot.size(); ithk++)
+			{
+				mt::fill(stream, radial_tot[ithk], T_r(0));
+			}
+
 			switch (output_type)
 			{
 			case eTEMOT_image_tot_coh:
@@ -766,6 +800,130 @@ namespace mt
 		}
 
 		/***************************************************************************/
+		// radial profile of the probe position iscan: radial_tot[ithk] is a (scanning size) x nr array
+		void add_scale_radial_tot(int ithk, int iscan, T_r w, Vector<T_r, e_host> &hist)
+		{
+			const int ns = nxy();
+			auto &radial = radial_tot[ithk];
+			for (auto ir = 0; ir < nr; ir++)
+			{
+				radial[iscan + ir*ns] += w*hist[ir];
+			}
+		}
+
+		/***************************************************************************/
+		// adds the accumulated outputs of the configurations run on another output (host outputs)
+		template <class TOutput_Multislice>
+		void add_conf(TOutput_Multislice &output_multislice)
+		{
+			for (auto ithk = 0; ithk < radial_tot.size(); ithk++)
+			{
+				mt::add(stream, output_multislice.radial_tot[ithk], radial_tot[ithk]);
+			}
+
+			for (auto ithk = 0; ithk < image_tot.size(); ithk++)
+			{
+				for (auto idet = 0; idet < image_tot[ithk].image.size(); idet++)
+				{
+					mt::add(stream, output_multislice.image_tot[ithk].image[idet], image_tot[ithk].image[idet]);
+				}
+			}
+
+			for (auto ithk = 0; ithk < m2psi_tot.size(); ithk++)
+			{
+				mt::add(stream, output_multislice.m2psi_tot[ithk], m2psi_tot[ithk]);
+			}
+
+			// the coherent intensities are evaluated from the summed coherent wave
+			for (auto ithk = 0; ithk < psi_coh.size(); ithk++)
+			{
+				mt::add(stream, output_multislice.psi_coh[ithk], psi_coh[ithk]);
+			}
+		}
+
+		// rescale the configuration sums: the frozen phonon average stopped before pn_nconf configurations
+		void scale_conf(T_r f)
+		{
+			for (auto ithk = 0; ithk < radial_tot.size(); ithk++)
+			{
+				mt::scale(stream, f, radial_tot[ithk]);
+			}
+
+			for (auto ithk = 0; ithk < image_tot.size(); ithk++)
+			{
+				for (auto idet = 0; idet < image_tot[ithk].image.size(); idet++)
+				{
+					mt::scale(stream, f, image_tot[ithk].image[idet]);
+				}
+			}
+
+			for (auto ithk = 0; ithk < m2psi_tot.size(); ithk++)
+			{
+				if((ithk < m2psi_tot_d.size()) && thk_gpu[ithk])
+				{
+					thrust::transform(thrust::device, m2psi_tot_d[ithk].begin(), m2psi_tot_d[ithk].end(), m2psi_tot_d[ithk].begin(), functor::scale<T_r>(f));
+				}
+				else
+				{
+					mt::scale(stream, f, m2psi_tot[ithk]);
+				}
+			}
+
+			for (auto ithk = 0; ithk < psi_coh.size(); ithk++)
+			{
+				if((ithk < psi_coh_d.size()) && thk_gpu[ithk])
+				{
+					thrust::transform(thrust::device, psi_coh_d[ithk].begin(), psi_coh_d[ithk].end(), psi_coh_d[ithk].begin(), functor::scale<T_c>(T_c(f)));
+				}
+				else
+				{
+					mt::scale(stream, T_c(f), psi_coh[ithk]);
+				}
+			}
+		}
+
+		// incoherent intensities summed over the configurations: detector intensities or m2psi_tot
+		template<class TVector>
+		void get_conf_data(TVector &data)
+		{
+			int n_data = 0;
+			for (auto ithk = 0; ithk < image_tot.size(); ithk++)
+			{
+				for (auto idet = 0; idet < image_tot[ithk].image.size(); idet++)
+				{
+					n_data += image_tot[ithk].image[idet].size();
+				}
+			}
+
+			for (auto ithk = 0; ithk < m2psi_tot.size(); ithk++)
+			{
+				n_data += m2psi_tot[ithk].size();
+			}
+
+			data.resize(n_data);
+
+			auto it = data.begin();
+			for (auto ithk = 0; ithk < image_tot.size(); ithk++)
+			{
+				for (auto idet = 0; idet < image_tot[ithk].image.size(); idet++)
+				{
+					it = thrust::copy(image_tot[ithk].image[idet].begin(), image_tot[ithk].image[idet].end(), it);
+				}
+			}
+
+			for (auto ithk = 0; ithk < m2psi_tot.size(); ithk++)
+			{
+				if((ithk < m2psi_tot_d.size()) && thk_gpu[ithk])
+				{
+					it = thrust::copy(m2psi_tot_d[ithk].begin(), m2psi_tot_d[ithk].end(), it);
+				}
+				else
+				{
+					it = thrust::copy(m2psi_tot[ithk].begin(), m2psi_tot[ithk].end(), it);
+				}
+			}
+		}
+
 		template<class TVector>
 		void add_scale_psi_coh(int ithk, T_c w, TVector &phi)
 		{
@@ -1178,6 +1336,15 @@ namespace mt
 		host_vector<Det_Int<TVector_hr>> image_tot;
 		host_vector<Det_Int<TVector_hr>> image_coh;
 
+		int nr; 								// number of radial bins of the radial detector
+		host_vector<T_r> radial_g; 				// radial bins (Ang^-1)
+		host_vector<TVector_hr> radial_tot; 	// radial profiles
+
+		int pn_nconf_run; 						// frozen phonon configurations averaged (convergence control)
+		T_r pn_conv_err; 						// relative standard error of the frozen phonon average
+		eSlice_Memory_Type slice_mem_type; 		// storage of the slices (slice_storage)
+		T_r slice_mem_err; 						// bound of the error of the stored transmission functions
+
 		host_vector<TVector_hr> m2psi_tot;
 		host_vector<TVector_hr> m2psi_coh;
 		host_vector<TVector_hc> psi_coh;
@@ -1204,6 +1371,29 @@ namespace mt
 			return static_cast<int>(floor(memory/mt::sizeMb<U>(nxy)));
 		}
 
+		void set_radial_output()
+		{
+			if (!(this->is_STEM() && this->is_detector_radial()))
+			{
+				return;
+			}
+
+			nr = this->det_radial_nr();
+			auto dg = this->det_radial_dg();
+
+			radial_g.resize(nr);
+			for (auto ir = 0; ir < nr; ir++)
+			{
+				radial_g[ir] = ir*dg;
+			}
+
+			radial_tot.resize(n_thk);
+			for (auto ithk = 0; ithk < n_thk; ithk++)
+			{
+				radial_tot[ithk].resize(nxy()*nr);
+			}
+		}
+
 		void set_output_grid()
 		{
 			if (this->is_STEM() || this->is_EELS())
@@ -0,0 +1,360 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef PRISM_H
+#define PRISM_H
+
+#include <vector>
+
+#include "math.cuh"
+#include "types.cuh"
+#include "traits.cuh"
+#include "stream.cuh"
+#include "fft.cuh"
+#include "memory_info.cuh"
+#include "input_multislice.cuh"
+#include "cpu_fcns.hpp"
+#include "gpu_fcns.cuh"
+#include "cgpu_fcns.cuh"
+#include "wave_function.cuh"
+
+namespace mt
+{
+	/* PRISM STEM engine: the exit waves of the plane waves inside the condenser aperture, taken
+	 * every f pixels in reciprocal space (the S-matrix), are computed once per phonon configuration.
+	 * Each probe is then synthesized as the weighted sum of the S-matrix beams over a window of
+	 * (nx/f, ny/f) pixels centered at the probe position; the window is transformed and integrated
+	 * over the detectors with a reciprocal sampling f times coarser than the full grid.
+	 */
+	template <class T, eDevice dev>
+	class PRISM
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+
+			static const eDevice device = dev;
+
+			PRISM(): input_multislice(nullptr), wave_function(nullptr), f(0), n_beam(0), n_batch(1), z_prop_b(0), b_prop_b(false){}
+
+			static bool is_enabled(Input_Multislice<T_r> &input_multislice_i)
+			{
+				return input_multislice_i.is_STEM() && (input_multislice_i.stem_prism_f > 0)
+					&& !input_multislice_i.pn_coh_contrib && !input_multislice_i.is_illu_mod_full_integration()
+					&& input_multislice_i.is_convergent_wave() && isZero(input_multislice_i.theta)
+					&& input_multislice_i.detector.is_detector_circular() && !input_multislice_i.is_STEM_4D();
+			}
+
+			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Wave_Function<T_r, dev> *wave_function_i)
+			{
+				clear();
+
+				input_multislice = input_multislice_i;
+				wave_function = wave_function_i;
+
+				auto &grid_2d = input_multislice->grid_2d;
+				f = input_multislice->stem_prism_f;
+
+				set_beams();
+				if(n_beam == 0)
+				{
+					return;
+				}
+
+				// S-matrix beams are propagated in blocks of n_batch with one batched fft per slice
+				n_batch = min(n_beam, c_n_batch_max);
+				int n_block = (n_beam+n_batch-1)/n_batch;
+				int n_thk = input_multislice->thick.size();
+
+				// the running S-matrix and one copy per thickness have to fit in the memory budget
+				double free_memory = get_free_memory<dev>() - 10;
+				double smatrix_memory = (1.0+n_thk)*n_block*n_batch*grid_2d.nxy()*sizeof(T_c)/1048576.0;
+				if(smatrix_memory > c_smatrix_memory_fraction*max(0.0, free_memory))
+				{
+					n_beam = 0;
+					return;
+				}
+
+				int nthread = input_multislice->system_conf.cpu_nthread;
+				stream.resize(nthread);
+
+				fft_b.create_plan_2d_batch(grid_2d.ny, grid_2d.nx, n_batch, nthread);
+
+				grid_w.set_input_data(grid_2d.nx/f, grid_2d.ny/f, grid_2d.lx/f, grid_2d.ly/f, grid_2d.dz, grid_2d.bwl, grid_2d.pbc_xy);
+				fft_w.create_plan_2d(grid_w.ny, grid_w.nx, nthread);
+
+				S.resize(n_block);
+				for(auto &S_b: S)
+				{
+					S_b.resize(n_batch*grid_2d.nxy());
+				}
+
+				S_thk.resize(n_thk);
+				for(auto &S_k: S_thk)
+				{
+					S_k.resize(n_block);
+					for(auto &S_b: S_k)
+					{
+						S_b.resize(n_batch*grid_2d.nxy());
+					}
+				}
+
+				prop_b.resize(grid_2d.nxy());
+				coef_h.resize(n_batch);
+				coef.resize(n_batch);
+				psi_w.resize(grid_w.nxy());
+			}
+
+			int size() const
+			{
+				return n_beam;
+			}
+
+			template <class TOutput_multislice>
+			void operator()(T_r w_i, TOutput_multislice &output_multislice)
+			{
+				set_smatrix();
+
+				// probe coefficients at the entrance plane, as in the conventional incident wave
+				auto &cond_lens = input_multislice->cond_lens;
+				auto f_0 = cond_lens.c_10;
+				cond_lens.set_defocus(f_0 - (cond_lens.zero_defocus_plane-wave_function->slicing.z_m(0)));
+				set_beam_amplitudes();
+				cond_lens.set_defocus(f_0);
+
+				for(auto iscan = 0; iscan < input_multislice->scanning.size(); iscan++)
+				{
+					psi(iscan, w_i, output_multislice);
+				}
+			}
+
+			void clear()
+			{
+				n_beam = 0;
+				b_prop_b = false;
+				S.clear();
+				S_thk.clear();
+				fft_b.destroy_plan();
+				fft_w.destroy_plan();
+			}
+
+		private:
+			static const int c_n_batch_max = 16; 						// maximum number of beams per batched fft
+			static constexpr double c_smatrix_memory_fraction = 0.5; 	// fraction of the free memory used by the S-matrix
+
+			// plane waves of the sub-lattice f*(dgx, dgy) inside the condenser aperture
+			void set_beams()
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &cond_lens = input_multislice->cond_lens;
+
+				ix_b.clear();
+				iy_b.clear();
+				for(auto ix = 0; ix < grid_2d.nx; ix++)
+				{
+					for(auto iy = 0; iy < grid_2d.ny; iy++)
+					{
+						auto g2 = grid_2d.g2_shift(ix, iy);
+						bool bb = (grid_2d.igx_shift(ix) % f == 0) && (grid_2d.igy_shift(iy) % f == 0);
+						if(bb && (cond_lens.g2_min <= g2) && (g2 < cond_lens.g2_max))
+						{
+							ix_b.push_back(ix);
+							iy_b.push_back(iy);
+						}
+					}
+				}
+				n_beam = ix_b.size();
+			}
+
+			// normalized probe amplitudes exp(i*chi) at the beams
+			void set_beam_amplitudes()
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+
+				fprobe_b.resize(n_beam);
+				T_r sum = 0;
+				for(auto ib = 0; ib < n_beam; ib++)
+				{
+					fprobe_b[ib] = host_device_detail::exp_i_chi(ix_b[ib], iy_b[ib], grid_2d, input_multislice->cond_lens, T_r(0), T_r(0), T_r(0), T_r(0));
+					sum += norm(fprobe_b[ib]);
+				}
+
+				T_r factor = (sum > 0) ? 1/sqrt(sum) : 0;
+				for(auto ib = 0; ib < n_beam; ib++)
+				{
+					fprobe_b[ib] *= factor;
+				}
+			}
+
+			// unit plane waves are transmitted and propagated block by block, slices in the outer loop
+			// so the transmission function of a slice is evaluated once for all the beams
+			void set_smatrix()
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &wf = *wave_function;
+				auto nxy = grid_2d.nxy();
+
+				Vector<T_c, e_host> S_h(n_batch*nxy);
+				for(auto iblock = 0; iblock < S.size(); iblock++)
+				{
+					thrust::fill(S_h.begin(), S_h.end(), T_c(0));
+					for(auto ib = 0; ib < n_batch; ib++)
+					{
+						int ib_g = iblock*n_batch+ib;
+						if(ib_g < n_beam)
+						{
+							S_h[ib*nxy+grid_2d.ind_col(ix_b[ib_g], iy_b[ib_g])] = T_c(1);
+						}
+					}
+					S[iblock].assign(S_h.begin(), S_h.end());
+					fft_b.inverse(S[iblock]);
+				}
+
+				for(auto islice = 0; islice < wf.slicing.slice.size(); islice++)
+				{
+					bool trans_stored = wf.is_trans_stored(islice);
+					if(!trans_stored)
+					{
+						wf.trans(islice, wf.trans_0);
+					}
+
+					for(auto &S_b: S)
+					{
+						if(trans_stored)
+						{
+							wf.transmit_batch(stream, islice, S_b);
+						}
+						else
+						{
+							mt::multiply_batch(stream, wf.trans_0, S_b);
+						}
+
+						if(input_multislice->is_multislice())
+						{
+							propagate_batch(wf.dz(islice), S_b);
+						}
+					}
+
+					int ithk = wf.slicing.slice[islice].ithk;
+					if(0 <= ithk)
+					{
+						auto z = wf.slicing.thick[ithk].z_back_prop;
+						for(auto iblock = 0; iblock < S.size(); iblock++)
+						{
+							auto &S_b = S_thk[ithk][iblock];
+							S_b.assign(S[iblock].begin(), S[iblock].end());
+							if(!isZero(z) || grid_2d.bwl)
+							{
+								propagate_batch(z, S_b);
+							}
+						}
+					}
+				}
+			}
+
+			void propagate_batch(const T_r &z, Vector<T_c, dev> &psi_b)
+			{
+				if(!b_prop_b || (z != z_prop_b))
+				{
+					mt::propagator_kernel(stream, input_multislice->grid_2d, input_multislice->get_propagator_factor(z), T_r(0), T_r(0), prop_b);
+					z_prop_b = z;
+					b_prop_b = true;
+				}
+
+				fft_b.forward(psi_b);
+				mt::multiply_batch(stream, prop_b, psi_b);
+				fft_b.inverse(psi_b);
+			}
+
+			template <class TOutput_multislice>
+			void psi(const int &iscan, const T_r &w_i, TOutput_multislice &output_multislice)
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &detector = input_multislice->detector;
+
+				T_r x = input_multislice->scanning.x[iscan];
+				T_r y = input_multislice->scanning.y[iscan];
+
+				// window centered at the probe position (the real space grid is stored shifted by (lx, ly)/2)
+				int ix_c = static_cast<int>(floor((x-grid_2d.lxh())/grid_2d.dRx+0.5));
+				int iy_c = static_cast<int>(floor((y-grid_2d.lyh())/grid_2d.dRy+0.5));
+				int ix_0 = ((ix_c - grid_w.nxh) % grid_2d.nx + grid_2d.nx) % grid_2d.nx;
+				int iy_0 = ((iy_c - grid_w.nyh) % grid_2d.ny + grid_2d.ny) % grid_2d.ny;
+
+				// probe position as a phase of each beam
+				T_r xf = grid_2d.exp_factor_Rx(x);
+				T_r yf = grid_2d.exp_factor_Ry(y);
+
+				for(auto ithk = 0; ithk < S_thk.size(); ithk++)
+				{
+					mt::fill(stream, psi_w, T_c(0));
+					for(auto iblock = 0; iblock < S.size(); iblock++)
+					{
+						for(auto ib = 0; ib < n_batch; ib++)
+						{
+							int ib_g = iblock*n_batch+ib;
+							coef_h[ib] = (ib_g < n_beam) ? fprobe_b[ib_g]*euler(xf*grid_2d.gx_shift(ix_b[ib_g]) + yf*grid_2d.gy_shift(iy_b[ib_g])) : T_c(0);
+						}
+						coef.assign(coef_h.begin(), coef_h.end());
+
+						mt::add_smatrix_beams(stream, grid_2d, grid_w, ix_0, iy_0, coef, S_thk[ithk][iblock], psi_w);
+					}
+
+					fft_w.forward(psi_w);
+					mt::scale(stream, grid_w.inxy(), psi_w);
+
+					for(auto iDet = 0; iDet < detector.size(); iDet++)
+					{
+						auto g_inner = detector.g_inner[iDet];
+						auto g_outer = detector.g_outer[iDet];
+						output_multislice.image_tot[ithk].image[iDet][iscan] += w_i*mt::sum_square_over_Det(stream, grid_w, g_inner, g_outer, psi_w);
+					}
+				}
+			}
+
+			Input_Multislice<T_r> *input_multislice;
+			Wave_Function<T_r, dev> *wave_function;
+
+			int f; 												// interpolation factor
+			int n_beam; 										// number of S-matrix beams
+			int n_batch; 										// beams per block
+
+			Vector<int, e_host> ix_b; 							// beam pixels
+			Vector<int, e_host> iy_b;
+			Vector<T_c, e_host> fprobe_b; 						// probe amplitudes at the beams
+
+			Stream<dev> stream;
+			FFT<T_r, dev> fft_b;
+			FFT<T_r, dev> fft_w;
+			Grid_2d<T_r> grid_w; 								// probe window
+
+			std::vector<Vector<T_c, dev>> S; 					// running S-matrix
+			std::vector<std::vector<Vector<T_c, dev>>> S_thk; 	// S-matrix at each thickness
+
+			Vector<T_c, dev> prop_b;
+			T_r z_prop_b;
+			bool b_prop_b;
+
+			Vector<T_c, e_host> coef_h;
+			Vector<T_c, dev> coef;
+			Vector<T_c, dev> psi_w;
+	};
+
+} // namespace mt
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef PROBE_WINDOW_H
+#define PROBE_WINDOW_H
+
+#include <vector>
+
+#include "math.cuh"
+#include "types.cuh"
+#include "traits.cuh"
+#include "stream.cuh"
+#include "fft.cuh"
+#include "memory_info.cuh"
+#include "input_multislice.cuh"
+#include "cpu_fcns.hpp"
+#include "gpu_fcns.cuh"
+#include "cgpu_fcns.cuh"
+#include "incident_wave.cuh"
+#include "propagator.cuh"
+#include "wave_function.cuh"
+
+namespace mt
+{
+	/* Probe window STEM engine: each probe is propagated on a window of (nx_w, ny_w) pixels of the
+	 * grid centered at the beam, with the real space sampling of the full grid. The transmission
+	 * function of a slice is taken from slice storage, or evaluated once for a group of probes, and
+	 * cropped to each window. The window size follows the spread of the probe through the specimen.
+	 */
+	template <class T, eDevice dev>
+	class Probe_Window
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+
+			static const eDevice device = dev;
+
+			Probe_Window(): input_multislice(nullptr), wave_function(nullptr), n_group(0){}
+
+			static bool is_enabled(Input_Multislice<T_r> &input_multislice_i)
+			{
+				return input_multislice_i.is_STEM() && input_multislice_i.stem_window
+					&& !input_multislice_i.pn_coh_contrib && !input_multislice_i.is_illu_mod_full_integration()
+					&& input_multislice_i.is_convergent_wave() && isZero(input_multislice_i.theta)
+					&& input_multislice_i.detector.is_detector_circular() && !input_multislice_i.is_STEM_4D();
+			}
+
+			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Wave_Function<T_r, dev> *wave_function_i)
+			{
+				clear();
+
+				input_multislice = input_multislice_i;
+				wave_function = wave_function_i;
+
+				auto &grid_2d = input_multislice->grid_2d;
+
+				int nx_w, ny_w;
+				set_window_size(nx_w, ny_w);
+
+				// nothing to gain when the window covers the grid
+				if((nx_w == grid_2d.nx) && (ny_w == grid_2d.ny))
+				{
+					return;
+				}
+
+				// the condenser lens and the beam position are modified per probe
+				input_multislice_w = *input_multislice;
+				input_multislice_w.atoms.clear();
+				input_multislice_w.grid_2d.set_input_data(nx_w, ny_w, nx_w*grid_2d.dRx, ny_w*grid_2d.dRy, grid_2d.dz, grid_2d.bwl, grid_2d.pbc_xy);
+				input_multislice_w.cond_lens.set_input_data(input_multislice_w.E_0, input_multislice_w.grid_2d);
+				input_multislice_w.iscan.resize(1);
+				input_multislice_w.beam_x.resize(1);
+				input_multislice_w.beam_y.resize(1);
+
+				auto &grid_w = input_multislice_w.grid_2d;
+
+				// windows of a group of probes advance together through the slices
+				double free_memory = get_free_memory<dev>() - 10;
+				n_group = static_cast<int>(floor(c_window_memory_fraction*max(0.0, free_memory)*1048576.0/(grid_w.nxy()*sizeof(T_c))));
+				n_group = min(n_group, input_multislice->scanning.size());
+				if(n_group < 1)
+				{
+					n_group = 0;
+					return;
+				}
+
+				int nthread = input_multislice->system_conf.cpu_nthread;
+				stream.resize(nthread);
+				fft_w.create_plan_2d(grid_w.ny, grid_w.nx, nthread);
+
+				incident_wave.set_input_data(&input_multislice_w, &stream, &fft_w);
+				propagator.set_input_data(&input_multislice_w, &stream, &fft_w);
+
+				psi_w.resize(n_group);
+				for(auto &psi: psi_w)
+				{
+					psi.resize(grid_w.nxy());
+				}
+				psi_o.resize(grid_w.nxy());
+				ix_0.resize(n_group);
+				iy_0.resize(n_group);
+			}
+
+			int size() const
+			{
+				return n_group;
+			}
+
+			template <class TOutput_multislice>
+			void operator()(T_r w_i, TOutput_multislice &output_multislice)
+			{
+				int n_scan = input_multislice->scanning.size();
+				for(auto iscan_0 = 0; iscan_0 < n_scan; iscan_0 += n_group)
+				{
+					psi(iscan_0, min(iscan_0+n_group, n_scan), w_i, output_multislice);
+				}
+			}
+
+			void clear()
+			{
+				n_group = 0;
+				psi_w.clear();
+				fft_w.destroy_plan();
+			}
+
+		private:
+			static constexpr double c_window_memory_fraction = 0.25; 	// fraction of the free memory used by the windows
+			static constexpr double c_window_r_min = 8.0; 				// minimum window radius (Angstrom)
+
+			/* radius of the probe: geometric spread of the aperture cone over the defocus and the
+			 * specimen thickness, spherical aberration blur and a margin for the probe tails
+			 */
+			void set_window_size(int &nx_w, int &ny_w)
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &cond_lens = input_multislice->cond_lens;
+				auto &atoms = input_multislice->atoms;
+
+				T_r alpha = cond_lens.lambda*sqrt(cond_lens.g2_max);
+				T_r thick = atoms.z_max - atoms.z_min;
+				T_r f_e = cond_lens.c_10 - (cond_lens.zero_defocus_plane - atoms.z_min);
+				T_r r = alpha*(fabs(f_e) + thick) + fabs(cond_lens.c_30)*alpha*alpha*alpha + c_window_r_min;
+
+				T_r lx_w = (input_multislice->stem_window_lx > 0)?input_multislice->stem_window_lx:2*r;
+				T_r ly_w = (input_multislice->stem_window_ly > 0)?input_multislice->stem_window_ly:2*r;
+
+				// fft friendly sizes
+				Prime_Num pn;
+				nx_w = pn(static_cast<int64_t>(ceil(lx_w/grid_2d.dRx))-1, eDST_Greater_Than);
+				ny_w = pn(static_cast<int64_t>(ceil(ly_w/grid_2d.dRy))-1, eDST_Greater_Than);
+				nx_w = (nx_w < grid_2d.nx)?nx_w:grid_2d.nx;
+				ny_w = (ny_w < grid_2d.ny)?ny_w:grid_2d.ny;
+			}
+
+			// window centered at the beam: first pixel on the full grid and beam position inside the window
+			void set_window(const int &iscan, int &ix_0_o, int &iy_0_o)
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &grid_w = input_multislice_w.grid_2d;
+
+				T_r x = input_multislice->scanning.x[iscan];
+				T_r y = input_multislice->scanning.y[iscan];
+
+				// the real space grid is stored shifted by (lx, ly)/2
+				int ix_c = static_cast<int>(floor((x-grid_2d.lxh())/grid_2d.dRx+0.5));
+				int iy_c = static_cast<int>(floor((y-grid_2d.lyh())/grid_2d.dRy+0.5));
+				ix_0_o = ((ix_c - grid_w.nxh) % grid_2d.nx + grid_2d.nx) % grid_2d.nx;
+				iy_0_o = ((iy_c - grid_w.nyh) % grid_2d.ny + grid_2d.ny) % grid_2d.ny;
+
+				input_multislice_w.beam_x[0] = x - grid_2d.lxh() - ix_c*grid_2d.dRx;
+				input_multislice_w.beam_y[0] = y - grid_2d.lyh() - iy_c*grid_2d.dRy;
+			}
+
+			template <class TOutput_multislice>
+			void psi(const int &iscan_0, const int &iscan_e, const T_r &w_i, TOutput_multislice &output_multislice)
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &grid_w = input_multislice_w.grid_2d;
+				auto &wf = *wave_function;
+
+				for(auto iscan = iscan_0; iscan < iscan_e; iscan++)
+				{
+					int ig = iscan-iscan_0;
+					set_window(iscan, ix_0[ig], iy_0[ig]);
+					incident_wave(psi_w[ig], 0, 0, input_multislice_w.beam_x, input_multislice_w.beam_y, wf.slicing.z_m(0));
+				}
+
+				for(auto islice = 0; islice < wf.slicing.slice.size(); islice++)
+				{
+					// the transmission function is evaluated once for all the windows of the group
+					Vector<T_c, dev> *trans = &(wf.trans_0);
+					if(wf.is_trans_stored(islice))
+					{
+						trans = &(wf.trans_stored(islice));
+					}
+					else
+					{
+						wf.trans(islice, wf.trans_0);
+					}
+
+					int ithk = wf.slicing.slice[islice].ithk;
+					for(auto iscan = iscan_0; iscan < iscan_e; iscan++)
+					{
+						int ig = iscan-iscan_0;
+						mt::multiply_window(stream, grid_2d, grid_w, ix_0[ig], iy_0[ig], *trans, psi_w[ig]);
+
+						if(input_multislice->is_multislice())
+						{
+							propagator(eS_Real, 0, 0, wf.dz(islice), psi_w[ig]);
+						}
+
+						if(0 <= ithk)
+						{
+							set_image(iscan, ithk, w_i, psi_w[ig], output_multislice);
+						}
+					}
+				}
+			}
+
+			template <class TOutput_multislice>
+			void set_image(const int &iscan, const int &ithk, const T_r &w_i, Vector<T_c, dev> &psi_i, TOutput_multislice &output_multislice)
+			{
+				auto &grid_w = input_multislice_w.grid_2d;
+				auto &detector = input_multislice->detector;
+
+				propagator(eS_Reciprocal, 0, 0, wave_function->slicing.thick[ithk].z_back_prop, psi_i, psi_o);
+
+				for(auto iDet = 0; iDet < detector.size(); iDet++)
+				{
+					auto g_inner = detector.g_inner[iDet];
+					auto g_outer = detector.g_outer[iDet];
+					output_multislice.image_tot[ithk].image[iDet][iscan] += w_i*mt::sum_square_over_Det(stream, grid_w, g_inner, g_outer, psi_o);
+				}
+			}
+
+			Input_Multislice<T_r> *input_multislice;
+			Wave_Function<T_r, dev> *wave_function;
+
+			Input_Multislice<T_r> input_multislice_w; 			// input data on the window grid
+			int n_group; 										// probes per group
+
+			Stream<dev> stream;
+			FFT<T_r, dev> fft_w;
+
+			Incident_Wave<T_r, dev> incident_wave;
+			Propagator<T_r, dev> propagator;
+
+			std::vector<Vector<T_c, dev>> psi_w; 				// windows of the group
+			Vector<T_c, dev> psi_o;
+			std::vector<int> ix_0; 								// first pixel of the windows on the full grid
+			std::vector<int> iy_0;
+	};
+
+} // namespace mt
+
+#endif
@@ -50,27 +50,24 @@ namespace mt
 				Quadrature quadrature;
 				quadrature(0, c_nqz, qz); // 0: int_-1^1 y(x) dx - TanhSinh quadrature
 
+				// only the atomic types of the specimen are set
 				atom_type.resize(c_nAtomsTypes);
 				for(auto iatom_type = 0; iatom_type<atom_type.size(); iatom_type++)
 				{
+					if(Spec<T>::atom_type[iatom_type].coef.empty())
+					{
+						continue;
+					}
 					atom_type[iatom_type].assign(Spec<T>::atom_type[iatom_type]);
 				}
 
-				n_atoms_s = (device==e_host)?(stream->size()):512;
-
-				int nv = max(this->input_multislice->grid_2d.nx_dRx(this->atoms.l_x_int), this->input_multislice->grid_2d.ny_dRy(this->atoms.l_y_int));
+				n_atoms_s = (device==e_host)?4096:512;
 
-				stream_data.resize(n_atoms_s);
-
-				for(auto i = 0; i<stream_data.size(); i++)
+				if(this->input_multislice->is_subslicing())
 				{
-					if(device==e_host)
-					{
-						stream_data.iv[i].resize(nv);
-						stream_data.v[i].resize(nv);
-					}
+					stream_data.resize(n_atoms_s);
 
-					if(this->input_multislice->is_subslicing())
+					for(auto i = 0; i<stream_data.size(); i++)
 					{
 						stream_data.c0[i].resize(c_nR);
 						stream_data.c1[i].resize(c_nR);
@@ -90,37 +87,16 @@ namespace mt
 			enable_if_dev_host<devn, void>
 			operator()(const T &z_0, const T &z_e, const int &iatom_0, const int &iatom_e, Vector<T, dev> &V)
 			{
-				auto eval_cubic_poly = [](Stream<e_host> &stream, Grid_2d<T> &grid_2d, 
-				Vector<Atom_Vp<T>, e_host> &atom, Vector<T, dev> &M_o)
-				{
-					if(stream.n_act_stream<= 0)
-					{
-						return;
-					}
-
-					for(auto istream = 0; istream < stream.n_act_stream-1; istream++)
-					{
-						stream[istream] = std::thread(std::bind(host_detail::eval_cubic_poly<T>, std::ref(stream), std::ref(grid_2d), std::ref(atom[istream]), std::ref(M_o)));
-					}
-
-					host_detail::eval_cubic_poly<T>(stream, grid_2d, atom[stream.n_act_stream-1], M_o);
-
-					stream.synchronize();
-				};
-
 				mt::fill(*stream, V, T(0));
 
-				int iatoms = iatom_0;
-				while (iatoms <= iatom_e)
+				if(is_gather(iatom_e-iatom_0+1))
 				{
-					stream->set_n_act_stream(iatom_e-iatoms+1);
-					set_atom_Vp(z_0, z_e, iatoms, stream->n_act_stream, atom_Vp);
-					//get_cubic_poly_coef_Vz(*stream, atom_Vp);
-					eval_cubic_poly(*stream, this->input_multislice->grid_2d, atom_Vp, V);
-					iatoms += stream->n_act_stream;
+					eval_cubic_poly_gather(z_0, z_e, iatom_0, iatom_e, V);
+				}
+				else
+				{
+					eval_cubic_poly_scatter(z_0, z_e, iatom_0, iatom_e, V);
 				}
-
-				stream->synchronize();
 			}
 
 			/***********************Device***********************/
@@ -191,8 +167,148 @@ namespace mt
 			Vector<T, dev> V_0;
 			Stream<dev> *stream;
 		private:
+			static const int c_n_tile = 64; 					// gather tile size (pixels)
+			static const int c_n_atoms_tile = 4; 				// minimum mean number of atoms per tile for gather
+
 			int n_atoms_s;
 
+			// the gather engine pays off when the tiles are densely populated and keep every stream busy
+			bool is_gather(const int &n_atoms) const
+			{
+				if(this->input_multislice->is_potential_scatter())
+				{
+					return false;
+				}
+				else if(this->input_multislice->is_potential_gather())
+				{
+					return true;
+				}
+
+				auto &grid_2d = this->input_multislice->grid_2d;
+				const int n_tiles = ((grid_2d.nx+c_n_tile-1)/c_n_tile)*((grid_2d.ny+c_n_tile-1)/c_n_tile);
+
+				return (n_tiles >= 2*stream->size()) && (n_atoms >= c_n_atoms_tile*n_tiles);
+			}
+
+			// scatter: each stream owns a range of columns and adds every atom of the batch to it
+			void eval_cubic_poly_scatter(const T &z_0, const T &z_e, const int &iatom_0, const int &iatom_e, Vector<T, dev> &V)
+			{
+				auto &grid_2d = this->input_multislice->grid_2d;
+
+				int iatoms = iatom_0;
+				while (iatoms <= iatom_e)
+				{
+					int n_atoms = min(n_atoms_s, iatom_e-iatoms+1);
+					set_atom_Vp(z_0, z_e, iatoms, n_atoms, atom_Vp);
+					//get_cubic_poly_coef_Vz(*stream, atom_Vp);
+
+					auto thr_eval_cubic_poly = [&](const Range_2d &range)
+					{
+						for(auto iatom = 0; iatom < n_atoms; iatom++)
+						{
+							host_detail::eval_cubic_poly<T>(range, grid_2d, atom_Vp[iatom], V);
+						}
+					};
+
+					stream->set_n_act_stream(grid_2d.nx);
+					stream->set_grid(grid_2d.nx, grid_2d.ny);
+					stream->exec(thr_eval_cubic_poly);
+
+					iatoms += n_atoms;
+				}
+			}
+
+			// gather: the atoms of a batch are binned into the tiles touched by their (pbc) footprint, 
+			// then each tile pulls its own atoms
+			void eval_cubic_poly_gather(const T &z_0, const T &z_e, const int &iatom_0, const int &iatom_e, Vector<T, dev> &V)
+			{
+				auto &grid_2d = this->input_multislice->grid_2d;
+
+				const int ntx = (grid_2d.nx+c_n_tile-1)/c_n_tile;
+				const int nty = (grid_2d.ny+c_n_tile-1)/c_n_tile;
+
+				tile_atoms.resize(ntx*nty);
+				std::vector<bool> btx(ntx), bty(nty);
+
+				auto set_tiles_x = [&](const int &ix_0, const int &nx)
+				{
+					std::fill(btx.begin(), btx.end(), false);
+					for(auto ix = ix_0; ix < ix_0+nx; ix++)
+					{
+						btx[grid_2d.iRx_pbc(ix)/c_n_tile] = true;
+					}
+				};
+
+				auto set_tiles_y = [&](const int &iy_0, const int &ny)
+				{
+					std::fill(bty.begin(), bty.end(), false);
+					for(auto iy = iy_0; iy < iy_0+ny; iy++)
+					{
+						bty[grid_2d.iRy_pbc(iy)/c_n_tile] = true;
+					}
+				};
+
+				int iatoms = iatom_0;
+				while (iatoms <= iatom_e)
+				{
+					int n_atoms = min(n_atoms_s, iatom_e-iatoms+1);
+					set_atom_Vp(z_0, z_e, iatoms, n_atoms, atom_Vp);
+					//get_cubic_poly_coef_Vz(*stream, atom_Vp);
+
+					for(auto &atoms_t: tile_atoms)
+					{
+						atoms_t.clear();
+					}
+
+					for(auto iatom = 0; iatom < n_atoms; iatom++)
+					{
+						auto &atom = atom_Vp[iatom];
+						set_tiles_x(atom.ix_0, atom.nx);
+						set_tiles_y(atom.iy_0, atom.ny);
+
+						for(auto itx = 0; itx < ntx; itx++)
+						{
+							if(!btx[itx])
+							{
+								continue;
+							}
+
+							for(auto ity = 0; ity < nty; ity++)
+							{
+								if(bty[ity])
+								{
+									tile_atoms[itx*nty+ity].push_back(iatom);
+								}
+							}
+						}
+					}
+
+					auto thr_eval_cubic_poly = [&](const int &itile)
+					{
+						auto &atoms_t = tile_atoms[itile];
+						if(atoms_t.empty())
+						{
+							return;
+						}
+
+						const int ix_0 = (itile/nty)*c_n_tile;
+						const int iy_0 = (itile%nty)*c_n_tile;
+						Range_2d range(ix_0, min(ix_0+c_n_tile, grid_2d.nx), iy_0, min(iy_0+c_n_tile, grid_2d.ny));
+
+						for(auto iatom: atoms_t)
+						{
+							host_detail::eval_cubic_poly<T>(range, grid_2d, atom_Vp[iatom], V);
+						}
+					};
+
+					stream->set_n_act_stream(ntx*nty);
+					stream->set_grid(1, ntx*nty);
+					stream->exec_vector(thr_eval_cubic_poly);
+
+					iatoms += n_atoms;
+				}
+			}
+
 			struct Stream_Data
 			{
 				using value_type = T;
@@ -202,21 +318,17 @@ namespace mt
 
 				size_type size() const
 				{
-					return iv.size();
+					return c0.size();
 				}
 
 				void resize(const size_type &new_size)
 				{
-					iv.resize(new_size);
-					v.resize(new_size);
 					c0.resize(new_size);
 					c1.resize(new_size);
 					c2.resize(new_size);
 					c3.resize(new_size);
 				}
 
-				Vector<Vector<int, dev>, e_host> iv;
-				Vector<Vector<T, dev>, e_host> v;
 				Vector<Vector<T, dev>, e_host> c0; 		// zero coefficient
 				Vector<Vector<T, dev>, e_host> c1; 		// first coefficient
 				Vector<Vector<T, dev>, e_host> c2; 		// second coefficient
@@ -244,12 +356,6 @@ namespace mt
 					atom_Vp_h[istream].R2_tap = coef.R2_tap();
 					atom_Vp_h[istream].tap_cf = coef.tap_cf;
 
-					if(device==e_host)
-					{
-						atom_Vp_h[istream].iv = raw_pointer_cast(stream_data.iv[istream].data());
-						atom_Vp_h[istream].v = raw_pointer_cast(stream_data.v[istream].data());
-					}
-
 					if(this->input_multislice->is_subslicing())
 					{
 						atom_Vp_h[istream].z0h = 0.5*(z_0 - this->atoms.z[iatoms]); 
@@ -287,6 +393,7 @@ namespace mt
 			Vector<Atom_Type<T, dev>, e_host> atom_type; // Atom types
 
 			Stream_Data stream_data;
+			std::vector<std::vector<int>> tile_atoms;
 			Vector<Atom_Vp<T>, e_host> atom_Vp_h;
 			Vector<Atom_Vp<T>, dev> atom_Vp;
 	};
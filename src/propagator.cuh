@@ -19,11 +19,14 @@
 #ifndef PROPAGATOR_H
 #define PROPAGATOR_H
 
+#include <random>
+
 #include "math.cuh"
 #include "types.cuh"
 #include "traits.cuh"
 #include "stream.cuh"
 #include "fft.cuh"
+#include "slice_step.hpp"
 #include "input_multislice.cuh"
 #include "output_multislice.hpp"
 #include "cpu_fcns.hpp"
@@ -40,13 +43,30 @@ namespace mt
 
 			static const eDevice device = dev;
 
-			Propagator(): input_multislice(nullptr), stream(nullptr), fft_2d(nullptr){}
+			Propagator(): input_multislice(nullptr), stream(nullptr), fft_2d(nullptr), prop_tick(0){}
 
 			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Stream<dev> *stream_i, FFT<T_r, dev> *fft2_i)
 			{
 				input_multislice = input_multislice_i;
 				stream = stream_i;
 				fft_2d = fft2_i;
+
+				// the cache is allocated up front so that slice storage sees the remaining memory
+				auto nxy = input_multislice->grid_2d.nxy();
+				double free_memory = get_free_memory<dev>() - 10;
+				int n_prop = static_cast<int>(floor(c_prop_memory_fraction*max(0.0, free_memory)*1048576.0/(nxy*sizeof(T_c))));
+				n_prop = min(n_prop, input_multislice->system_conf.prop_cache);
+
+				prop_cache.resize(n_prop);
+				for(auto &prop_entry: prop_cache)
+				{
+					prop_entry.clear();
+					prop_entry.prop.resize(nxy);
+				}
+				prop_tick = 0;
+
+				set_fft_pruned();
+				set_slice_step();
 			}
 
 			void operator()(const eSpace &space_out, T_r gxu, T_r gyu, 
@@ -56,6 +76,15 @@ namespace mt
 				{
 					if(input_multislice->grid_2d.bwl)
 					{
+						if((space_out == eS_Real) && fft_pruned.is_pruned())
+						{
+							assign_pruned(psi_i, psi_o);
+							fft_pruned_forward(psi_o);
+							mt::bandwidth_limit(*stream, input_multislice->grid_2d, psi_o);
+							fft_pruned_inverse(psi_o);
+							return;
+						}
+
 						fft_2d->forward(psi_i, psi_o); 
 						mt::bandwidth_limit(*stream, input_multislice->grid_2d, psi_o);
 						
@@ -75,11 +104,33 @@ namespace mt
 				}
 				else
 				{
-					fft_2d->forward(psi_i, psi_o); 
+					// the spectrum is only needed on the band limited rows
+					bool pruned = (space_out == eS_Real) && fft_pruned.is_pruned();
+					if(pruned)
+					{
+						assign_pruned(psi_i, psi_o);
+						fft_pruned_forward(psi_o);
+					}
+					else
+					{
+						fft_2d->forward(psi_i, psi_o); 
+					}
 
-					mt::propagate(*stream, input_multislice->grid_2d, input_multislice->get_propagator_factor(z), gxu, gyu, psi_o, psi_o);
+					auto prop = get_prop(gxu, gyu, z);
+					if(prop != nullptr)
+					{
+						mt::multiply(*stream, *prop, psi_o);
+					}
+					else
+					{
+						mt::propagate(*stream, input_multislice->grid_2d, input_multislice->get_propagator_factor(z), gxu, gyu, psi_o, psi_o);
+					}
 
-					if(space_out == eS_Real)
+					if(pruned)
+					{
+						fft_pruned_inverse(psi_o);
+					}
+					else if(space_out == eS_Real)
 					{
 						fft_2d->inverse(psi_o, psi_o);
 					}
@@ -92,6 +143,23 @@ namespace mt
 				this->operator()(space_out, gxu, gyu, z, psi_io, psi_io);
 			}
 
+			// psi_io <- propagated trans*psi_io in real space
+			void transmit_propagate(Vector<T_c, dev> &trans, T_r gxu, T_r gyu, T_r z, Vector<T_c, dev> &psi_io)
+			{
+				if(is_slice_step() && nonZero(z))
+				{
+					auto prop = get_prop(gxu, gyu, z);
+					if(prop != nullptr)
+					{
+						slice_step_exec(trans, *prop, psi_io);
+						return;
+					}
+				}
+
+				mt::multiply(*stream, trans, psi_io);
+				this->operator()(eS_Real, gxu, gyu, z, psi_io);
+			}
+
 			template <class TOutput_multislice>
 			void operator()(const eSpace &space_out, T_r gxu, T_r gyu, 
 			T_r z, TOutput_multislice &output_multislice)
@@ -104,9 +172,220 @@ namespace mt
 			}
 
 		private:
+			static constexpr double c_prop_memory_fraction = 0.0625; 	// fraction of the free memory used by the cache
+			static constexpr double c_bwl_eps = 1e-7; 					// band limit factor taken as zero
+			static constexpr double c_pruned_tol = 1e-5; 				// relative error of the pruned transforms
+			static const int c_pruned_seed = 1983; 						// seed of the test wave
+
+			/************************Host************************/
+			/* FFTs that skip the rows outside the band limit. They are checked once against the
+			 * full transforms on a test wave and dropped if the relative error exceeds c_pruned_tol.
+			 */
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			set_fft_pruned()
+			{
+				fft_pruned.destroy_plan();
+
+				auto &grid_2d = input_multislice->grid_2d;
+				if(!input_multislice->bwl_pruned || !grid_2d.bwl)
+				{
+					return;
+				}
+
+				// bwl_factor < c_bwl_eps beyond the row ny_c
+				double g2_c = grid_2d.gl2_max + log(1.0/c_bwl_eps-1.0)/grid_2d.alpha;
+				int ny_c = static_cast<int>(ceil(sqrt(g2_c)/grid_2d.dgy));
+				if(!fft_pruned.create_plan_2d(grid_2d.ny, grid_2d.nx, ny_c, stream->size()))
+				{
+					return;
+				}
+
+				// test wave
+				auto nxy = grid_2d.nxy();
+				std::mt19937_64 gen(c_pruned_seed);
+				std::uniform_real_distribution<T_r> rand(-1, 1);
+				Vector<T_c, dev> psi_t(nxy);
+				for(auto ixy = 0; ixy < nxy; ixy++)
+				{
+					psi_t[ixy] = T_c(rand(gen), rand(gen));
+				}
+
+				Vector<T_c, dev> psi_f(psi_t);
+				Vector<T_c, dev> psi_p(psi_t);
+				auto w = input_multislice->get_propagator_factor(grid_2d.dz);
+
+				fft_2d->forward(psi_f);
+				mt::propagate(*stream, grid_2d, w, T_r(0), T_r(0), psi_f, psi_f);
+				fft_2d->inverse(psi_f);
+
+				fft_pruned.forward(psi_p);
+				mt::propagate(*stream, grid_2d, w, T_r(0), T_r(0), psi_p, psi_p);
+				fft_pruned.inverse(psi_p);
+
+				double ee = 0;
+				double sum = 0;
+				for(auto ixy = 0; ixy < nxy; ixy++)
+				{
+					ee += norm(psi_p[ixy]-psi_f[ixy]);
+					sum += norm(psi_f[ixy]);
+				}
+
+				if((sum > 0) && (sqrt(ee/sum) > c_pruned_tol))
+				{
+					fft_pruned.destroy_plan();
+				}
+			}
+
+			// the fused step needs the propagator kernels in memory
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			set_slice_step()
+			{
+				slice_step.destroy_plan();
+
+				if(input_multislice->system_conf.cpu_slice_fused && !prop_cache.empty())
+				{
+					slice_step.create_plan_2d(input_multislice->grid_2d.ny, input_multislice->grid_2d.nx, fft_pruned.get_ny_c());
+				}
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, bool>
+			is_slice_step() const
+			{
+				return slice_step.is_active();
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			slice_step_exec(Vector<T_c, dev> &trans, Vector<T_c, dev> &prop, Vector<T_c, dev> &psi_io)
+			{
+				slice_step(*stream, trans, prop, psi_io);
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			assign_pruned(Vector<T_c, dev> &psi_i, Vector<T_c, dev> &psi_o)
+			{
+				if(psi_i.data() != psi_o.data())
+				{
+					psi_o.assign(psi_i.begin(), psi_i.end());
+				}
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			fft_pruned_forward(Vector<T_c, dev> &psi_io)
+			{
+				fft_pruned.forward(psi_io);
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			fft_pruned_inverse(Vector<T_c, dev> &psi_io)
+			{
+				fft_pruned.inverse(psi_io);
+			}
+
+			/**********************Device**********************/
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			set_fft_pruned(){}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			set_slice_step(){}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, bool>
+			is_slice_step() const
+			{
+				return false;
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			slice_step_exec(Vector<T_c, dev> &trans, Vector<T_c, dev> &prop, Vector<T_c, dev> &psi_io){}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			assign_pruned(Vector<T_c, dev> &psi_i, Vector<T_c, dev> &psi_o){}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			fft_pruned_forward(Vector<T_c, dev> &psi_io){}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			fft_pruned_inverse(Vector<T_c, dev> &psi_io){}
+
+			struct Prop_Entry
+			{
+				T_r gxu;
+				T_r gyu;
+				T_r z;
+				unsigned long long tick; 							// last use, 0: empty
+				Vector<T_c, dev> prop;
+
+				void clear()
+				{
+					gxu = gyu = z = 0;
+					tick = 0;
+				}
+
+				bool is_empty() const
+				{
+					return tick == 0;
+				}
+
+				bool is_equal(const T_r &gxu_i, const T_r &gyu_i, const T_r &z_i) const
+				{
+					return !is_empty() && (gxu == gxu_i) && (gyu == gyu_i) && (z == z_i);
+				}
+			};
+
+			// returns the cached propagator for (gxu, gyu, z), the least recently used entry is rebuilt on a miss
+			Vector<T_c, dev>* get_prop(const T_r &gxu, const T_r &gyu, const T_r &z)
+			{
+				if(prop_cache.empty())
+				{
+					return nullptr;
+				}
+
+				auto it_lru = prop_cache.begin();
+				for(auto it = prop_cache.begin(); it != prop_cache.end(); it++)
+				{
+					if(it->is_equal(gxu, gyu, z))
+					{
+						it->tick = ++prop_tick;
+						return &(it->prop);
+					}
+
+					if(it->tick < it_lru->tick)
+					{
+						it_lru = it;
+					}
+				}
+
+				it_lru->gxu = gxu;
+				it_lru->gyu = gyu;
+				it_lru->z = z;
+				it_lru->tick = ++prop_tick;
+				mt::propagator_kernel(*stream, input_multislice->grid_2d, input_multislice->get_propagator_factor(z), gxu, gyu, it_lru->prop);
+
+				return &(it_lru->prop);
+			}
+
 			Input_Multislice<T_r> *input_multislice;
 			Stream<dev> *stream;
 			FFT<T_r, dev> *fft_2d;
+
+			std::vector<Prop_Entry> prop_cache;
+			unsigned long long prop_tick;
+
+			FFT_Pruned<T_r> fft_pruned; 						// host transforms on the band limited rows
+			Slice_Step<T_r> slice_step; 						// host multislice step fused with the 1d passes of the fft
 	};
 
 } // namespace mt
@@ -0,0 +1,322 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef SLICE_SCRATCH_H
+#define SLICE_SCRATCH_H
+
+#ifdef _WIN32
+	#include <Windows.h>
+#else
+	#include <sys/types.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "math.cuh"
+#include "types.cuh"
+
+namespace mt
+{
+	/* Out-of-core storage of the transmission functions: the slices that do not fit in memory are
+	 * written once per configuration to a memory mapped scratch file. The file is deleted when it is
+	 * closed (or when the process ends). Reading slice islice asks a prefetcher thread to fault in
+	 * slices islice+1..islice+n_prefetch, wrapping around to the first slices for the next probe,
+	 * while slice islice is propagated.
+	 */
+	template <class T>
+	class Slice_Scratch
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+
+			Slice_Scratch(): n_slice(0), nxy(0), n_prefetch(0), data(nullptr), size_b(0),
+			islice_req(-1), b_stop(false)
+			{
+#ifdef _WIN32
+				h_file = INVALID_HANDLE_VALUE;
+				h_map = NULL;
+#else
+				fd = -1;
+#endif
+			}
+
+			~Slice_Scratch()
+			{
+				close();
+			}
+
+			Slice_Scratch(const Slice_Scratch&) = delete;
+			Slice_Scratch& operator=(const Slice_Scratch&) = delete;
+
+			// it returns false when the file can not be created or mapped
+			bool open(const std::string &dir, const int &n_slice_i, const int &nxy_i, const int &n_prefetch_i)
+			{
+				close();
+
+				if(dir.empty() || (n_slice_i < 1) || (nxy_i < 1))
+				{
+					return false;
+				}
+
+				n_slice = n_slice_i;
+				nxy = nxy_i;
+				n_prefetch = max(0, min(n_prefetch_i, n_slice-1));
+				size_b = static_cast<uint64_t>(n_slice)*nxy*sizeof(T_c);
+
+				if(!map_file(get_fn(dir)))
+				{
+					unmap_file();
+					n_slice = nxy = n_prefetch = 0;
+					size_b = 0;
+					return false;
+				}
+
+				if(n_prefetch > 0)
+				{
+					b_stop = false;
+					islice_req = -1;
+					prefetcher = std::thread(&Slice_Scratch::prefetch, this);
+				}
+
+				return true;
+			}
+
+			void close()
+			{
+				if(prefetcher.joinable())
+				{
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						b_stop = true;
+					}
+					cv.notify_all();
+					prefetcher.join();
+				}
+
+				unmap_file();
+				n_slice = nxy = n_prefetch = 0;
+				size_b = 0;
+			}
+
+			bool is_open() const
+			{
+				return data != nullptr;
+			}
+
+			int size() const
+			{
+				return n_slice;
+			}
+
+			void write(const int &islice, const T_c *trans)
+			{
+				std::memcpy(slice_ptr(islice), trans, nxy*sizeof(T_c));
+			}
+
+			void read(const int &islice, T_c *trans)
+			{
+				if(n_prefetch > 0)
+				{
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						islice_req = islice;
+					}
+					cv.notify_one();
+				}
+
+				std::memcpy(trans, slice_ptr(islice), nxy*sizeof(T_c));
+			}
+
+		private:
+			static const int c_page_size = 4096;
+
+			char* slice_ptr(const int &islice) const
+			{
+				return data + static_cast<uint64_t>(islice)*nxy*sizeof(T_c);
+			}
+
+			std::string get_fn(const std::string &dir) const
+			{
+				std::random_device rd;
+				char name[64];
+				std::snprintf(name, sizeof(name), "multem_slices_%08x%08x.bin", rd(), rd());
+
+				auto sep = ((dir.back() == '/') || (dir.back() == '\\'))?"":"/";
+				return dir + sep + name;
+			}
+
+			// the prefetcher touches one byte per page of the slices ahead of the last one read
+			void prefetch()
+			{
+				int islice_done = -1;
+				while(true)
+				{
+					int islice_0;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						cv.wait(lock, [&](){ return b_stop || (islice_req != islice_done); });
+						if(b_stop)
+						{
+							return;
+						}
+						islice_0 = islice_done = islice_req;
+					}
+
+					for(auto ik = 1; ik <= n_prefetch; ik++)
+					{
+						auto p = slice_ptr((islice_0 + ik) % n_slice);
+						uint64_t nb = static_cast<uint64_t>(nxy)*sizeof(T_c);
+#ifndef _WIN32
+						madvise(p - (reinterpret_cast<uintptr_t>(p) % c_page_size), nb + (reinterpret_cast<uintptr_t>(p) % c_page_size), MADV_WILLNEED);
+#endif
+						volatile char sum = 0;
+						for(uint64_t ib = 0; ib < nb; ib += c_page_size)
+						{
+							sum += p[ib];
+						}
+
+						// a newer request restarts the read ahead from it
+						std::lock_guard<std::mutex> lock(mutex);
+						if(b_stop || (islice_req != islice_0))
+						{
+							break;
+						}
+					}
+				}
+			}
+
+#ifdef _WIN32
+			bool map_file(const std::string &fn)
+			{
+				h_file = CreateFileA(fn.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+				FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+				if(h_file == INVALID_HANDLE_VALUE)
+				{
+					return false;
+				}
+
+				LARGE_INTEGER size;
+				size.QuadPart = static_cast<LONGLONG>(size_b);
+				h_map = CreateFileMappingA(h_file, NULL, PAGE_READWRITE, size.HighPart, size.LowPart, NULL);
+				if(h_map == NULL)
+				{
+					return false;
+				}
+
+				data = static_cast<char*>(MapViewOfFile(h_map, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+
+				return data != nullptr;
+			}
+
+			void unmap_file()
+			{
+				if(data != nullptr)
+				{
+					UnmapViewOfFile(data);
+					data = nullptr;
+				}
+				if(h_map != NULL)
+				{
+					CloseHandle(h_map);
+					h_map = NULL;
+				}
+				if(h_file != INVALID_HANDLE_VALUE)
+				{
+					CloseHandle(h_file);
+					h_file = INVALID_HANDLE_VALUE;
+				}
+			}
+
+			HANDLE h_file;
+			HANDLE h_map;
+#else
+			bool map_file(const std::string &fn)
+			{
+				fd = ::open(fn.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+				if(fd < 0)
+				{
+					return false;
+				}
+
+				// the file is removed from the directory now, its space is released when it is unmapped
+				unlink(fn.c_str());
+
+				// the disk space is reserved, a full disk fails here and not on a page fault
+#ifdef __APPLE__
+				if(ftruncate(fd, static_cast<off_t>(size_b)) != 0)
+#else
+				if(posix_fallocate(fd, 0, static_cast<off_t>(size_b)) != 0)
+#endif
+				{
+					return false;
+				}
+
+				void *p = mmap(nullptr, size_b, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if(p == MAP_FAILED)
+				{
+					return false;
+				}
+				data = static_cast<char*>(p);
+
+				return true;
+			}
+
+			void unmap_file()
+			{
+				if(data != nullptr)
+				{
+					munmap(data, size_b);
+					data = nullptr;
+				}
+				if(fd >= 0)
+				{
+					::close(fd);
+					fd = -1;
+				}
+			}
+
+			int fd;
+#endif
+
+			int n_slice; 							// slices in the file
+			int nxy; 								// pixels of a slice
+			int n_prefetch; 						// slices read ahead
+			char *data; 							// mapped file
+			uint64_t size_b; 						// size of the file (bytes)
+
+			std::thread prefetcher;
+			std::mutex mutex;
+			std::condition_variable cv;
+			int islice_req; 						// last slice read
+			bool b_stop;
+	};
+
+} // namespace mt
+
+#endif
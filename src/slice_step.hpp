@@ -0,0 +1,220 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef SLICE_STEP_H
+#define SLICE_STEP_H
+
+#include <vector>
+#include <algorithm>
+
+#include "math.cuh"
+#include "types.cuh"
+#include "stream.cuh"
+#include "fft.cuh"
+
+namespace mt
+{
+	/* Multislice step on the host, psi <- IFFT(prop*FFT(trans*psi)), in three passes over the wave.
+	 * The 2d transforms are split into 1d transforms and the products are applied to each block of
+	 * the wave while it is in cache:
+	 *	- columns: transmission and forward transform along y
+	 *	- rows: forward transform along x, propagator and inverse transform along x
+	 *	- columns: inverse transform along y
+	 * The propagator holds the 1/nxy factor and the band limit. With ny_c > 0 the row pass only runs
+	 * on the rows |ky| <= ny_c and the rest are set to zero, as in FFT_Pruned.
+	 */
+	template <class T>
+	class Slice_Step
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+			using TPlan = typename FFTW_Api<T>::TPlan;
+			using TComplex = typename FFTW_Api<T>::TComplex;
+			using TVector_c = Vector<T_c, e_host>;
+
+			Slice_Step(): nx(0), ny(0), ny_c(0){}
+
+			void destroy_plan()
+			{
+				nx = ny = ny_c = 0;
+				col_block.clear();
+				row_block.clear();
+			}
+
+			// ny_c = 0: all the rows go through the row pass
+			void create_plan_2d(const int &ny_i, const int &nx_i, const int &ny_c_i)
+			{
+				destroy_plan();
+
+				nx = nx_i;
+				ny = ny_i;
+				ny_c = ((ny_c_i > 0) && (2*ny_c_i+1 < ny))?ny_c_i:0;
+
+				int n_col = max(1, static_cast<int>(c_block_size/(ny*sizeof(T_c))));
+				for(auto ix_0 = 0; ix_0 < nx; ix_0 += n_col)
+				{
+					col_block.push_back(get_col_block(ix_0, min(n_col, nx-ix_0)));
+				}
+
+				int n_row = max(1, static_cast<int>(c_block_size/(nx*sizeof(T_c))));
+				if(ny_c > 0)
+				{
+					set_row_blocks(0, ny_c+1, n_row);
+					set_row_blocks(ny-ny_c, ny, n_row);
+				}
+				else
+				{
+					set_row_blocks(0, ny, n_row);
+				}
+			}
+
+			bool is_active() const
+			{
+				return nx > 0;
+			}
+
+			void operator()(Stream<e_host> &stream, TVector_c &trans, TVector_c &prop, TVector_c &psi_io)
+			{
+				auto V_io = reinterpret_cast<TComplex*>(psi_io.data());
+
+				auto thr_col_forward = [&](const Block &block)
+				{
+					const int ixy_0 = block.i_0*ny;
+					const int ixy_e = ixy_0 + block.n*ny;
+					for(auto ixy = ixy_0; ixy < ixy_e; ixy++)
+					{
+						psi_io[ixy] *= trans[ixy];
+					}
+					FFTW_Api<T>::execute_dft(block.plan_forward, V_io + ixy_0);
+				};
+
+				exec_block(stream, col_block, thr_col_forward);
+
+				auto thr_row = [&](const Block &block)
+				{
+					FFTW_Api<T>::execute_dft(block.plan_forward, V_io + block.i_0);
+					for(auto ix = 0; ix < nx; ix++)
+					{
+						const int ixy_0 = ix*ny + block.i_0;
+						for(auto ixy = ixy_0; ixy < ixy_0 + block.n; ixy++)
+						{
+							psi_io[ixy] *= prop[ixy];
+						}
+					}
+					FFTW_Api<T>::execute_dft(block.plan_backward, V_io + block.i_0);
+				};
+
+				exec_block(stream, row_block, thr_row);
+
+				auto thr_col_inverse = [&](const Block &block)
+				{
+					if(ny_c > 0)
+					{
+						for(auto ix = block.i_0; ix < block.i_0 + block.n; ix++)
+						{
+							auto it = psi_io.begin() + ix*ny;
+							std::fill(it + (ny_c+1), it + (ny-ny_c), T_c(0));
+						}
+					}
+					FFTW_Api<T>::execute_dft(block.plan_backward, V_io + block.i_0*ny);
+				};
+
+				exec_block(stream, col_block, thr_col_inverse);
+			}
+
+		private:
+			static const std::size_t c_block_size = 262144; 		// size of a block (bytes), it stays in the L2 cache
+
+			// n columns or rows starting at i_0, with single thread plans
+			struct Block
+			{
+				int i_0;
+				int n;
+				TPlan plan_forward;
+				TPlan plan_backward;
+			};
+
+			Block get_col_block(const int &ix_0, const int &n)
+			{
+				Block block{ix_0, n, nullptr, nullptr};
+
+				auto create = [&](const unsigned &rigor, TPlan &plan_f, TPlan &plan_b)
+				{
+					TVector_c M(n*ny);
+					auto V = reinterpret_cast<TComplex*>(M.data());
+
+					plan_f = FFTW_Api<T>::plan_many_dft(ny, n, V, 1, ny, FFTW_FORWARD, rigor | FFTW_UNALIGNED);
+					plan_b = FFTW_Api<T>::plan_many_dft(ny, n, V, 1, ny, FFTW_BACKWARD, rigor | FFTW_UNALIGNED);
+				};
+				FFTW_Plan_Registry<T>::instance().get(eFFTW_1d_batch_unaligned, n, ny, 1, 1, create, block.plan_forward, block.plan_backward);
+
+				return block;
+			}
+
+			// rows [iy_0, iy_e) in blocks of n_row rows: same plans as the x pass of FFT_Pruned
+			void set_row_blocks(const int &iy_0, const int &iy_e, const int &n_row)
+			{
+				for(auto iy = iy_0; iy < iy_e; iy += n_row)
+				{
+					int n = min(n_row, iy_e-iy);
+					Block block{iy, n, nullptr, nullptr};
+
+					auto create = [&](const unsigned &rigor, TPlan &plan_f, TPlan &plan_b)
+					{
+						TVector_c M(nx*ny);
+						auto V = reinterpret_cast<TComplex*>(M.data());
+
+						plan_f = FFTW_Api<T>::plan_many_dft(nx, n, V, ny, 1, FFTW_FORWARD, rigor | FFTW_UNALIGNED);
+						plan_b = FFTW_Api<T>::plan_many_dft(nx, n, V, ny, 1, FFTW_BACKWARD, rigor | FFTW_UNALIGNED);
+					};
+					FFTW_Plan_Registry<T>::instance().get(eFFTW_1d_stride_unaligned, nx, ny, n, 1, create, block.plan_forward, block.plan_backward);
+
+					row_block.push_back(block);
+				}
+			}
+
+			// the blocks are dealt out to the threads of the stream
+			template <class TFn>
+			void exec_block(Stream<e_host> &stream, std::vector<Block> &block, TFn &fn)
+			{
+				stream.set_n_act_stream(block.size());
+				const int n_act_stream = stream.n_act_stream;
+
+				auto thr_block = [&](const int &istream)
+				{
+					for(auto ib = istream; ib < block.size(); ib += n_act_stream)
+					{
+						fn(block[ib]);
+					}
+				};
+
+				stream.exec_istream(thr_block);
+			}
+
+			int nx;
+			int ny;
+			int ny_c; 								// last row of the band limited spectrum, 0: all the rows
+
+			std::vector<Block> col_block;
+			std::vector<Block> row_block;
+	};
+
+} // namespace mt
+
+#endif
@@ -99,6 +99,45 @@ namespace mt
 				slice = get_slicing(m_input_multislice, m_z_slice, thick, *m_atoms);
 			}
 
+			// slice boundaries set by the planes of the undisplaced specimen: they do not move with the atoms
+			bool is_slice_fixed()
+			{
+				auto pot_sli = m_input_multislice->potential_slicing;
+				return m_input_multislice->is_multislice() && (z_plane.size() > 1) && ((pot_sli == ePS_Planes) || (pot_sli == ePS_dz_Proj));
+			}
+
+			// slice of z: -1 before the first slice and slice.size() after the last one
+			int islice_by_z(const T &z) const
+			{
+				const int nslice = m_z_slice.size()-1;
+				if(z < m_z_slice[0])
+				{
+					return -1;
+				}
+				else if(m_z_slice[nslice] < z)
+				{
+					return nslice;
+				}
+
+				int islice = static_cast<int>(std::upper_bound(m_z_slice.begin(), m_z_slice.end(), z) - m_z_slice.begin()) - 1;
+				return min(islice, nslice-1);
+			}
+
+			// atoms sorted by slice: the atoms of the slice islice are [iatom_s[islice+1], iatom_s[islice+2])
+			void set_slice_atoms(TVector_i &iatom_s)
+			{
+				for(auto islice = 0; islice < slice.size(); islice++)
+				{
+					slice[islice].iatom_0 = iatom_s[islice+1];
+					slice[islice].iatom_e = iatom_s[islice+2]-1;
+					if(slice[islice].iatom_e < slice[islice].iatom_0)
+					{
+						slice[islice].iatom_0 = 1;
+						slice[islice].iatom_e = 0;
+					}
+				}
+			}
+
 			TVector_r z_plane;
 			Vector<Slice<T>, e_host> slice;
 			Vector<Thick<T>, e_host> thick;
@@ -19,12 +19,16 @@
 #ifndef SPECIMEN_H
 #define SPECIMEN_H
 
+#include <vector>
+#include <memory>
+
 #include "math.cuh"
 #include "types.cuh"
 #include "lin_alg_def.cuh"
 #include "cgpu_rand.cuh"
 #include "atomic_data.hpp"
 #include "atomic_data_mt.hpp"
+#include "atom_type_cache.hpp"
 #include "input_multislice.cuh"
 #include "cgpu_fcns.cuh"
 #include "cpu_fcns.hpp"
@@ -39,20 +43,16 @@ namespace mt
 			using T_r = T;
 			using size_type = std::size_t;
 
-			Spec(): input_multislice(nullptr){}
+			Spec(): input_multislice(nullptr), b_slice_fixed(false){}
 
 			void set_input_data(Input_Multislice<T> *input_multislice_i)
 			{
 				input_multislice = input_multislice_i;
 
-				/***************************************************************************/
-				Atomic_Data atomic_data(input_multislice->potential_type);
+				stream.resize(input_multislice->system_conf.cpu_nthread);
 
-				atom_type.resize(c_nAtomsTypes); 
-				for(auto i = 0; i<atom_type.size(); i++)
-				{
-					atomic_data.To_atom_type_CPU(i+1, input_multislice->Vrl, input_multislice->nR, input_multislice->grid_2d.dR_min(), atom_type[i]);
-				}
+				/***************************************************************************/
+				set_atom_type();
 
 				/***************************************************************************/
 				atoms_u.set_atoms(input_multislice->atoms, input_multislice->grid_2d.pbc_xy, &atom_type);
@@ -79,40 +79,59 @@ namespace mt
 				atoms.set_atoms(atoms_u, false, &atom_type);
 				// This is needed for memory preallocation in Transmission function
 				slicing.calculate();
+
+				// the displaced atoms are assigned to the slices of the undisplaced specimen
+				b_slice_fixed = input_multislice->is_frozen_phonon() && slicing.is_slice_fixed();
 			}
 
-			/* Move atoms (cgpu_rand distribution will be included in the future) */
+			/* Move atoms: the displacements are counter-based random numbers of (pn_seed, iconf, atom),
+			 * so the atoms are moved concurrently and the configuration does not depend on the number of threads
+			 */
 			void move_atoms(const int &fp_iconf)
 			{
 				// set phonon configuration
-				if(input_multislice->is_frozen_phonon())
+				bool bb_fp = input_multislice->is_frozen_phonon();
+				if(bb_fp)
 				{
 					rand.seed(input_multislice->pn_seed, fp_iconf);
 					rand.set_activation(input_multislice->pn_dim.x, input_multislice->pn_dim.y, input_multislice->pn_dim.z);
 				}
 
-				// move atoms
-				for(int iatoms = 0; iatoms<atoms_u.size(); iatoms++)
+				if(b_slice_fixed)
 				{
-					atoms.Z[iatoms] = atoms_u.Z[iatoms];
-					auto r = atoms_u.to_r3d(iatoms);
+					move_atoms_by_slice();
+					return;
+				}
 
-					if(input_multislice->is_frozen_phonon())
+				// move atoms
+				auto thr_move_atoms = [&](const Range_2d &range)
+				{
+					for(auto iatoms = range.ixy_0; iatoms < range.ixy_e; iatoms++)
 					{
-						auto sigma_x = atoms_u.sigma[iatoms];
-						auto sigma_y = atoms_u.sigma[iatoms];
-						auto sigma_z = atoms_u.sigma[iatoms];
-						r += rand(sigma_x, sigma_y, sigma_z);
+						atoms.Z[iatoms] = atoms_u.Z[iatoms];
+						auto r = atoms_u.to_r3d(iatoms);
+
+						if(bb_fp)
+						{
+							auto sigma_x = atoms_u.sigma[iatoms];
+							auto sigma_y = atoms_u.sigma[iatoms];
+							auto sigma_z = atoms_u.sigma[iatoms];
+							r += rand(iatoms, sigma_x, sigma_y, sigma_z);
+						}
+
+						atoms.x[iatoms] = r.x;
+						atoms.y[iatoms] = r.y;
+						atoms.z[iatoms] = r.z;
+						atoms.sigma[iatoms] = atoms_u.sigma[iatoms];
+						atoms.occ[iatoms] = atoms_u.occ[iatoms];
+						atoms.region[iatoms] = atoms_u.region[iatoms];
+						atoms.charge[iatoms] = atoms_u.charge[iatoms];
 					}
+				};
 
-					atoms.x[iatoms] = r.x;
-					atoms.y[iatoms] = r.y;
-					atoms.z[iatoms] = r.z;
-					atoms.sigma[iatoms] = atoms_u.sigma[iatoms];
-					atoms.occ[iatoms] = atoms_u.occ[iatoms];
-					atoms.region[iatoms] = atoms_u.region[iatoms];
-					atoms.charge[iatoms] = atoms_u.charge[iatoms];
-				}
+				stream.set_n_act_stream(atoms_u.size());
+				stream.set_grid(atoms_u.size(), 1);
+				stream.exec(thr_move_atoms);
 
 				if(input_multislice->pn_dim.z)
 				{
@@ -142,8 +161,134 @@ namespace mt
 			Slicing<T> slicing; 								// slicing procedure
 			Vector<Atom_Type<T, e_host>, e_host> atom_type;		// Atom types
 		private:
-			Randn_3d<T, e_host> rand;
+			/* only the atomic types of the specimen are evaluated, the other ones are left empty. The tables
+			 * are read from the cache directory when available and written to it otherwise
+			 */
+			void set_atom_type()
+			{
+				auto &atoms_i = input_multislice->atoms;
+
+				std::vector<bool> bb_Z(c_nAtomsTypes, false);
+				for(auto iatoms = 0; iatoms < atoms_i.size(); iatoms++)
+				{
+					auto Z = atoms_i.get_Z(atoms_i.Z[iatoms]);
+					if((0 < Z) && (Z <= c_nAtomsTypes))
+					{
+						bb_Z[Z-1] = true;
+					}
+				}
+
+				Atom_Type_Cache<T> cache;
+				cache.set_input_data(input_multislice->system_conf.cache_dir, input_multislice->potential_type, 
+					input_multislice->Vrl, input_multislice->nR, input_multislice->grid_2d.dR_min());
+
+				std::unique_ptr<Atomic_Data> atomic_data;
+
+				atom_type.clear();
+				atom_type.resize(c_nAtomsTypes); 
+				for(auto i = 0; i<atom_type.size(); i++)
+				{
+					if(!bb_Z[i] || cache.read(i+1, atom_type[i]))
+					{
+						continue;
+					}
+
+					if(!atomic_data)
+					{
+						atomic_data.reset(new Atomic_Data(input_multislice->potential_type));
+					}
+
+					atomic_data->To_atom_type_CPU(i+1, input_multislice->Vrl, input_multislice->nR, input_multislice->grid_2d.dR_min(), atom_type[i]);
+					cache.write(i+1, atom_type[i]);
+				}
+			}
+
+			/* fixed slice boundaries: the atoms are sorted by slice with a stable counting sort, so the atoms
+			 * of a slice keep the order of the undisplaced specimen and only the atoms whose displaced z crosses
+			 * a boundary change slice. The atom types are not changed by the displacements: the statistic of
+			 * the undisplaced specimen is kept
+			 */
+			void move_atoms_by_slice()
+			{
+				auto displaced = [&](const int &iatoms)->r3d<T>
+				{
+					auto sigma = atoms_u.sigma[iatoms];
+					return atoms_u.to_r3d(iatoms) + rand(iatoms, sigma, sigma, sigma);
+				};
+
+				const int n_atoms = atoms_u.size();
+				const int n_key = slicing.slice.size()+2;
+
+				stream.set_n_act_stream(n_atoms);
+				stream.set_grid(n_atoms, 1);
+				const int n_act_stream = stream.n_act_stream;
+
+				atom_key.resize(n_atoms);
+				key_pos.assign(n_act_stream*n_key, 0);
+
+				// slice of the displaced atoms and number of atoms per slice and stream
+				auto thr_key = [&](const int &istream)
+				{
+					auto range = stream.get_range(istream);
+					int *count = key_pos.data() + istream*n_key;
+					for(auto iatoms = range.ixy_0; iatoms < range.ixy_e; iatoms++)
+					{
+						int key = slicing.islice_by_z(displaced(iatoms).z) + 1;
+						atom_key[iatoms] = key;
+						count[key]++;
+					}
+				};
+
+				stream.exec_istream(thr_key);
+
+				// first position of each slice and stream
+				key_offset.resize(n_key+1);
+				int ia = 0;
+				for(auto key = 0; key < n_key; key++)
+				{
+					key_offset[key] = ia;
+					for(auto istream = 0; istream < n_act_stream; istream++)
+					{
+						auto count = key_pos[istream*n_key+key];
+						key_pos[istream*n_key+key] = ia;
+						ia += count;
+					}
+				}
+				key_offset[n_key] = ia;
+
+				auto thr_move_atoms = [&](const int &istream)
+				{
+					auto range = stream.get_range(istream);
+					int *pos = key_pos.data() + istream*n_key;
+					for(auto iatoms = range.ixy_0; iatoms < range.ixy_e; iatoms++)
+					{
+						auto ia = pos[atom_key[iatoms]]++;
+						auto r = displaced(iatoms);
+
+						atoms.Z[ia] = atoms_u.Z[iatoms];
+						atoms.x[ia] = r.x;
+						atoms.y[ia] = r.y;
+						atoms.z[ia] = r.z;
+						atoms.sigma[ia] = atoms_u.sigma[iatoms];
+						atoms.occ[ia] = atoms_u.occ[iatoms];
+						atoms.region[ia] = atoms_u.region[iatoms];
+						atoms.charge[ia] = atoms_u.charge[iatoms];
+					}
+				};
+
+				stream.exec_istream(thr_move_atoms);
+
+				slicing.set_slice_atoms(key_offset);
+			}
+
+			Philox_Randn_3d<T> rand;
 			Atom_Data<T> atoms_u;
+			Stream<e_host> stream;
+
+			bool b_slice_fixed; 								// slice boundaries independent of the displacements
+			std::vector<int> atom_key; 							// slice of the displaced atoms (+1)
+			std::vector<int> key_pos; 							// position of the next atom of each slice and stream
+			Vector<int, e_host> key_offset; 					// first atom of each slice (+1)
 	};
 
 } // namespace mt
@@ -0,0 +1,829 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef STEM_4D_H
+#define STEM_4D_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "math.cuh"
+#include "types.cuh"
+#include "traits.cuh"
+#include "stream.cuh"
+#include "input_multislice.cuh"
+
+namespace mt
+{
+	/********************************float16**********************************/
+	// round to nearest even, overflow goes to inf
+	inline uint16_t float_2_half(const float &x)
+	{
+		uint32_t u;
+		std::memcpy(&u, &x, sizeof(u));
+
+		const uint32_t sign = (u >> 16) & 0x8000;
+		const uint32_t e_f = (u >> 23) & 0xff;
+		const int e = static_cast<int>(e_f) - 127 + 15;
+		uint32_t m = u & 0x7fffff;
+
+		if(e_f == 0xff)
+		{
+			return static_cast<uint16_t>(sign | 0x7c00 | ((m != 0) ? 0x200 : 0));
+		}
+
+		if(e >= 31)
+		{
+			return static_cast<uint16_t>(sign | 0x7c00);
+		}
+
+		if(e <= 0)
+		{
+			if(e < -10)
+			{
+				return static_cast<uint16_t>(sign);
+			}
+
+			m |= 0x800000;
+			const int shift = 14 - e;
+			uint32_t h = m >> shift;
+			const uint32_t rem = m & ((1u << shift) - 1);
+			const uint32_t half_way = 1u << (shift - 1);
+			if((rem > half_way) || ((rem == half_way) && (h & 1)))
+			{
+				h++;
+			}
+			return static_cast<uint16_t>(sign | h);
+		}
+
+		uint32_t h = (static_cast<uint32_t>(e) << 10) | (m >> 13);
+		const uint32_t rem = m & 0x1fff;
+		if((rem > 0x1000) || ((rem == 0x1000) && (h & 1)))
+		{
+			h++;
+		}
+		return static_cast<uint16_t>(sign | h);
+	}
+
+	inline float half_2_float(const uint16_t &h)
+	{
+		const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		const uint32_t e = (h >> 10) & 0x1f;
+		const uint32_t m = h & 0x3ff;
+
+		if(e == 0)
+		{
+			const float x = std::ldexp(static_cast<float>(m), -24);
+			return (sign) ? -x : x;
+		}
+
+		const uint32_t u = (e == 31) ? (sign | 0x7f800000 | (m << 13)) : (sign | ((e - 15 + 127) << 23) | (m << 13));
+		float x;
+		std::memcpy(&x, &u, sizeof(x));
+		return x;
+	}
+
+	/*********************************header***********************************/
+	/* A fixed header followed by the diffraction patterns of all the scanning positions and
+	 * thicknesses, data(ky, kx, iscan, ithk) in column-major order starting at data_offset, so
+	 * the data block can be memory mapped. The patterns are centered at g = 0.
+	 */
+	struct STEM_4D_Header
+	{
+		static const int c_version = 1;
+		static const int c_align = 4096; 			// alignment of the data block (bytes)
+
+		int dtype; 						// 1: float32, 2: float16
+		int nkx; 						// pattern size in x
+		int nky; 						// pattern size in y
+		int nsx; 						// scanning positions in x
+		int nsy; 						// scanning positions in y
+		int nthk; 						// number of thicknesses
+		int n_chunk; 					// scanning positions per chunk
+		int bin; 						// binning factor
+		double E_0; 					// acceleration voltage (keV)
+		double gx_0; 					// gx of the first pixel (Angs^-1)
+		double gy_0; 					// gy of the first pixel (Angs^-1)
+		double dgx; 					// pixel size in x (Angs^-1)
+		double dgy; 					// pixel size in y (Angs^-1)
+		double g_max; 					// cropping radius (Angs^-1)
+		int64_t data_offset; 			// first byte of the patterns
+		std::vector<double> thick; 		// thicknesses (Angs)
+
+		STEM_4D_Header(): dtype(1), nkx(0), nky(0), nsx(0), nsy(0), nthk(0), n_chunk(1), bin(1),
+			E_0(0), gx_0(0), gy_0(0), dgx(0), dgy(0), g_max(0), data_offset(0) {}
+
+		int npix() const { return nkx*nky; }
+
+		int ns() const { return nsx*nsy; }
+
+		int n_chunk_thk() const { return (ns()+n_chunk-1)/n_chunk; }
+
+		int value_size() const { return (dtype == 2) ? sizeof(uint16_t) : sizeof(float); }
+
+		int64_t pattern_bytes() const { return static_cast<int64_t>(npix())*value_size(); }
+
+		int64_t offset(const int &ithk, const int &iscan) const
+		{
+			return data_offset + (static_cast<int64_t>(ithk)*ns() + iscan)*pattern_bytes();
+		}
+
+		int64_t file_size() const
+		{
+			return offset(nthk, 0);
+		}
+
+		double gx(const int &ikx) const { return gx_0 + ikx*dgx; }
+
+		double gy(const int &iky) const { return gy_0 + iky*dgy; }
+
+		// annular virtual detector g_inner <= |g| < g_outer
+		void annular_mask(const double &g_inner, const double &g_outer, std::vector<float> &mask) const
+		{
+			mask.assign(npix(), 0);
+			for(auto ikx = 0; ikx < nkx; ikx++)
+			{
+				for(auto iky = 0; iky < nky; iky++)
+				{
+					const double g = sqrt(pow(gx(ikx), 2) + pow(gy(iky), 2));
+					if((g_inner <= g) && (g < g_outer))
+					{
+						mask[ikx*nky+iky] = 1;
+					}
+				}
+			}
+		}
+
+		void write(std::ostream &out)
+		{
+			int n_bytes = c_size_fixed + sizeof(double)*nthk;
+			data_offset = ((n_bytes + c_align - 1)/c_align)*c_align;
+
+			std::vector<char> buffer(data_offset, 0);
+			char *p = buffer.data();
+			std::memcpy(p, magic(), 8); p += 8;
+			put(p, static_cast<int32_t>(c_version));
+			put(p, static_cast<int32_t>(dtype));
+			put(p, static_cast<int32_t>(nkx));
+			put(p, static_cast<int32_t>(nky));
+			put(p, static_cast<int32_t>(nsx));
+			put(p, static_cast<int32_t>(nsy));
+			put(p, static_cast<int32_t>(nthk));
+			put(p, static_cast<int32_t>(n_chunk));
+			put(p, static_cast<int32_t>(bin));
+			put(p, static_cast<int32_t>(0));
+			put(p, E_0);
+			put(p, gx_0);
+			put(p, gy_0);
+			put(p, dgx);
+			put(p, dgy);
+			put(p, g_max);
+			put(p, data_offset);
+			for(auto ithk = 0; ithk < nthk; ithk++)
+			{
+				put(p, thick[ithk]);
+			}
+
+			out.seekp(0);
+			out.write(buffer.data(), buffer.size());
+		}
+
+		bool read(std::istream &in)
+		{
+			std::vector<char> buffer(c_size_fixed);
+			in.seekg(0);
+			if(!in.read(buffer.data(), buffer.size()) || (std::memcmp(buffer.data(), magic(), 8) != 0))
+			{
+				return false;
+			}
+
+			const char *p = buffer.data() + 8;
+			int32_t version, reserved;
+			get(p, version);
+			dtype = get_int(p);
+			nkx = get_int(p);
+			nky = get_int(p);
+			nsx = get_int(p);
+			nsy = get_int(p);
+			nthk = get_int(p);
+			n_chunk = get_int(p);
+			bin = get_int(p);
+			get(p, reserved);
+			get(p, E_0);
+			get(p, gx_0);
+			get(p, gy_0);
+			get(p, dgx);
+			get(p, dgy);
+			get(p, g_max);
+			get(p, data_offset);
+
+			thick.resize(nthk);
+			return (version == c_version) && (nthk == 0 || in.read(reinterpret_cast<char*>(thick.data()), sizeof(double)*nthk));
+		}
+
+		private:
+			static const char* magic() { return "MT4DSTEM"; }
+			static const int c_size_fixed = 8 + 10*sizeof(int32_t) + 6*sizeof(double) + sizeof(int64_t);
+
+			template <class U>
+			static void put(char *&p, const U &v)
+			{
+				std::memcpy(p, &v, sizeof(U));
+				p += sizeof(U);
+			}
+
+			template <class U>
+			static void get(const char *&p, U &v)
+			{
+				std::memcpy(&v, p, sizeof(U));
+				p += sizeof(U);
+			}
+
+			static int get_int(const char *&p)
+			{
+				int32_t v;
+				get(p, v);
+				return v;
+			}
+	};
+
+	/*********************************writer***********************************/
+	/* The simulation threads push the patterns into a bounded queue and a single background
+	 * thread accumulates them into chunks of n_chunk consecutive scanning positions. The
+	 * least recently used chunk is written when more than n_cache chunks are open; a chunk
+	 * that comes back (frozen phonon configurations, defocus integration) is read again and
+	 * accumulated, so the result does not depend on the pass order. The sums are kept in float32:
+	 * with float16 output the written chunks go to a float32 scratch file, and each chunk is
+	 * converted to float16 once, when the writer is closed.
+	 */
+	class STEM_4D_Writer
+	{
+		public:
+			STEM_4D_Writer(): n_buffer(1), n_cache(1), b_stop(false), b_open(false) {}
+
+			~STEM_4D_Writer()
+			{
+				close();
+			}
+
+			bool open(const std::string &fn, STEM_4D_Header &header_i, int n_buffer_i, int n_cache_i)
+			{
+				close();
+
+				header = header_i;
+				n_buffer = max(1, n_buffer_i);
+				n_cache = max(1, n_cache_i);
+
+				file.open(fn, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+				if(!file.is_open())
+				{
+					return false;
+				}
+
+				header.write(file);
+				header_i.data_offset = header.data_offset;
+
+				// allocate the whole data block: chunks that were never written read back as zeros
+				if(header.file_size() > header.data_offset)
+				{
+					file.seekp(header.file_size()-1);
+					file.put(0);
+				}
+				file.flush();
+
+				// a full disk fails here, before the scan starts
+				if(!file.good())
+				{
+					file.close();
+					std::remove(fn.c_str());
+					return false;
+				}
+
+				if(header.dtype == 2)
+				{
+					fn_scratch = fn + ".f32";
+					scratch.open(fn_scratch, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+					if(!scratch.is_open())
+					{
+						file.close();
+						std::remove(fn.c_str());
+						return false;
+					}
+				}
+
+				chunk_flushed.assign(header.nthk*header.n_chunk_thk(), 0);
+
+				b_stop = false;
+				b_open = true;
+				thread = std::thread(&STEM_4D_Writer::run, this);
+
+				return true;
+			}
+
+			bool is_open() const
+			{
+				return b_open;
+			}
+
+			// it only waits when n_buffer patterns are already queued
+			void push(const int &ithk, const int &iscan, std::vector<float> &&pattern)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv_push.wait(lock, [this]{ return queue.size() < n_buffer; });
+				queue.push_back(Item{ithk, iscan, std::move(pattern)});
+				lock.unlock();
+				cv_pop.notify_one();
+			}
+
+			// drain the queue, write all the open chunks and close the file
+			void close()
+			{
+				if(!b_open)
+				{
+					return;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					b_stop = true;
+				}
+				cv_pop.notify_one();
+				thread.join();
+
+				file.close();
+				if(scratch.is_open())
+				{
+					scratch.close();
+					std::remove(fn_scratch.c_str());
+				}
+				b_open = false;
+			}
+
+		private:
+			struct Item
+			{
+				int ithk;
+				int iscan;
+				std::vector<float> data;
+			};
+
+			struct Chunk
+			{
+				int key;
+				std::vector<float> data;
+			};
+
+			void run()
+			{
+				while(true)
+				{
+					Item item;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						cv_pop.wait(lock, [this]{ return b_stop || !queue.empty(); });
+						if(queue.empty())
+						{
+							break;
+						}
+						item = std::move(queue.front());
+						queue.pop_front();
+					}
+					cv_push.notify_one();
+
+					add_pattern(item);
+				}
+
+				if(header.dtype == 2)
+				{
+					write_f16();
+				}
+				else
+				{
+					for(auto &chunk: cache)
+					{
+						write_chunk(chunk);
+					}
+				}
+				cache.clear();
+				cache_map.clear();
+				file.flush();
+			}
+
+			// the open chunks hold their final sums, the other flushed chunks are read from the scratch file
+			void write_f16()
+			{
+				std::vector<char> chunk_done(chunk_flushed.size(), 0);
+				for(auto &chunk: cache)
+				{
+					write_chunk_f16(chunk);
+					chunk_done[chunk.key] = 1;
+				}
+
+				for(auto key = 0; key < chunk_flushed.size(); key++)
+				{
+					if(chunk_flushed[key] && !chunk_done[key])
+					{
+						Chunk chunk{key, std::vector<float>(chunk_size(key)*header.npix(), 0)};
+						read_chunk(chunk);
+						write_chunk_f16(chunk);
+					}
+				}
+			}
+
+			void write_chunk_f16(Chunk &chunk)
+			{
+				const int ithk = chunk.key/header.n_chunk_thk();
+				file.seekp(header.offset(ithk, chunk_iscan_0(chunk.key)));
+
+				buffer_f16.resize(chunk.data.size());
+				for(auto i = 0; i < chunk.data.size(); i++)
+				{
+					buffer_f16[i] = float_2_half(chunk.data[i]);
+				}
+				file.write(reinterpret_cast<const char*>(buffer_f16.data()), buffer_f16.size()*sizeof(uint16_t));
+			}
+
+			// float32 position of a chunk in the scratch file
+			int64_t scratch_offset(const int &key) const
+			{
+				const int ithk = key/header.n_chunk_thk();
+				return (static_cast<int64_t>(ithk)*header.ns() + chunk_iscan_0(key))*header.npix()*sizeof(float);
+			}
+
+			void add_pattern(Item &item)
+			{
+				const int ic = item.iscan/header.n_chunk;
+				const int key = item.ithk*header.n_chunk_thk() + ic;
+
+				auto it = cache_map.find(key);
+				if(it == cache_map.end())
+				{
+					cache.push_front(Chunk{key, std::vector<float>(chunk_size(key)*header.npix(), 0)});
+					if(chunk_flushed[key])
+					{
+						read_chunk(cache.front());
+					}
+					it = cache_map.emplace(key, cache.begin()).first;
+
+					if(cache.size() > n_cache)
+					{
+						write_chunk(cache.back());
+						cache_map.erase(cache.back().key);
+						cache.pop_back();
+					}
+				}
+				else if(it->second != cache.begin())
+				{
+					cache.splice(cache.begin(), cache, it->second);
+				}
+
+				auto &data = it->second->data;
+				const int npix = header.npix();
+				const int ip_0 = (item.iscan - ic*header.n_chunk)*npix;
+				for(auto ip = 0; ip < min(npix, static_cast<int>(item.data.size())); ip++)
+				{
+					data[ip_0+ip] += item.data[ip];
+				}
+			}
+
+			int chunk_iscan_0(const int &key) const
+			{
+				return (key % header.n_chunk_thk())*header.n_chunk;
+			}
+
+			int chunk_size(const int &key) const
+			{
+				const int iscan_0 = chunk_iscan_0(key);
+				return min(header.n_chunk, header.ns()-iscan_0);
+			}
+
+			// evicted chunks are written in float32, to the scratch file for float16 output
+			void write_chunk(Chunk &chunk)
+			{
+				if(header.dtype == 2)
+				{
+					scratch.seekp(scratch_offset(chunk.key));
+					scratch.write(reinterpret_cast<const char*>(chunk.data.data()), chunk.data.size()*sizeof(float));
+				}
+				else
+				{
+					const int ithk = chunk.key/header.n_chunk_thk();
+					file.seekp(header.offset(ithk, chunk_iscan_0(chunk.key)));
+					file.write(reinterpret_cast<const char*>(chunk.data.data()), chunk.data.size()*sizeof(float));
+				}
+
+				chunk_flushed[chunk.key] = 1;
+			}
+
+			void read_chunk(Chunk &chunk)
+			{
+				if(header.dtype == 2)
+				{
+					scratch.seekg(scratch_offset(chunk.key));
+					scratch.read(reinterpret_cast<char*>(chunk.data.data()), chunk.data.size()*sizeof(float));
+				}
+				else
+				{
+					const int ithk = chunk.key/header.n_chunk_thk();
+					file.seekg(header.offset(ithk, chunk_iscan_0(chunk.key)));
+					file.read(reinterpret_cast<char*>(chunk.data.data()), chunk.data.size()*sizeof(float));
+				}
+			}
+
+			STEM_4D_Header header;
+			std::fstream file;
+			std::string fn_scratch;
+			std::fstream scratch; 						// float32 sums of the evicted chunks (float16 output)
+
+			int n_buffer; 								// maximum number of queued patterns
+			int n_cache; 								// maximum number of open chunks
+
+			std::deque<Item> queue;
+			std::mutex mutex;
+			std::condition_variable cv_push;
+			std::condition_variable cv_pop;
+			bool b_stop;
+			bool b_open;
+			std::thread thread;
+
+			std::list<Chunk> cache;
+			std::unordered_map<int, std::list<Chunk>::iterator> cache_map;
+			std::vector<char> chunk_flushed;
+			std::vector<uint16_t> buffer_f16;
+	};
+
+	/*********************************reader***********************************/
+	class STEM_4D_Reader
+	{
+		public:
+			bool open(const std::string &fn)
+			{
+				close();
+
+				file.open(fn, std::ios::in | std::ios::binary);
+				if(!file.is_open() || !header.read(file))
+				{
+					close();
+					return false;
+				}
+				return true;
+			}
+
+			void close()
+			{
+				if(file.is_open())
+				{
+					file.close();
+				}
+			}
+
+			bool is_open()
+			{
+				return file.is_open();
+			}
+
+			void read_pattern(const int &ithk, const int &iscan, std::vector<float> &pattern)
+			{
+				read(header.offset(ithk, iscan), header.npix(), pattern);
+			}
+
+			// image[iDet][iscan] = sum(mask[iDet]*pattern[iscan]), the patterns are read chunk by chunk
+			void virtual_image(const int &ithk, const std::vector<std::vector<float>> &mask,
+			std::vector<std::vector<float>> &image)
+			{
+				const int ns = header.ns();
+				const int npix = header.npix();
+
+				image.assign(mask.size(), std::vector<float>(ns, 0));
+
+				std::vector<float> data;
+				for(auto iscan_0 = 0; iscan_0 < ns; iscan_0 += header.n_chunk)
+				{
+					const int n_pos = min(header.n_chunk, ns-iscan_0);
+					read(header.offset(ithk, iscan_0), n_pos*npix, data);
+
+					for(auto iDet = 0; iDet < mask.size(); iDet++)
+					{
+						for(auto ipos = 0; ipos < n_pos; ipos++)
+						{
+							const float *p = data.data() + ipos*npix;
+							double sum = 0;
+							for(auto ip = 0; ip < npix; ip++)
+							{
+								sum += mask[iDet][ip]*p[ip];
+							}
+							image[iDet][iscan_0+ipos] = static_cast<float>(sum);
+						}
+					}
+				}
+			}
+
+			STEM_4D_Header header;
+
+		private:
+			void read(const int64_t &offset, const int &n_value, std::vector<float> &data)
+			{
+				data.resize(n_value);
+				file.seekg(offset);
+
+				if(header.dtype == 2)
+				{
+					buffer_f16.resize(n_value);
+					file.read(reinterpret_cast<char*>(buffer_f16.data()), n_value*sizeof(uint16_t));
+					for(auto i = 0; i < n_value; i++)
+					{
+						data[i] = half_2_float(buffer_f16[i]);
+					}
+				}
+				else
+				{
+					file.read(reinterpret_cast<char*>(data.data()), n_value*sizeof(float));
+				}
+			}
+
+			std::ifstream file;
+			std::vector<uint16_t> buffer_f16;
+	};
+
+	/*********************************store************************************/
+	/* |psi(g)|^2 of each scanning position and thickness is cropped to g_max, binned and
+	 * handed to the background writer. It can be called concurrently by the scan workers.
+	 */
+	template <class T, eDevice dev>
+	class STEM_4D_Store
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+
+			static const std::size_t c_chunk_size = 4194304; 		// target chunk size (bytes)
+			static const std::size_t c_buffer_size = 268435456; 		// maximum size of the queued patterns (bytes)
+
+			STEM_4D_Store(): input_multislice(nullptr), bin2(1), b_error(false) {}
+
+			// it returns false when the 4D-STEM file is requested but it can not be created
+			bool set_input_data(Input_Multislice<T_r> *input_multislice_i)
+			{
+				close();
+
+				b_error = false;
+				input_multislice = input_multislice_i;
+				if(!input_multislice->is_STEM_4D())
+				{
+					return true;
+				}
+
+				set_header_index();
+
+				auto pattern_bytes = header.npix()*sizeof(float);
+				header.n_chunk = input_multislice->stem_4d.n_chunk;
+				if(header.n_chunk <= 0)
+				{
+					header.n_chunk = static_cast<int>(c_chunk_size/pattern_bytes);
+				}
+				header.n_chunk = max(1, min(header.n_chunk, header.ns()));
+
+				// open chunks: one per scan thread and thickness being written, plus slack for out of order positions
+				int n_cache = 2*max(1, input_multislice->system_conf.cpu_nthread_scan)*max(1, header.nthk);
+				int n_buffer = max(2, static_cast<int>(c_buffer_size/pattern_bytes));
+
+				b_error = !writer.open(input_multislice->stem_4d.fn, header, n_buffer, n_cache);
+
+				return !b_error;
+			}
+
+			bool is_enable() const
+			{
+				return writer.is_open();
+			}
+
+			bool is_error() const
+			{
+				return b_error;
+			}
+
+			template <class TVector_c>
+			enable_if_host_vector<TVector_c, void>
+			operator()(const int &ithk, const int &iscan, const T_r &w_i, TVector_c &psi)
+			{
+				std::vector<float> pattern(header.npix());
+				for(auto ip = 0; ip < pattern.size(); ip++)
+				{
+					T_r sum = 0;
+					for(auto ib = 0; ib < bin2; ib++)
+					{
+						sum += norm(psi[ind[ip*bin2+ib]]);
+					}
+					pattern[ip] = static_cast<float>(w_i*sum);
+				}
+
+				writer.push(ithk, iscan, std::move(pattern));
+			}
+
+			template <class TVector_c>
+			enable_if_device_vector<TVector_c, void>
+			operator()(const int &ithk, const int &iscan, const T_r &w_i, TVector_c &psi)
+			{
+				Vector<T_c, e_host> psi_h(psi.begin(), psi.end());
+				this->operator()(ithk, iscan, w_i, psi_h);
+			}
+
+			void close()
+			{
+				writer.close();
+			}
+
+			STEM_4D_Header header;
+
+		private:
+			// the crop window is a whole number of bins, centered at g = 0
+			void set_header_index()
+			{
+				auto &grid_2d = input_multislice->grid_2d;
+				auto &stem_4d = input_multislice->stem_4d;
+
+				int bin = max(1, min(stem_4d.bin, min(grid_2d.nxh, grid_2d.nyh)));
+
+				auto crop_half = [bin](const int &nh, const T_r &dg, const T_r &g_max)->int
+				{
+					int c = (g_max > 0) ? min(nh, static_cast<int>(ceil(g_max/dg))) : nh;
+					c = max(bin, ((c+bin-1)/bin)*bin);
+					return (c > nh) ? (nh/bin)*bin : c;
+				};
+
+				int cx = crop_half(grid_2d.nxh, grid_2d.dgx, stem_4d.g_max);
+				int cy = crop_half(grid_2d.nyh, grid_2d.dgy, stem_4d.g_max);
+
+				header.dtype = (stem_4d.f16) ? 2 : 1;
+				header.nkx = 2*cx/bin;
+				header.nky = 2*cy/bin;
+				header.nsx = (input_multislice->scanning.is_line()) ? 1 : input_multislice->scanning.nx;
+				header.nsy = (input_multislice->scanning.is_line()) ? input_multislice->scanning.size() : input_multislice->scanning.ny;
+				header.nthk = input_multislice->thick.size();
+				header.bin = bin;
+				header.E_0 = input_multislice->E_0;
+				header.dgx = bin*grid_2d.dgx;
+				header.dgy = bin*grid_2d.dgy;
+				header.gx_0 = (-cx + 0.5*(bin-1))*grid_2d.dgx;
+				header.gy_0 = (-cy + 0.5*(bin-1))*grid_2d.dgy;
+				header.g_max = stem_4d.g_max;
+				header.thick.assign(input_multislice->thick.begin(), input_multislice->thick.end());
+
+				// source pixels of each output pixel: shifted pixel -> fft layout
+				bin2 = bin*bin;
+				ind.resize(header.npix()*bin2);
+				for(auto ikx = 0; ikx < header.nkx; ikx++)
+				{
+					for(auto iky = 0; iky < header.nky; iky++)
+					{
+						const int ip = ikx*header.nky+iky;
+						for(auto jx = 0; jx < bin; jx++)
+						{
+							for(auto jy = 0; jy < bin; jy++)
+							{
+								const int ix = grid_2d.iRx_shift(grid_2d.nxh - cx + ikx*bin + jx);
+								const int iy = grid_2d.iRy_shift(grid_2d.nyh - cy + iky*bin + jy);
+								ind[ip*bin2 + jx*bin + jy] = grid_2d.ind_col(ix, iy);
+							}
+						}
+					}
+				}
+			}
+
+			Input_Multislice<T_r> *input_multislice;
+
+			int bin2;
+			Vector<int, e_host> ind; 			// source pixels of each output pixel
+
+			STEM_4D_Writer writer;
+			bool b_error; 						// the 4D-STEM file can not be created
+	};
+
+} // namespace mt
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * This file is part of MULTEM.
+ * Copyright 2020 Ivan Lobato <Ivanlh20@gmail.com>
+ *
+ * MULTEM is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MULTEM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MULTEM. If not, see <http:// www.gnu.org/licenses/>.
+ */
+
+#ifndef STEM_SCAN_H
+#define STEM_SCAN_H
+
+#include <atomic>
+#include <vector>
+
+#include "math.cuh"
+#include "types.cuh"
+#include "traits.cuh"
+#include "stream.cuh"
+#include "fft.cuh"
+#include "memory_info.cuh"
+#include "input_multislice.cuh"
+#include "cpu_fcns.hpp"
+#include "gpu_fcns.cuh"
+#include "wave_function.cuh"
+
+namespace mt
+{
+	/* STEM scan engine: probe positions are distributed over cpu_nthread_scan workers,
+	 * each with its own incident wave, propagator, fft plan and wave buffers. The stored
+	 * transmission functions and the detectors of the master wave function are shared read-only.
+	 * Each worker takes tiles of cpu_scan_tile blocks of cpu_scan_batch probe positions; the
+	 * probes of a block are propagated together and the blocks of a tile share a window of slices.
+	 */
+	template <class T, eDevice dev>
+	class STEM_Scan
+	{
+		public:
+			using T_r = T;
+			using T_c = complex<T>;
+
+			static const eDevice device = dev;
+
+			STEM_Scan(): input_multislice(nullptr), wave_function(nullptr){}
+
+			static bool is_enabled(Input_Multislice<T_r> &input_multislice_i)
+			{
+				return (dev == e_host) && input_multislice_i.is_STEM() && !input_multislice_i.pn_coh_contrib
+					&& !input_multislice_i.is_illu_mod_full_integration()
+					&& ((input_multislice_i.system_conf.cpu_nthread_scan > 1) || (input_multislice_i.system_conf.cpu_scan_batch > 1)
+					|| (input_multislice_i.system_conf.cpu_scan_tile > 1))
+					&& (input_multislice_i.scanning.size() > 1);
+			}
+
+			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Wave_Function<T_r, dev> *wave_function_i)
+			{
+				input_multislice = input_multislice_i;
+				wave_function = wave_function_i;
+
+				int n_scan = input_multislice->scanning.size();
+				int n_worker = min(input_multislice->system_conf.cpu_nthread_scan, n_scan);
+				int nthread_grid = input_multislice->system_conf.cpu_nthread_grid();
+				int n_batch = min(input_multislice->system_conf.cpu_scan_batch, max(1, n_scan/n_worker));
+				int n_tile = min(input_multislice->system_conf.cpu_scan_tile, max(1, n_scan/(n_worker*n_batch)));
+
+				/* the window of slices, the waves of a block, the propagator kernel and the wave
+				 * scratch of a worker share its part of the cache budget. Tiling only pays off when
+				 * at least one slice fits next to the waves of a block; otherwise each block goes
+				 * through all the slices (n_slice_win = 0)
+				 */
+				double cache_size = input_multislice->system_conf.cpu_cache_size;
+				cache_size = (cache_size > 0)?cache_size:get_cache_size();
+				cache_size = ((cache_size > 0)?cache_size:c_cache_size)*1048576.0/n_worker;
+
+				double slice_size = input_multislice->grid_2d.nxy()*sizeof(T_c);
+				int n_slice_win = static_cast<int>(floor(cache_size/slice_size)) - (n_batch + 2);
+				if(n_slice_win < 1)
+				{
+					n_tile = 1;
+					n_slice_win = 0;
+				}
+
+				stream_scan.resize(n_worker);
+
+				// Stream holds a mutex: workers are constructed in place
+				worker = std::vector<Worker>(n_worker);
+				for(auto &wk: worker)
+				{
+					// fftw planning is not thread safe: plans are created here, in the calling thread
+					wk.set_input_data(*input_multislice, nthread_grid, n_batch, n_tile, n_slice_win);
+				}
+			}
+
+			int size() const
+			{
+				return worker.size();
+			}
+
+			template <class TOutput_multislice>
+			void operator()(T_r w_i, TOutput_multislice &output_multislice)
+			{
+				int n_scan = input_multislice->scanning.size();
+
+				// each probe position is evaluated by exactly one worker, so the output needs no locking
+				std::atomic<int> iscan_next(0);
+
+				auto thr_scan = [&](const int &iworker)
+				{
+					auto &wk = worker[iworker];
+					const int n_scan_tile = wk.n_batch*wk.n_tile;
+					for(auto iscan = iscan_next.fetch_add(n_scan_tile); iscan < n_scan; iscan = iscan_next.fetch_add(n_scan_tile))
+					{
+						wk.psi(iscan, min(iscan+n_scan_tile, n_scan), w_i, *wave_function, output_multislice);
+					}
+				};
+
+				stream_scan.set_n_act_stream(worker.size());
+				stream_scan.exec_istream(thr_scan);
+			}
+
+			void clear()
+			{
+				worker.clear();
+				stream_scan.destroy();
+			}
+
+		private:
+			static constexpr double c_cache_size = 16; 				// cache budget (MB) when the cache size is not known
+
+			struct Worker
+			{
+				Worker(): n_batch(1), n_tile(1), n_slice_win(0), z_prop_b(0), b_prop_b(false){}
+
+				int n_batch;
+				int n_tile;
+				int n_slice_win;
+
+				Input_Multislice<T_r> input_multislice;
+				Stream<dev> stream;
+				FFT<T_r, dev> fft_2d;
+				FFT<T_r, dev> fft_b;
+
+				Incident_Wave<T_r, dev> incident_wave;
+				Propagator<T_r, dev> propagator;
+
+				Vector<T_c, dev> psi_z;
+				Vector<T_c, dev> psi_o;
+
+				std::vector<Vector<T_c, dev>> psi_t;
+				Vector<T_c, dev> prop_b;
+				T_r z_prop_b;
+				bool b_prop_b;
+
+				Vector<T_r, e_host> det_hist;
+				Vector<T_r, e_host> det_int;
+
+				void set_input_data(Input_Multislice<T_r> &input_multislice_i, const int &nthread, 
+				const int &n_batch_i, const int &n_tile_i, const int &n_slice_win_i)
+				{
+					// the condenser lens and the beam position are modified per probe
+					input_multislice = input_multislice_i;
+					input_multislice.atoms.clear();
+
+					input_multislice.iscan.resize(1);
+					input_multislice.beam_x.resize(1);
+					input_multislice.beam_y.resize(1);
+
+					auto nx = input_multislice.grid_2d.nx;
+					auto ny = input_multislice.grid_2d.ny;
+					auto nxy = input_multislice.grid_2d.nxy();
+
+					stream.resize(nthread);
+					fft_2d.create_plan_2d(ny, nx, nthread);
+
+					incident_wave.set_input_data(&input_multislice, &stream, &fft_2d);
+					propagator.set_input_data(&input_multislice, &stream, &fft_2d);
+
+					psi_z.resize(nxy);
+					psi_o.resize(nxy);
+					det_int.resize(input_multislice.detector.size());
+
+					// a tile holds n_tile blocks of n_batch probes; each block is transmitted and 
+					// propagated with one batched fft per slice
+					n_batch = n_batch_i;
+					n_tile = n_tile_i;
+					n_slice_win = n_slice_win_i;
+					if(n_batch*n_tile > 1)
+					{
+						fft_b.create_plan_2d_batch(ny, nx, n_batch, nthread);
+						psi_t.resize(n_tile);
+						for(auto &psi_b: psi_t)
+						{
+							psi_b.resize(n_batch*nxy);
+						}
+						prop_b.resize(nxy);
+					}
+					b_prop_b = false;
+				}
+
+				template <class TOutput_multislice>
+				void psi(const int &iscan_0, const int &iscan_e, const T_r &w_i, Wave_Function<T_r, dev> &wf, TOutput_multislice &output_multislice)
+				{
+					// full blocks go through the tile path, the remaining probes one by one
+					int n_block = (n_batch*n_tile > 1)?(iscan_e-iscan_0)/n_batch:0;
+					if(n_block > 0)
+					{
+						psi_tile(iscan_0, n_block, w_i, wf, output_multislice);
+					}
+
+					for(auto iscan = iscan_0+n_block*n_batch; iscan < iscan_e; iscan++)
+					{
+						psi(iscan, w_i, wf, output_multislice);
+					}
+				}
+
+				template <class TOutput_multislice>
+				void psi(const int &iscan, const T_r &w_i, Wave_Function<T_r, dev> &wf, TOutput_multislice &output_multislice)
+				{
+					set_incident_wave(iscan, wf.slicing.z_m(0), psi_z);
+
+					T_r gx_0 = input_multislice.gx_0();
+					T_r gy_0 = input_multislice.gy_0();
+
+					for(auto islice = 0; islice<wf.slicing.slice.size(); islice++)
+					{
+						if(input_multislice.is_multislice())
+						{
+							propagator.transmit_propagate(wf.trans_stored(islice), gx_0, gy_0, wf.dz(islice), psi_z);
+						}
+						else
+						{
+							wf.transmit(stream, islice, psi_z);
+						}
+
+						int ithk = wf.slicing.slice[islice].ithk;
+						if(0 <= ithk)
+						{
+							set_image(iscan, ithk, w_i, wf, psi_z, output_multislice);
+						}
+					}
+				}
+
+				/* the blocks of the tile advance together through a window of n_slice_win slices before
+				 * moving to the next window, so the transmission functions of the window are reused
+				 * from cache by all the probes of the tile
+				 */
+				template <class TOutput_multislice>
+				void psi_tile(const int &iscan_0, const int &n_block, const T_r &w_i, Wave_Function<T_r, dev> &wf, TOutput_multislice &output_multislice)
+				{
+					auto nxy = input_multislice.grid_2d.nxy();
+
+					for(auto it = 0; it < n_block; it++)
+					{
+						for(auto ib = 0; ib < n_batch; ib++)
+						{
+							set_incident_wave(iscan_0+it*n_batch+ib, wf.slicing.z_m(0), psi_z);
+							thrust::copy(psi_z.begin(), psi_z.end(), psi_t[it].begin()+ib*nxy);
+						}
+					}
+
+					T_r gx_0 = input_multislice.gx_0();
+					T_r gy_0 = input_multislice.gy_0();
+
+					int n_slice = wf.slicing.slice.size();
+					int n_win = (n_slice_win > 0)?n_slice_win:n_slice;
+					for(auto islice_0 = 0; islice_0 < n_slice; islice_0 += n_win)
+					{
+						int islice_e = min(islice_0+n_win, n_slice);
+						for(auto it = 0; it < n_block; it++)
+						{
+							auto &psi_b = psi_t[it];
+							for(auto islice = islice_0; islice < islice_e; islice++)
+							{
+								wf.transmit_batch(stream, islice, psi_b);
+
+								if(input_multislice.is_multislice())
+								{
+									propagate_batch(gx_0, gy_0, wf.dz(islice), psi_b);
+								}
+
+								int ithk = wf.slicing.slice[islice].ithk;
+								if(0 <= ithk)
+								{
+									for(auto ib = 0; ib < n_batch; ib++)
+									{
+										thrust::copy(psi_b.begin()+ib*nxy, psi_b.begin()+(ib+1)*nxy, psi_z.begin());
+										set_image(iscan_0+it*n_batch+ib, ithk, w_i, wf, psi_z, output_multislice);
+									}
+								}
+							}
+						}
+					}
+				}
+
+				void set_incident_wave(const int &iscan, const T_r &z_init, Vector<T_c, dev> &psi)
+				{
+					input_multislice.iscan[0] = iscan;
+					input_multislice.set_iscan_beam_position();
+
+					incident_wave(psi, 0, 0, input_multislice.beam_x, input_multislice.beam_y, z_init);
+				}
+
+				void propagate_batch(const T_r &gxu, const T_r &gyu, const T_r &z, Vector<T_c, dev> &psi_b)
+				{
+					// slices usually share the same thickness: the kernel is only rebuilt when z changes
+					if(!b_prop_b || (z != z_prop_b))
+					{
+						mt::propagator_kernel(stream, input_multislice.grid_2d, input_multislice.get_propagator_factor(z), gxu, gyu, prop_b);
+						z_prop_b = z;
+						b_prop_b = true;
+					}
+
+					fft_b.forward(psi_b);
+					mt::multiply_batch(stream, prop_b, psi_b);
+					fft_b.inverse(psi_b);
+				}
+
+				template <class TOutput_multislice>
+				void set_image(const int &iscan, const int &ithk, const T_r &w_i, Wave_Function<T_r, dev> &wf, 
+				Vector<T_c, dev> &psi_i, TOutput_multislice &output_multislice)
+				{
+					T_r gx_0 = input_multislice.gx_0();
+					T_r gy_0 = input_multislice.gy_0();
+
+					wf.phase_multiplication(stream, gx_0, gy_0, psi_i, psi_o);
+					propagator(input_multislice.get_simulation_space(), gx_0, gy_0, wf.slicing.thick[ithk].z_back_prop, psi_o);
+
+					wf.integrated_intensity_over_det(stream, w_i, psi_o, det_hist, det_int);
+					for(auto iDet = 0; iDet<wf.detector.size(); iDet++)
+					{
+						output_multislice.image_tot[ithk].image[iDet][iscan] += det_int[iDet];
+					}
+
+					if(wf.detector.is_detector_radial())
+					{
+						output_multislice.add_scale_radial_tot(ithk, iscan, w_i, det_hist);
+					}
+
+					if(wf.stem_4d.is_enable())
+					{
+						wf.stem_4d(ithk, iscan, w_i, psi_o);
+					}
+				}
+			};
+
+			Input_Multislice<T_r> *input_multislice;
+			Wave_Function<T_r, dev> *wave_function;
+
+			Stream<e_host> stream_scan;
+			std::vector<Worker> worker;
+	};
+
+} // namespace mt
+
+#endif
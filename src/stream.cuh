@@ -20,6 +20,10 @@
 #define STREAM_H
 
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <condition_variable>
 
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -38,10 +42,12 @@ namespace mt
 			std::mutex stream_mutex;
 
 			Stream(): nx(0), ny(0), nxy(0), nstream(0), n_act_stream(0), 
-			stream(nullptr){}
+			n_task(0), n_task_pend(0), task_gen(0), task_stop(false), 
+			task_busy(false), task_fn(nullptr), task_call(nullptr){}
 
 			Stream(int new_nstream): nx(0), ny(0), nxy(0), nstream(0), 
-			n_act_stream(0), stream(nullptr)
+			n_act_stream(0), n_task(0), n_task_pend(0), task_gen(0), 
+			task_stop(false), task_busy(false), task_fn(nullptr), task_call(nullptr)
 			{
 				resize(new_nstream);
 			}
@@ -60,26 +66,21 @@ namespace mt
 				destroy();
 
 				nstream = new_nstream;
-				if(nstream > 1)
+
+				// the calling thread always executes the last range, so only nstream-1 workers are parked
+				worker.reserve(nstream-1);
+				for(auto iworker = 0; iworker < nstream-1; iworker++)
 				{
-					stream = new std::thread[nstream-1];
+					worker.emplace_back(&Stream<e_host>::worker_loop, this, iworker);
 				}
 
 				set_n_act_stream(size());
 			}
 
-			std::thread& operator[](const int i){ return stream[i]; }
-
-			const std::thread& operator[](const int i) const { return stream[i]; }
-
 			void synchronize()
 			{
-				destroy();
-
-				if(nstream > 1)
-				{
-					stream = new std::thread[nstream-1];
-				}
+				std::unique_lock<std::mutex> lock(pool_mutex);
+				cv_done.wait(lock, [this]{ return n_task_pend == 0; });
 			}
 
 			void set_n_act_stream(const int &new_n_act_stream)
@@ -138,34 +139,59 @@ namespace mt
 				return range;
 			}
 
-			template <class TFn, class... TArgs>
-			void exec(TFn &fn, TArgs &...arg)
+			// fork/join: fn(istream) for istream = 0, ..., n_act_stream-1
+			template <class TFn>
+			void exec_istream(TFn &fn)
 			{
 				if(n_act_stream < 1)
 				{
 					return;
 				}
 
-				for(auto istream = 0; istream < n_act_stream-1; istream++)
+				// nested or single calls run on the calling thread
+				if((n_act_stream == 1) || task_busy.exchange(true))
 				{
-					stream[istream] = std::thread(std::bind(fn, get_range(istream), std::ref<TArgs>(arg)...));
+					for(auto istream = 0; istream < n_act_stream; istream++)
+					{
+						fn(istream);
+					}
+					return;
 				}
 
-				fn(get_range(n_act_stream-1), std::ref<TArgs>(arg)...);
+				{
+					std::lock_guard<std::mutex> lock(pool_mutex);
+					task_fn = &fn;
+					task_call = &Stream<e_host>::call_task<TFn>;
+					n_task = n_act_stream;
+					n_task_pend = n_act_stream-1;
+					task_gen++;
+				}
+				cv_task.notify_all();
+
+				fn(n_act_stream-1);
 
 				synchronize();
+
+				task_busy = false;
 			}
 
 			template <class TFn, class... TArgs>
-			void exec_matrix(TFn &fn, TArgs &...arg)
+			void exec(TFn &fn, TArgs &...arg)
 			{
-				if(n_act_stream < 1)
+				auto thr_fn = [&](const int &istream)
 				{
-					return;
-				}
+					fn(get_range(istream), arg...);
+				};
 
-				auto thr_fn_m = [&](const Range_2d &range, TArgs &...arg)
+				exec_istream(thr_fn);
+			}
+
+			template <class TFn, class... TArgs>
+			void exec_matrix(TFn &fn, TArgs &...arg)
+			{
+				auto thr_fn_m = [&](const int &istream)
 				{
+					auto range = get_range(istream);
 					for(auto ix = range.ix_0; ix < range.ix_e; ix++)
 					{
 						for(auto iy = range.iy_0; iy < range.iy_e; iy++)
@@ -175,40 +201,22 @@ namespace mt
 					}
 				};
 
-				for(auto istream = 0; istream < n_act_stream-1; istream++)
-				{
-					stream[istream] = std::thread(std::bind(thr_fn_m, get_range(istream), std::ref<TArgs>(arg)...));
-				}
-
-				thr_fn_m(get_range(n_act_stream-1), std::ref<TArgs>(arg)...);
-
-				synchronize();
+				exec_istream(thr_fn_m);
 			}
 
 			template <class TFn, class... TArgs>
 			void exec_vector(TFn &fn, TArgs &...arg)
 			{
-				if(n_act_stream < 1)
-				{
-					return;
-				}
-
-				auto thr_fn_v = [&](const Range_2d &range, TArgs &...arg)
+				auto thr_fn_v = [&](const int &istream)
 				{
+					auto range = get_range(istream);
 					for(auto ixy = range.ixy_0; ixy < range.ixy_e; ixy++)
 					{
 						fn(ixy, arg...);
 					}
 				};
 
-				for(auto istream = 0; istream < n_act_stream-1; istream++)
-				{
-					stream[istream] = std::thread(std::bind(thr_fn_v, get_range(istream), std::ref<TArgs>(arg)...));
-				}
-
-				thr_fn_v(get_range(n_act_stream-1), std::ref<TArgs>(arg)...);
-
-				synchronize();
+				exec_istream(thr_fn_v);
 			}
 
 			int n_act_stream;
@@ -218,24 +226,86 @@ namespace mt
 			int nxy;
 
 			int nstream;
-			std::thread *stream;
+
+			// persistent worker pool: workers park on cv_task between calls
+			std::vector<std::thread> worker;
+			std::mutex pool_mutex;
+			std::condition_variable cv_task;
+			std::condition_variable cv_done;
+
+			int n_task;
+			int n_task_pend;
+			unsigned long long task_gen;
+			bool task_stop;
+			std::atomic<bool> task_busy;
+
+			void *task_fn;
+			void (*task_call)(void *fn, const int &istream);
+
+			template <class TFn>
+			static void call_task(void *fn, const int &istream)
+			{
+				(*static_cast<TFn*>(fn))(istream);
+			}
+
+			void worker_loop(const int iworker)
+			{
+				unsigned long long task_gen_w = 0;
+
+				std::unique_lock<std::mutex> lock(pool_mutex);
+				while(true)
+				{
+					cv_task.wait(lock, [&]{ return task_stop || (task_gen != task_gen_w); });
+
+					if(task_stop)
+					{
+						return;
+					}
+
+					task_gen_w = task_gen;
+
+					if(iworker >= n_task-1)
+					{
+						continue;
+					}
+
+					auto fn = task_fn;
+					auto call = task_call;
+
+					lock.unlock();
+					call(fn, iworker);
+					lock.lock();
+
+					if(--n_task_pend == 0)
+					{
+						cv_done.notify_all();
+					}
+				}
+			}
 
 			void destroy()
 			{
-				if(nstream < 0)
+				if(worker.empty())
 				{
 					return;
 				}
 
-				for(auto i = 0; i < nstream-1; i++)
 				{
-					if(stream[i].joinable())
+					std::lock_guard<std::mutex> lock(pool_mutex);
+					task_stop = true;
+				}
+				cv_task.notify_all();
+
+				for(auto &thr: worker)
+				{
+					if(thr.joinable())
 					{
-						stream[i].join();
+						thr.join();
 					}
 				}
 
-				delete [] stream;
+				worker.clear();
+				task_stop = false;
 			};
 	};
 
@@ -19,6 +19,12 @@
 #ifndef TEM_SIMULATION_H
 #define TEM_SIMULATION_H
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
 #include <fftw3.h>
 #include "math.cuh"
 #include "types.cuh"
@@ -28,8 +34,13 @@
 #include "cpu_fcns.hpp"
 #include "gpu_fcns.cuh"
 #include "cgpu_fcns.cuh"
+#include "memory_info.cuh"
 #include "energy_loss.cuh"
 #include "wave_function.cuh"
+#include "stem_scan.cuh"
+#include "prism.cuh"
+#include "probe_window.cuh"
+#include "fp_convergence.hpp"
 #include "timing.cuh"
 #include "matlab_mex.cuh"
 
@@ -44,9 +55,10 @@ namespace mt
 
 			static const eDevice device = dev;
 
-			static bool ext_stop_sim;
-			static int ext_niter;
-			static int ext_iter;
+			// configuration workers run concurrently: the progress counters are shared
+			static std::atomic<bool> ext_stop_sim;
+			static std::atomic<int> ext_niter;
+			static std::atomic<int> ext_iter;
 
 			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Stream<dev> *stream_i, FFT<T_r, dev> *fft2_i)
 			{
@@ -54,6 +66,15 @@ namespace mt
 				stream = stream_i;
 				fft_2d = fft2_i;
 
+				fp_conv.set_input_data(input_multislice);
+
+				// each worker owns its wave function, slice storage and partial output
+				if(is_conf_parallel(*input_multislice))
+				{
+					set_conf_workers();
+					return;
+				}
+
 				if(input_multislice->is_EELS_EFTEM())
 				{
 					energy_loss.set_input_data(input_multislice, stream, fft_2d);
@@ -70,7 +91,13 @@ namespace mt
 			template <class TOutput_multislice>
 			void operator()(TOutput_multislice &output_multislice)
 			{
-				if(input_multislice->is_STEM_ISTEM())
+				fp_conv.init();
+
+				if(conf_worker.size() > 0)
+				{
+					conf_parallel(output_multislice);
+				}
+				else if(input_multislice->is_STEM_ISTEM())
 				{
 					STEM_ISTEM(output_multislice);
 				}
@@ -94,14 +121,150 @@ namespace mt
 				{
 					EELS_EFTEM(output_multislice);
 				}
+
+				set_slice_mem(output_multislice);
+			}
+
+			// the 4D-STEM file is requested but it can not be created: the caller must not run the simulation
+			bool is_stem_4d_error() const
+			{
+				return wave_function.stem_4d.is_error();
 			}
 
 		private:
+			// slice storage tier and error bound, the largest bound of the configuration workers
 			template <class TOutput_multislice>
-			void STEM_ISTEM(TOutput_multislice &output_multislice)
+			void set_slice_mem(TOutput_multislice &output_multislice)
 			{
-				ext_niter = input_multislice->scanning.size()*input_multislice->number_conf();
+				if(conf_worker.size() > 0)
+				{
+					auto &wf_0 = conf_worker[0]->multislice->wave_function;
+					output_multislice.slice_mem_type = wf_0.slice_mem_type();
+					output_multislice.slice_mem_err = 0;
+					for(auto &wk: conf_worker)
+					{
+						output_multislice.slice_mem_err = max(output_multislice.slice_mem_err, wk->multislice->wave_function.get_slice_mem_err());
+					}
+				}
+				else
+				{
+					output_multislice.slice_mem_type = wave_function.slice_mem_type();
+					output_multislice.slice_mem_err = wave_function.get_slice_mem_err();
+				}
+			}
+
+			static bool is_conf_parallel(Input_Multislice<T_r> &input_multislice_i)
+			{
+				bool bb_mode = input_multislice_i.is_STEM_ISTEM() || input_multislice_i.is_CBED_CBEI() || input_multislice_i.is_ED_HRTEM()
+					|| input_multislice_i.is_PED_HCTEM() || input_multislice_i.is_EWFS_EWRS() || input_multislice_i.is_EELS_EFTEM();
+
+				return (dev == e_host) && bb_mode && (input_multislice_i.system_conf.cpu_nthread_conf > 1) 
+					&& input_multislice_i.is_frozen_phonon() && (input_multislice_i.number_conf() > 1) && (input_multislice_i.pn_nconf_w == 0)
+					&& !(input_multislice_i.is_STEM() && input_multislice_i.pn_coh_contrib) && !input_multislice_i.is_STEM_4D();
+			}
+
+			// configuration workers run one of the configurations of the run: the master resets the counter
+			void set_ext_niter(const int &niter)
+			{
+				if(input_multislice->pn_nconf_w > 0)
+				{
+					ext_niter = niter*input_multislice->pn_nconf_w;
+				}
+				else
+				{
+					ext_niter = niter;
+					ext_iter = 0;
+				}
+			}
+
+			/* workers are added while the free memory holds one more of them; the memory of a worker
+			 * (slice storage, wave buffers and partial output) is measured on the first one
+			 */
+			void set_conf_workers()
+			{
+				conf_worker.clear();
+
+				int n_worker = min(input_multislice->system_conf.cpu_nthread_conf, input_multislice->number_conf());
+				int nthread = max(1, input_multislice->system_conf.cpu_nthread/n_worker);
+
+				double worker_memory = 0;
+				for(auto iworker = 0; iworker < n_worker; iworker++)
+				{
+					double free_memory = get_free_memory<dev>() - 10;
+					if((iworker > 0) && (free_memory < worker_memory))
+					{
+						break;
+					}
+
+					// fftw planning is not thread safe: plans are created here, in the calling thread
+					conf_worker.emplace_back(new Conf_Worker);
+					conf_worker.back()->set_input_data(*input_multislice, nthread);
+
+					if(iworker == 0)
+					{
+						worker_memory = max(1.0, free_memory - (get_free_memory<dev>() - 10));
+					}
+				}
+
+				stream_conf.resize(conf_worker.size());
+			}
+
+			/* configurations are taken in order by the workers; each partial output holds a single configuration
+			 * and is added to the output in configuration order, so the result does not depend on the number of workers
+			 */
+			template <class TOutput_multislice>
+			void conf_parallel(TOutput_multislice &output_multislice)
+			{
+				ext_niter = 0;
 				ext_iter = 0;
+
+				output_multislice.init();
+
+				const int iconf_e = input_multislice->pn_nconf;
+				std::atomic<int> iconf_next(input_multislice->fp_iconf_0);
+				int iconf_add = input_multislice->fp_iconf_0;
+				std::atomic<bool> b_conv(false);
+				std::mutex mtx_add;
+				std::condition_variable cv_add;
+
+				auto thr_conf = [&](const int &iworker)
+				{
+					auto &wk = *(conf_worker[iworker]);
+					for(auto iconf = iconf_next.fetch_add(1); iconf <= iconf_e; iconf = iconf_next.fetch_add(1))
+					{
+						wk.input_multislice.fp_iconf_0 = iconf;
+						wk.input_multislice.pn_nconf = iconf;
+						(*wk.multislice)(wk.output_multislice);
+
+						{
+							std::unique_lock<std::mutex> lock(mtx_add);
+							cv_add.wait(lock, [&](){ return (iconf_add == iconf) || b_conv; });
+
+							// configurations after the converged one are dropped
+							if(!b_conv)
+							{
+								output_multislice.add_conf(wk.output_multislice);
+								iconf_add++;
+								b_conv = fp_conv(output_multislice);
+							}
+						}
+						cv_add.notify_all();
+
+						if(ext_stop_sim || b_conv) break;
+					}
+				};
+
+				stream_conf.set_n_act_stream(conf_worker.size());
+				stream_conf.exec_istream(thr_conf);
+
+				fp_conv.set_output(output_multislice);
+				conf_worker[0]->multislice->wave_function.set_m2psi_coh(output_multislice);
+			}
+
+			template <class TOutput_multislice>
+			void STEM_ISTEM(TOutput_multislice &output_multislice)
+			{
+				set_ext_niter(input_multislice->scanning.size()*input_multislice->number_conf());
 				/*****************************************************************/
 
 				T_r w_pr_0 = input_multislice->get_phonon_rot_weight();
@@ -140,10 +303,10 @@ namespace mt
 						Q1<double, e_host> qt;
 						Q2<double, e_host> qs;
 
-						ext_niter *= qt.size();
-						
 						// Load quadratures
 						cond_lens_temporal_spatial_quadratures(input_multislice->cond_lens, qt, qs);
+
+						set_ext_niter(input_multislice->scanning.size()*qt.size()*input_multislice->number_conf());
 						double c_10_0 = input_multislice->cond_lens.c_10;
 						
 						for(auto iconf = input_multislice->fp_iconf_0; iconf <= input_multislice->pn_nconf; iconf++)
@@ -170,33 +333,86 @@ namespace mt
 								if(ext_stop_sim) break;
 							}
 							if(ext_stop_sim) break;
+
+							// stop once the frozen phonon average has converged
+							if(fp_conv(output_multislice)) break;
 						}
 
+						fp_conv.set_output(output_multislice);
 						wave_function.set_m2psi_coh(output_multislice);
 						
 						input_multislice->cond_lens.set_defocus(c_10_0);
 					}
 					else
 					{
+						if(PRISM<T_r, dev>::is_enabled(*input_multislice))
+						{
+							prism.set_input_data(input_multislice, &wave_function);
+						}
+						else if(Probe_Window<T_r, dev>::is_enabled(*input_multislice))
+						{
+							probe_window.set_input_data(input_multislice, &wave_function);
+						}
+						else if(STEM_Scan<T_r, dev>::is_enabled(*input_multislice))
+						{
+							stem_scan.set_input_data(input_multislice, &wave_function);
+						}
+
 						for(auto iconf = input_multislice->fp_iconf_0; iconf <= input_multislice->pn_nconf; iconf++)
 						{
 							wave_function.move_atoms(iconf);	
-							for(auto iscan = 0; iscan < input_multislice->scanning.size(); iscan++)
+
+							// S-matrix of the configuration, probes synthesized from it
+							if(prism.size() > 0)
 							{
-								input_multislice->iscan[0] = iscan;
-								input_multislice->set_iscan_beam_position();
-								wave_function.set_incident_wave(wave_function.psi_z);
-								wave_function.psi(w_pr_0, wave_function.psi_z, output_multislice);
+								prism(w_pr_0, output_multislice);
 
-								ext_iter++;
-								if(ext_stop_sim) break;
+								ext_iter += input_multislice->scanning.size();
+							}
+							// probes propagated on windows of the grid centered at the beam
+							else if(probe_window.size() > 0)
+							{
+								probe_window(w_pr_0, output_multislice);
+
+								ext_iter += input_multislice->scanning.size();
+							}
+							// probe positions run concurrently when all slices are stored as transmission functions
+							else if((stem_scan.size() > 0) && wave_function.is_trans_stored())
+							{
+								stem_scan(w_pr_0, output_multislice);
+
+								ext_iter += input_multislice->scanning.size();
+							}
+							else
+							{
+								for(auto iscan = 0; iscan < input_multislice->scanning.size(); iscan++)
+								{
+									input_multislice->iscan[0] = iscan;
+									input_multislice->set_iscan_beam_position();
+									wave_function.set_incident_wave(wave_function.psi_z);
+									wave_function.psi(w_pr_0, wave_function.psi_z, output_multislice);
+
+									ext_iter++;
+									if(ext_stop_sim) break;
+								}
 							}
 							if(ext_stop_sim) break;
+
+							// stop once the frozen phonon average has converged
+							if(fp_conv(output_multislice)) break;
 						}
 
+						stem_scan.clear();
+						prism.clear();
+						probe_window.clear();
+
+						fp_conv.set_output(output_multislice);
 						wave_function.set_m2psi_coh(output_multislice);
 					}
 				}
+
+				// write the open chunks of the 4D-STEM store
+				wave_function.stem_4d.close();
 			}
 
 			template <class TOutput_multislice>
@@ -220,8 +436,7 @@ namespace mt
 					Vector<T_r, e_host> beam_x(nbeams);
 					Vector<T_r, e_host> beam_y(nbeams);
 
-					ext_niter = qs.size()*qt.size()*input_multislice->number_conf();
-					ext_iter = 0;
+					set_ext_niter(qs.size()*qt.size()*input_multislice->number_conf());
 
 					for(auto iconf = input_multislice->fp_iconf_0; iconf <= input_multislice->pn_nconf; iconf++)
 					{
@@ -253,7 +468,11 @@ namespace mt
 						}
 
 						if(ext_stop_sim) break;
+
+						// stop once the frozen phonon average has converged
+						if(fp_conv(output_multislice)) break;
 					}
+					fp_conv.set_output(output_multislice);
 					wave_function.set_m2psi_coh(output_multislice);
 
 					input_multislice->cond_lens.set_defocus(c_10_0);
@@ -274,8 +493,7 @@ namespace mt
 			template <class TOutput_multislice>
 			void PED_HCTEM(TOutput_multislice &output_multislice)
 			{
-				ext_niter = input_multislice->nrot*input_multislice->number_conf();
-				ext_iter = 0;
+				set_ext_niter(input_multislice->nrot*input_multislice->number_conf());
 				/*****************************************************************/
 
 				T_r w = input_multislice->get_phonon_rot_weight();
@@ -295,16 +513,19 @@ namespace mt
 						if(ext_stop_sim) break;
 					}
 					if(ext_stop_sim) break;
+
+					// stop once the frozen phonon average has converged
+					if(fp_conv(output_multislice)) break;
 				}
 
+				fp_conv.set_output(output_multislice);
 				wave_function.set_m2psi_coh(output_multislice);
 			}
 
 			template <class TOutput_multislice>
 			void EWFS_EWRS(TOutput_multislice &output_multislice)
 			{
-				ext_niter = input_multislice->number_conf();
-				ext_iter = 0;
+				set_ext_niter(input_multislice->number_conf());
 				/*****************************************************************/
 
 				T_r w = input_multislice->get_phonon_rot_weight();
@@ -321,21 +542,24 @@ namespace mt
 
 					ext_iter++;
 					if(ext_stop_sim) break;
+
+					// stop once the frozen phonon average has converged
+					if(fp_conv(output_multislice)) break;
 				}
 
+				fp_conv.set_output(output_multislice);
 				wave_function.set_m2psi_coh(output_multislice);
 			}
 
 			template <class TOutput_multislice>
 			void EELS_EFTEM(TOutput_multislice &output_multislice)
 			{
-				ext_niter = wave_function.slicing.slice.size()*input_multislice->number_conf();
-				ext_iter = 0;
-
+				int niter = wave_function.slicing.slice.size()*input_multislice->number_conf();
 				if(input_multislice->is_EELS())
 				{
-					ext_niter *= input_multislice->scanning.size();
+					niter *= input_multislice->scanning.size();
 				}
+				set_ext_niter(niter);
 				/*****************************************************************/
 
 				T_r w = input_multislice->get_phonon_rot_weight();
@@ -397,6 +621,9 @@ namespace mt
 						}
 
 						if(ext_stop_sim) break;
+
+						// stop once the frozen phonon average has converged
+						if(fp_conv(output_multislice)) break;
 					}
 				}
 				else
@@ -408,20 +635,24 @@ namespace mt
 						psi(w, psi_thk, output_multislice);
 
 						if(ext_stop_sim) break;
+
+						// stop once the frozen phonon average has converged
+						if(fp_conv(output_multislice)) break;
 					}
 				}
+
+				fp_conv.set_output(output_multislice);
 			}
 
 			template <class TOutput_multislice>
 			void EDX(TOutput_multislice &output_multislice)
 			{
-				ext_niter = wave_function.slicing.slice.size()*input_multislice->number_conf();
-				ext_iter = 0;
-
+				int niter = wave_function.slicing.slice.size()*input_multislice->number_conf();
 				if(input_multislice->is_EELS())
 				{
-					ext_niter *= input_multislice->scanning.size();
+					niter *= input_multislice->scanning.size();
 				}
+				set_ext_niter(niter);
 				/*****************************************************************/
 
 				T_r w = input_multislice->get_phonon_rot_weight();
@@ -503,20 +734,56 @@ namespace mt
 			FFT<T_r, dev> *fft_2d;
 
 			Wave_Function<T_r, dev> wave_function;
+			STEM_Scan<T_r, dev> stem_scan;
+			PRISM<T_r, dev> prism;
+			Probe_Window<T_r, dev> probe_window;
 			Energy_Loss<T_r, dev> energy_loss;
+			FP_Convergence<T_r> fp_conv;
 
 			Vector<T_c, dev> psi_thk;
 			Vector<T_c, dev> trans_thk;
+
+			struct Conf_Worker
+			{
+				Input_Multislice<T_r> input_multislice;
+				Stream<dev> stream;
+				FFT<T_r, dev> fft_2d;
+				std::unique_ptr<Multislice<T_r, dev>> multislice;
+				Output_Multislice<T_r> output_multislice;
+
+				void set_input_data(Input_Multislice<T_r> &input_multislice_i, const int &nthread)
+				{
+					input_multislice = input_multislice_i;
+					input_multislice.system_conf.cpu_nthread = nthread;
+					input_multislice.system_conf.cpu_nthread_conf = 1;
+					input_multislice.system_conf.cpu_nthread_scan = min(input_multislice.system_conf.cpu_nthread_scan, nthread);
+					input_multislice.system_conf.nstream = nthread;
+
+					// the phonon weight of the run, one configuration at a time
+					input_multislice.pn_nconf_w = input_multislice_i.pn_nconf;
+
+					stream.resize(nthread);
+					fft_2d.create_plan_2d(input_multislice.grid_2d.ny, input_multislice.grid_2d.nx, nthread);
+
+					multislice.reset(new Multislice<T_r, dev>);
+					multislice->set_input_data(&input_multislice, &stream, &fft_2d);
+
+					output_multislice.set_input_data(&input_multislice);
+				}
+			};
+
+			std::vector<std::unique_ptr<Conf_Worker>> conf_worker;
+			Stream<e_host> stream_conf;
 	};
 
 	template <class T, eDevice dev>
-	bool Multislice<T, dev>::ext_stop_sim = false;
+	std::atomic<bool> Multislice<T, dev>::ext_stop_sim(false);
 
 	template <class T, eDevice dev>
-	int Multislice<T, dev>::ext_niter = 0;
+	std::atomic<int> Multislice<T, dev>::ext_niter(0);
 
 	template <class T, eDevice dev>
-	int Multislice<T, dev>::ext_iter = 0;
+	std::atomic<int> Multislice<T, dev>::ext_iter(0);
 } // namespace mt
 
 #endif
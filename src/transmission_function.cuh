@@ -19,6 +19,8 @@
 #ifndef TRANSMISSION_FUNCTION_H
 #define TRANSMISSION_FUNCTION_H
 
+#include <cstdint>
+
 #include "math.cuh"
 #include "types.cuh"
 #include "traits.cuh"
@@ -28,6 +30,7 @@
 #include "input_multislice.cuh"
 #include "output_multislice.hpp"
 #include "projected_potential.cuh"
+#include "slice_scratch.hpp"
 
 namespace mt
 {
@@ -39,7 +42,7 @@ namespace mt
 			using T_c = complex<T>;
 			using size_type = std::size_t;
 
-			Transmission_Function(): Projected_Potential<T, dev>(), fft_2d(nullptr){}
+			Transmission_Function(): Projected_Potential<T, dev>(), fft_2d(nullptr), slice_mem_err(0){}
 
 			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Stream<dev> *stream_i, FFT<T_r, dev> *fft2_i)
 			{
@@ -47,26 +50,59 @@ namespace mt
 				fft_2d = fft2_i;
 
 				trans_0.resize(this->input_multislice->grid_2d.nxy());
+				trans_q.clear();
+				slice_mem_err = 0;
 
 				if(!this->input_multislice->slice_storage)
 				{
 					memory_slice.clear();
+					slice_scratch.close();
 					return;
 				}
 
 				int n_slice_sig = (this->input_multislice->pn_dim.z)?(int)ceil(3.0*this->atoms.sigma_max/this->input_multislice->grid_2d.dz):0;
 				int n_slice_req = this->slicing.slice.size() + 2*n_slice_sig;
 
-				memory_slice.set_input_data(n_slice_req, this->input_multislice->grid_2d.nxy());
+				// |t| = 1 without the weak phase approximation and the bandwidth limit
+				bool b_phase = (this->input_multislice->interaction_model != eESIM_Weak_Phase_Object) && !this->input_multislice->grid_2d.bwl;
 
-				if(memory_slice.is_potential())
-				{
-					memory_slice.resize_vector(this->input_multislice->grid_2d.nxy(), Vp_v);
-				}
-				else if(memory_slice.is_transmission())
+				memory_slice.set_input_data(n_slice_req, this->input_multislice->grid_2d.nxy(), b_phase);
+
+				auto nxy = this->input_multislice->grid_2d.nxy();
+				switch(memory_slice.slice_mem_type)
 				{
-					memory_slice.resize_vector(this->input_multislice->grid_2d.nxy(), trans_v);
+					case eSMT_Transmission:
+					{
+						memory_slice.resize_vector(nxy, trans_v);
+					}
+					break;
+					case eSMT_Potential:
+					{
+						memory_slice.resize_vector(nxy, Vp_v);
+					}
+					break;
+					case eSMT_Transmission_Half:
+					{
+						memory_slice.resize_vector(nxy, trans_h_v);
+					}
+					break;
+					case eSMT_Phase:
+					{
+						memory_slice.resize_vector(nxy, phase_v);
+						slice_mem_err = c_Pi/65536;
+					}
+					break;
+					case eSMT_Potential_Quantized:
+					{
+						memory_slice.resize_vector(nxy, Vq_v);
+						Vq_0.assign(memory_slice.n_slice_Allow, 0);
+						Vq_d.assign(memory_slice.n_slice_Allow, 0);
+						trans_q.resize(nxy);
+					}
+					break;
 				}
+
+				set_slice_scratch(n_slice_req, nxy);
 			}
 
 			void trans(T_r w, Vector<T_r, dev> &V0_i, Vector<T_c, dev> &Trans_o)
@@ -85,15 +121,40 @@ namespace mt
 			{
 				if(islice < memory_slice.n_slice_cur(this->slicing.slice.size()))
 				{
-					if(memory_slice.is_potential())
-					{
-						trans(this->input_multislice->Vr_factor(), Vp_v[islice], trans_0);
-					}
-					else if(memory_slice.is_transmission())
+					switch(memory_slice.slice_mem_type)
 					{
-						mt::assign(trans_v[islice], trans_0);
+						case eSMT_Transmission:
+						{
+							mt::assign(trans_v[islice], trans_0);
+						}
+						break;
+						case eSMT_Potential:
+						{
+							trans(this->input_multislice->Vr_factor(), Vp_v[islice], trans_0);
+						}
+						break;
+						case eSMT_Transmission_Half:
+						{
+							mt::transform_vector(*(this->stream), trans_h_v[islice], trans_0, functor::decode_half_complex<T_r>());
+						}
+						break;
+						case eSMT_Phase:
+						{
+							mt::transform_vector(*(this->stream), phase_v[islice], trans_0, functor::decode_phase<T_r>());
+						}
+						break;
+						case eSMT_Potential_Quantized:
+						{
+							mt::transform_vector(*(this->stream), Vq_v[islice], this->V_0, functor::decode_quantized<T_r>(Vq_0[islice], Vq_d[islice]));
+							trans(this->input_multislice->Vr_factor(), this->V_0, trans_0);
+						}
+						break;
 					}
 				}
+				else if(is_trans_scratch(islice))
+				{
+					read_scratch(islice, trans_0);
+				}
 				else
 				{
 					Projected_Potential<T, dev>::operator()(islice, this->V_0);
@@ -102,6 +163,21 @@ namespace mt
 				}
 			}
 
+			// transmission function of a slice evaluated with the given stream and fft plan
+			void trans(Stream<dev> &stream_i, FFT<T_r, dev> &fft_i, const int &islice, Vector<T_c, dev> &trans_o)
+			{
+				auto stream_0 = this->stream;
+				auto fft_0 = fft_2d;
+
+				this->stream = &stream_i;
+				fft_2d = &fft_i;
+
+				trans(islice, trans_o);
+
+				this->stream = stream_0;
+				fft_2d = fft_0;
+			}
+
 			void trans(const int &islice_0, const int &islice_e, Vector<T_c, dev> &trans_0)
 			{
 				Projected_Potential<T, dev>::operator()(islice_0, islice_e, this->V_0);
@@ -121,28 +197,182 @@ namespace mt
 				Projected_Potential<T, dev>::move_atoms(fp_iconf);
 
 				// Calculate transmission functions
+				auto w = this->input_multislice->Vr_factor();
 				for(auto islice = 0; islice< memory_slice.n_slice_cur(this->slicing.slice.size()); islice++)
 				{
-					if(memory_slice.is_potential())
+					switch(memory_slice.slice_mem_type)
 					{
-						Projected_Potential<T, dev>::operator()(islice, Vp_v[islice]);
+						case eSMT_Transmission:
+						{
+							Projected_Potential<T, dev>::operator()(islice, this->V_0);
+							trans(w, this->V_0, trans_v[islice]);
+						}
+						break;
+						case eSMT_Potential:
+						{
+							Projected_Potential<T, dev>::operator()(islice, Vp_v[islice]);
+						}
+						break;
+						case eSMT_Transmission_Half:
+						{
+							Projected_Potential<T, dev>::operator()(islice, this->V_0);
+							trans(w, this->V_0, trans_0);
+							mt::transform_vector(*(this->stream), trans_0, trans_h_v[islice], functor::encode_half_complex<T_r>());
+
+							T_r err = thrust::transform_reduce(trans_0.begin(), trans_0.end(), functor::error_half_complex<T_r>(), T_r(0), thrust::maximum<T_r>());
+							slice_mem_err = max(slice_mem_err, err);
+						}
+						break;
+						case eSMT_Phase:
+						{
+							Projected_Potential<T, dev>::operator()(islice, this->V_0);
+							mt::transform_vector(*(this->stream), this->V_0, phase_v[islice], functor::encode_phase<T_r>(w));
+						}
+						break;
+						case eSMT_Potential_Quantized:
+						{
+							Projected_Potential<T, dev>::operator()(islice, this->V_0);
+							auto V_mm = thrust::minmax_element(this->V_0.begin(), this->V_0.end());
+							Vq_0[islice] = *(V_mm.first);
+							Vq_d[islice] = (*(V_mm.second) - Vq_0[islice])/T_r(65535);
+							mt::transform_vector(*(this->stream), this->V_0, Vq_v[islice], functor::encode_quantized<T_r>(Vq_0[islice], Vq_d[islice]));
+
+							// the bandwidth limit does not preserve the bound |w|*dV/2 pointwise, the error is measured after it
+							trans(w, this->V_0, trans_0);
+							mt::transform_vector(*(this->stream), Vq_v[islice], this->V_0, functor::decode_quantized<T_r>(Vq_0[islice], Vq_d[islice]));
+							trans(w, this->V_0, trans_q);
+
+							T_r err = thrust::inner_product(trans_0.begin(), trans_0.end(), trans_q.begin(), T_r(0), thrust::maximum<T_r>(), functor::error_complex<T_r>());
+							slice_mem_err = max(slice_mem_err, err);
+						}
+						break;
 					}
-					else if(memory_slice.is_transmission())
+				}
+
+				// slices beyond the memory are written to the slice file
+				for(auto islice = memory_slice.n_slice_cur(this->slicing.slice.size()); islice < this->slicing.slice.size(); islice++)
+				{
+					if(is_trans_scratch(islice))
 					{
 						Projected_Potential<T, dev>::operator()(islice, this->V_0);
-						trans(this->input_multislice->Vr_factor(), this->V_0, trans_v[islice]);
+						trans(w, this->V_0, trans_0);
+						write_scratch(islice, trans_0);
 					}
 				}
 			}
 
-			void transmit(const int &islice, Vector<T_c, dev> &psi_io)
+			// slice memory type and bound of |t_stored-t| of the stored transmission functions
+			eSlice_Memory_Type slice_mem_type() const
+			{
+				return memory_slice.slice_mem_type;
+			}
+
+			T_r get_slice_mem_err() const
+			{
+				return slice_mem_err;
+			}
+
+			bool is_trans_stored(const int &islice)
+			{
+				return (islice < memory_slice.n_slice_cur(this->slicing.slice.size())) && memory_slice.is_transmission();
+			}
+
+			bool is_trans_stored()
+			{
+				return (this->slicing.slice.size() > 0) && is_trans_stored(this->slicing.slice.size()-1);
+			}
+
+			// read-only access to the stored transmission function: safe from concurrent workers
+			void transmit(Stream<dev> &stream, const int &islice, Vector<T_c, dev> &psi_io)
+			{
+				mt::multiply(stream, trans_v[islice], psi_io);
+			}
+
+			// psi_io holds a batch of waves stored one after the other
+			void transmit_batch(Stream<dev> &stream, const int &islice, Vector<T_c, dev> &psi_io)
+			{
+				mt::multiply_batch(stream, trans_v[islice], psi_io);
+			}
+
+			// stored transmission function of a slice, shared read-only
+			Vector<T_c, dev>& trans_stored(const int &islice)
+			{
+				return trans_v[islice];
+			}
+
+			// transmission function of a slice: the stored one, without the copy to trans_0, or trans_0
+			Vector<T_c, dev>& trans_slice(const int &islice)
 			{
+				if(is_trans_stored(islice))
+				{
+					return trans_v[islice];
+				}
+
 				trans(islice, trans_0);
-				mt::multiply(*(this->stream), trans_0, psi_io);
+				return trans_0;
+			}
+
+			void transmit(const int &islice, Vector<T_c, dev> &psi_io)
+			{
+				mt::multiply(*(this->stream), trans_slice(islice), psi_io);
 			}
 
 			Vector<T_c, dev> trans_0;
 		private:
+			// memory mapped file of the transmission functions of the slices that do not fit in memory
+			void set_slice_scratch(const int &n_slice_req, const int &nxy)
+			{
+				auto &system_conf = this->input_multislice->system_conf;
+				int n_slice_scratch = n_slice_req - memory_slice.n_slice_Allow;
+
+				if(system_conf.slice_scratch_dir.empty() || (n_slice_scratch < 1))
+				{
+					slice_scratch.close();
+					return;
+				}
+
+				slice_scratch.open(system_conf.slice_scratch_dir, n_slice_scratch, nxy, system_conf.slice_prefetch);
+			}
+
+			bool is_trans_scratch(const int &islice)
+			{
+				int islice_s = islice - memory_slice.n_slice_Allow;
+				return slice_scratch.is_open() && (0 <= islice_s) && (islice_s < slice_scratch.size());
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			read_scratch(const int &islice, Vector<T_c, dev> &trans_o)
+			{
+				slice_scratch.read(islice - memory_slice.n_slice_Allow, trans_o.data());
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			write_scratch(const int &islice, Vector<T_c, dev> &trans_i)
+			{
+				slice_scratch.write(islice - memory_slice.n_slice_Allow, trans_i.data());
+			}
+
+			// the device reads and writes through a host buffer
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			read_scratch(const int &islice, Vector<T_c, dev> &trans_o)
+			{
+				trans_h.resize(trans_o.size());
+				slice_scratch.read(islice - memory_slice.n_slice_Allow, trans_h.data());
+				thrust::copy(trans_h.begin(), trans_h.end(), trans_o.begin());
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			write_scratch(const int &islice, Vector<T_c, dev> &trans_i)
+			{
+				trans_h.resize(trans_i.size());
+				thrust::copy(trans_i.begin(), trans_i.end(), trans_h.begin());
+				slice_scratch.write(islice - memory_slice.n_slice_Allow, trans_h.data());
+			}
+
 			struct Memory_Slice
 			{
 				public:
@@ -158,22 +388,35 @@ namespace mt
 						slice_mem_type = eSMT_none;
 					}
 
-					void set_input_data(const int &nSlice_req_i, const int &nxy_i)
+					/* the first tier that holds all the slices in memory: transmission, potential, phase (|t| = 1),
+					 * half precision transmission and 16 bit potential. The half precision transmission takes
+					 * 4 bytes per pixel, as the exact single precision potential, so it is only a tier in double
+					 * precision. Otherwise the slices that fit are stored as potentials and the rest are computed
+					 * on the fly.
+					 */
+					void set_input_data(const int &nSlice_req_i, const int &nxy_i, const bool &b_phase)
 					{
 						n_slice_req = nSlice_req_i;
 						double free_memory = get_free_memory<dev>() - 10;
 
-						if(number_slices<T_c>(free_memory, nxy_i) >= n_slice_req)
-						{
-							slice_mem_type = eSMT_Transmission;
-							n_slice_Allow = number_slices<T_c>(free_memory, nxy_i);
-						}
-						else
+						const eSlice_Memory_Type tiers[] = {eSMT_Transmission, eSMT_Potential, eSMT_Phase, eSMT_Transmission_Half, eSMT_Potential_Quantized};
+
+						slice_mem_type = eSMT_Potential;
+						for(auto tier: tiers)
 						{
-							slice_mem_type = eSMT_Potential;
-							n_slice_Allow = number_slices<T_r>(free_memory, nxy_i);
+							if(((tier == eSMT_Phase) && !b_phase) || ((tier == eSMT_Transmission_Half) && (sizeof(T_r) == 4)))
+							{
+								continue;
+							}
+
+							if(number_slices(free_memory, nxy_i, tier) >= n_slice_req)
+							{
+								slice_mem_type = tier;
+								break;
+							}
 						}
-						n_slice_Allow = min(n_slice_Allow, n_slice_req);
+
+						n_slice_Allow = min(number_slices(free_memory, nxy_i, slice_mem_type), n_slice_req);
 
 						if(n_slice_Allow == 0 )
 						{
@@ -207,10 +450,28 @@ namespace mt
 					}
 
 				private:
-					template <class U>
-					int number_slices(const double &memory, const int &nxy)
+					int number_slices(const double &memory, const int &nxy, const eSlice_Memory_Type &tier)
 					{
-						return static_cast<int>(floor(memory/mt::sizeMb<U>(nxy)));
+						double size_slice = 0;
+						switch(tier)
+						{
+							case eSMT_Transmission:
+								size_slice = mt::sizeMb<T_c>(nxy);
+								break;
+							case eSMT_Potential:
+								size_slice = mt::sizeMb<T_r>(nxy);
+								break;
+							case eSMT_Transmission_Half:
+								size_slice = mt::sizeMb<uint32_t>(nxy);
+								break;
+							case eSMT_Phase:
+							case eSMT_Potential_Quantized:
+								size_slice = mt::sizeMb<uint16_t>(nxy);
+								break;
+							default:
+								return 0;
+						}
+						return static_cast<int>(floor(max(0.0, memory)/size_slice));
 					}
 			};
 
@@ -219,6 +480,17 @@ namespace mt
 		protected:
 			Vector<Vector<T_c, dev>, e_host> trans_v;
 			Vector<Vector<T_r, dev>, e_host> Vp_v;
+			Vector<Vector<uint32_t, dev>, e_host> trans_h_v; 		// half precision transmission functions
+			Vector<Vector<uint16_t, dev>, e_host> phase_v; 		// phases of unit modulus transmission functions
+			Vector<Vector<uint16_t, dev>, e_host> Vq_v; 			// 16 bit potentials
+			Vector<T_r, e_host> Vq_0; 							// offset and step of the 16 bit potentials
+			Vector<T_r, e_host> Vq_d;
+			Vector<T_c, dev> trans_q; 							// transmission function of a 16 bit potential
+
+			T_r slice_mem_err; 									// bound of |t_stored-t|
+
+			Slice_Scratch<T_r> slice_scratch; 					// slices beyond the memory
+			Vector<T_c, e_host> trans_h; 						// host buffer of the slice file
 
 			FFT<T_r, dev> *fft_2d;
 	};
@@ -142,7 +142,7 @@ namespace mt
 	/******************************Slice memory type******************************/
 	enum eSlice_Memory_Type
 	{
-		eSMT_Transmission = 1, eSMT_Potential = 2, eSMT_none = 3
+		eSMT_Transmission = 1, eSMT_Potential = 2, eSMT_none = 3, eSMT_Transmission_Half = 4, eSMT_Phase = 5, eSMT_Potential_Quantized = 6
 	};
 
 	/******************************Microscope effects*****************************/
@@ -244,6 +244,12 @@ namespace mt
 		ePT_Kirkland_0_12 = 4, ePT_Weickenmeier_0_12 = 5, ePT_Lobato_0_12 = 6, ePT_none = 0
 	};
 
+	/********************Projected_Potential evaluation engine******************/
+	enum ePotential_Eval
+	{
+		ePE_Scatter = 1, ePE_Gather = 2, ePE_Auto = 3
+	};
+
 	/***************************Incident Wave Type******************************/
 	enum eIncident_Wave_Type
 	{
@@ -4401,6 +4407,53 @@ namespace mt
 		private:
 	};
 
+	/**********************************4D-STEM*********************************/
+	template <class T>
+	struct STEM_4D
+	{
+		public:
+			using value_type = T;
+
+			std::string fn; 				// output file name (empty: off)
+			T g_max; 						// maximum reciprocal distance (Angs^-1), 0: whole grid
+			int bin; 						// binning factor
+			bool f16; 						// float16 storage
+			int n_chunk; 					// scanning positions per chunk, 0: auto
+
+			STEM_4D(): g_max(0), bin(1), f16(false), n_chunk(0) {};
+
+			template <class TSTEM_4D>
+			void assign(TSTEM_4D &stem_4d)
+			{
+				fn = stem_4d.fn;
+				g_max = stem_4d.g_max;
+				bin = stem_4d.bin;
+				f16 = stem_4d.f16;
+				n_chunk = stem_4d.n_chunk;
+			}
+
+			template <class TSTEM_4D>
+			STEM_4D<T>& operator=(TSTEM_4D &stem_4d)
+			{
+				assign(stem_4d);
+				return *this;
+			}
+
+			void set_default()
+			{
+				fn.clear();
+				g_max = 0;
+				bin = 1;
+				f16 = false;
+				n_chunk = 0;
+			}
+
+			bool is_enable() const
+			{
+				return !fn.empty();
+			}
+	};
+
 	/*************************Radial Schrodinger equation**********************/
 	template <class T>
 	struct In_Rad_Schr
@@ -4451,14 +4504,26 @@ namespace mt
 			eDevice device; 									// eP_float = 1, eP_double = 2
 			int cpu_ncores; 									// Number of Cores CPU
 			int cpu_nthread; 									// Number of threads
+			int cpu_nthread_scan; 								// Number of threads that run scan positions concurrently
+			int cpu_scan_batch; 								// Number of scan positions propagated together
+			int cpu_scan_tile; 									// Number of scan batches that share a window of slices
+			int cpu_cache_size; 								// Cache budget (MB) of the windows of slices, 0: last level cache
+			int cpu_nthread_conf; 								// Number of threads that run frozen phonon configurations concurrently
+			int cpu_slice_fused; 								// Transmission and propagator fused with the 1d passes of the fft, 1: true, 0: false
 			int gpu_device; 									// GPU device
 			int gpu_nstream; 									// Number of streams
+			std::string cache_dir; 								// directory of the cached atomic type tables, empty: no cache
+			std::string fftw_wisdom_dir; 						// directory of the fftw wisdom files, empty: no wisdom files
+			int fftw_rigor; 									// fftw planning rigor: 0: estimate, 1: measure, 2: patient, 3: exhaustive
+			std::string slice_scratch_dir; 						// directory of the memory mapped slice file, empty: no slice file
+			int slice_prefetch; 								// slices read ahead from the slice file
+			int prop_cache; 									// number of cached propagator kernels, 0: computed on the fly
 
 			int nstream;
 			bool active;
 
 			System_Configuration(): precision(eP_double), device(e_host), cpu_ncores(1),
-				cpu_nthread(4), gpu_device(0), gpu_nstream(8), nstream(1), active(true){};
+				cpu_nthread(4), cpu_nthread_scan(1), cpu_scan_batch(1), cpu_scan_tile(1), cpu_cache_size(0), cpu_nthread_conf(1), cpu_slice_fused(1), gpu_device(0), gpu_nstream(8), fftw_rigor(1), slice_prefetch(4), prop_cache(4), nstream(1), active(true){};
 
 			void validate_parameters()
 			{
@@ -4490,10 +4555,25 @@ namespace mt
 				}
 
 				cpu_nthread = max(1, cpu_nthread);
+				cpu_nthread_scan = min(max(1, cpu_nthread_scan), cpu_nthread);
+				cpu_scan_batch = max(1, cpu_scan_batch);
+				cpu_scan_tile = max(1, cpu_scan_tile);
+				cpu_cache_size = max(0, cpu_cache_size);
+				cpu_nthread_conf = min(max(1, cpu_nthread_conf), cpu_nthread);
+				cpu_slice_fused = min(max(0, cpu_slice_fused), 1);
+				fftw_rigor = min(max(0, fftw_rigor), 3);
+				slice_prefetch = max(0, slice_prefetch);
+				prop_cache = max(0, prop_cache);
 				gpu_nstream = max(1, gpu_nstream);
 				nstream = (is_host())?cpu_nthread:gpu_nstream;
 			}
 
+			// threads left for the grid kernels of each scan worker
+			int cpu_nthread_grid() const
+			{
+				return max(1, cpu_nthread/cpu_nthread_scan);
+			}
+
 			void set_device()
 			{
 				if(is_device())
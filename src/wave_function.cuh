@@ -30,6 +30,7 @@
 #include "incident_wave.cuh"
 #include "propagator.cuh"
 #include "microscope_effects.cuh"
+#include "stem_4d.cuh"
 
 namespace mt
 {
@@ -43,7 +44,7 @@ namespace mt
 			using TVector_c = Vector<T_c, dev>;
 			using size_type = std::size_t;
 
-			Wave_Function(): Transmission_Function<T, dev>(){}
+			Wave_Function(): Transmission_Function<T, dev>(), det_n_bin(0), b_pipeline(false){}
 
 			void set_input_data(Input_Multislice<T_r> *input_multislice_i, Stream<dev> *stream_i, FFT<T_r, dev> *fft2_i)
 			{
@@ -60,6 +61,18 @@ namespace mt
 							mt::fft2_shift(*stream_i, input_multislice_i->grid_2d, detector.fR[i]);
 						}
 					}
+					else if(input_multislice_i->is_detector_circular())
+					{
+						set_det_radial_bins(input_multislice_i->grid_2d);
+					}
+					else if(input_multislice_i->is_detector_radial())
+					{
+						set_det_radial_profile(input_multislice_i->grid_2d, input_multislice_i->det_radial_nr(), input_multislice_i->det_radial_dg());
+					}
+					det_int.resize(detector.size());
+					det_hist.resize(det_n_bin);
+
+					stem_4d.set_input_data(input_multislice_i);
 				}
 
 				incident_wave.set_input_data(input_multislice_i, stream_i, fft2_i);
@@ -72,9 +85,11 @@ namespace mt
 				} 
 
 				Transmission_Function<T, dev>::set_input_data(input_multislice_i, stream_i, fft2_i);
+
+				set_pipeline();
 			}
 
-			void phase_multiplication(const T_r &gxu, const T_r &gyu, TVector_c &psi_i, TVector_c &psi_o)
+			void phase_multiplication(Stream<dev> &stream, const T_r &gxu, const T_r &gyu, TVector_c &psi_i, TVector_c &psi_o)
 			{
 				if(this->input_multislice->dp_Shift || isZero(gxu, gyu))
 				{
@@ -85,7 +100,12 @@ namespace mt
 					return;
 				}
 
-				mt::exp_r_factor_2d(*(this->stream), this->input_multislice->grid_2d, c_2Pi*gxu, c_2Pi*gyu, psi_i, psi_o);
+				mt::exp_r_factor_2d(stream, this->input_multislice->grid_2d, c_2Pi*gxu, c_2Pi*gyu, psi_i, psi_o);
+			}
+
+			void phase_multiplication(const T_r &gxu, const T_r &gyu, TVector_c &psi_i, TVector_c &psi_o)
+			{
+				phase_multiplication(*(this->stream), gxu, gyu, psi_i, psi_o);
 			}
 
 			void phase_multiplication(const T_r &gxu, const T_r &gyu, TVector_c &psi_io)
@@ -104,6 +124,11 @@ namespace mt
 			}
 
 			T_r integrated_intensity_over_det(T_r w_i, const int &iDet, TVector_c &psi_z)
+			{
+				return integrated_intensity_over_det(*(this->stream), w_i, iDet, psi_z);
+			}
+
+			T_r integrated_intensity_over_det(Stream<dev> &stream, T_r w_i, const int &iDet, TVector_c &psi_z)
 			{
 				T_r int_val = 0;
 				switch (detector.type)
@@ -113,17 +138,19 @@ namespace mt
 						auto g_inner = detector.g_inner[iDet];
 						auto g_outer = detector.g_outer[iDet];
 							
-						int_val = w_i*mt::sum_square_over_Det(*(this->stream), this->input_multislice->grid_2d, g_inner, g_outer, psi_z);
+						int_val = w_i*mt::sum_square_over_Det(stream, this->input_multislice->grid_2d, g_inner, g_outer, psi_z);
 					}
 					break;
 					case mt::eDT_Radial:
 					{
-						int_val = 0;
+						Vector<T_r, e_host> hist(det_n_bin);
+						mt::sum_square_over_radial_bins(stream, this->input_multislice->grid_2d, det_ir, psi_z, hist);
+						int_val = w_i*sum_det_radial_bins(iDet, hist);
 					}
 					break;
 					case mt::eDT_Matrix:
 					{
-						int_val = w_i*mt::sum_square_over_Det(*(this->stream), this->input_multislice->grid_2d, detector.fR[iDet], psi_z);
+						int_val = w_i*mt::sum_square_over_Det(stream, this->input_multislice->grid_2d, detector.fR[iDet], psi_z);
 					}
 					break;
 				}
@@ -131,6 +158,30 @@ namespace mt
 				return int_val;
 			}
 
+			// integrated intensity of all the detectors: circular and radial detectors are evaluated from 
+			// a single radial histogram of |psi|^2 (hist), so the cost does not grow with the number of detectors
+			void integrated_intensity_over_det(Stream<dev> &stream, T_r w_i, TVector_c &psi_z, 
+			Vector<T_r, e_host> &hist, Vector<T_r, e_host> &int_o)
+			{
+				if(!detector.is_detector_matrix() && (det_ir.size() > 0))
+				{
+					hist.resize(det_n_bin);
+					mt::sum_square_over_radial_bins(stream, this->input_multislice->grid_2d, det_ir, psi_z, hist);
+
+					for(auto iDet = 0; iDet<detector.size(); iDet++)
+					{
+						int_o[iDet] = w_i*sum_det_radial_bins(iDet, hist);
+					}
+				}
+				else
+				{
+					for(auto iDet = 0; iDet<detector.size(); iDet++)
+					{
+						int_o[iDet] = integrated_intensity_over_det(stream, w_i, iDet, psi_z);
+					}
+				}
+			}
+
 			template <class TOutput_multislice>
 			void set_m2psi_tot_psi_coh(TVector_c &psi_z_i, const T_r &gxu, const T_r &gyu, 
 			const int &islice, const T_r &w_i, TOutput_multislice &output_multislice)
@@ -142,10 +193,22 @@ namespace mt
 
 					if(this->input_multislice->is_STEM())
 					{
+						int iscan = this->input_multislice->iscan[0];
+
+						integrated_intensity_over_det(*(this->stream), w_i, *psi_z_o, det_hist, det_int);
 						for(auto iDet = 0; iDet<detector.size(); iDet++)
 						{
-							int iscan = this->input_multislice->iscan[0];
-							output_multislice.image_tot[ithk].image[iDet][iscan] += integrated_intensity_over_det(w_i, iDet, *psi_z_o);
+							output_multislice.image_tot[ithk].image[iDet][iscan] += det_int[iDet];
+						}
+
+						if(detector.is_detector_radial())
+						{
+							output_multislice.add_scale_radial_tot(ithk, iscan, w_i, det_hist);
+						}
+
+						if(stem_4d.is_enable())
+						{
+							stem_4d(ithk, iscan, w_i, *psi_z_o);
 						}
 
 						if(this->input_multislice->pn_coh_contrib)
@@ -199,10 +262,11 @@ namespace mt
 					for(auto ithk = 0; ithk < n_thk; ithk++)
 					{
 						output_multislice.from_psi_coh_2_phi(ithk, psi_z);
+						integrated_intensity_over_det(*(this->stream), 1, psi_z, det_hist, det_int);
 						for(auto iDet = 0; iDet<detector.size(); iDet++)
 						{
 							int iscan = this->input_multislice->iscan[0];
-							output_multislice.image_coh[ithk].image[iDet][iscan] = integrated_intensity_over_det(1, iDet, psi_z);
+							output_multislice.image_coh[ithk].image[iDet][iscan] = det_int[iDet];
 						}
 					}
 				}
@@ -228,11 +292,13 @@ namespace mt
 			template <class TVector_c>
 			void psi_slice(const T_r &gxu, const T_r &gyu, const int &islice, TVector_c &psi_z)
 			{
-				this->transmit(islice, psi_z);
-
 				if(this->input_multislice->is_multislice())
 				{
-					propagator(eS_Real, gxu, gyu, this->dz(islice), psi_z);
+					propagator.transmit_propagate(this->trans_slice(islice), gxu, gyu, this->dz(islice), psi_z);
+				}
+				else
+				{
+					this->transmit(islice, psi_z);
 				}
 			}
 
@@ -242,6 +308,12 @@ namespace mt
 				T_r gx_0 = this->input_multislice->gx_0();
 				T_r gy_0 = this->input_multislice->gy_0();
 
+				if(b_pipeline && !this->is_trans_stored() && (this->slicing.slice.size() > 1))
+				{
+					psi_pipeline(gx_0, gy_0, w_i, psi_z, output_multislice);
+					return;
+				}
+
 				for(auto islice = 0; islice<this->slicing.slice.size(); islice++)
 				{
 					psi_slice(gx_0, gy_0, islice, psi_z);
@@ -321,8 +393,218 @@ namespace mt
 			Detector<T_r, dev> detector; 	
 			Microscope_Effects<T_r, dev> microscope_effects;
 			Incident_Wave<T_r, dev> incident_wave;		
+			STEM_4D_Store<T_r, dev> stem_4d;
 
 			//mt::Timing<mt::e_device> time;
+			int det_radial_size() const
+			{
+				return det_n_bin;
+			}
+
+		private:
+			/* double buffered slices for transmission functions that are not stored: the threads of the
+			 * stream are split between a producer, which builds the transmission function of the next
+			 * slice into a spare buffer, and a consumer, which transmits and propagates the current one.
+			 * Each one has its own stream and fft plan.
+			 */
+			template<eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			set_pipeline()
+			{
+				b_pipeline = false;
+				pipe.trans_c.clear();
+				pipe.trans_p.clear();
+
+				auto &grid_2d = this->input_multislice->grid_2d;
+				int nthread = this->stream->size();
+				if((nthread < 2) || !this->input_multislice->is_multislice() || (this->slice_mem_type() == eSMT_Transmission))
+				{
+					return;
+				}
+
+				double free_memory = get_free_memory<dev>() - 10;
+				if(free_memory < 2*mt::sizeMb<T_c>(grid_2d.nxy()))
+				{
+					return;
+				}
+
+				int nthread_c = nthread/2;
+				int nthread_p = nthread - nthread_c;
+
+				pipe.stream.resize(2);
+				pipe.stream_c.resize(nthread_c);
+				pipe.stream_p.resize(nthread_p);
+				pipe.fft_c.create_plan_2d(grid_2d.ny, grid_2d.nx, nthread_c);
+				pipe.fft_p.create_plan_2d(grid_2d.ny, grid_2d.nx, nthread_p);
+				pipe.propagator.set_input_data(this->input_multislice, &(pipe.stream_c), &(pipe.fft_c));
+
+				pipe.trans_c.resize(grid_2d.nxy());
+				pipe.trans_p.resize(grid_2d.nxy());
+
+				b_pipeline = true;
+			}
+
+			template<eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			set_pipeline()
+			{
+				b_pipeline = false;
+			}
+
+			// the outputs of a thickness are set once the producer and the consumer have finished the slice
+			template <class TOutput_multislice, eDevice devn = dev>
+			enable_if_dev_host<devn, void>
+			psi_pipeline(const T_r &gxu, const T_r &gyu, const T_r &w_i, TVector_c &psi_z, TOutput_multislice &output_multislice)
+			{
+				int n_slice = this->slicing.slice.size();
+
+				this->trans(0, pipe.trans_c);
+				for(auto islice = 0; islice < n_slice; islice++)
+				{
+					auto thr_pipe = [&](const int &istream)
+					{
+						if(istream == 0)
+						{
+							pipe.propagator.transmit_propagate(pipe.trans_c, gxu, gyu, this->dz(islice), psi_z);
+						}
+						else if(islice+1 < n_slice)
+						{
+							this->trans(pipe.stream_p, pipe.fft_p, islice+1, pipe.trans_p);
+						}
+					};
+
+					pipe.stream.set_n_act_stream(2);
+					pipe.stream.exec_istream(thr_pipe);
+
+					pipe.trans_c.swap(pipe.trans_p);
+
+					set_m2psi_tot_psi_coh(psi_z, gxu, gyu, islice, w_i, output_multislice);
+				}
+			}
+
+			template <class TOutput_multislice, eDevice devn = dev>
+			enable_if_dev_device<devn, void>
+			psi_pipeline(const T_r &gxu, const T_r &gyu, const T_r &w_i, TVector_c &psi_z, TOutput_multislice &output_multislice){}
+
+			struct Slice_Pipeline
+			{
+				Stream<dev> stream; 					// producer and consumer
+				Stream<dev> stream_c; 					// consumer
+				Stream<dev> stream_p; 					// producer
+				FFT<T_r, dev> fft_c;
+				FFT<T_r, dev> fft_p;
+				Propagator<T_r, dev> propagator; 		// consumer propagator
+				TVector_c trans_c; 						// transmission function of the current slice
+				TVector_c trans_p; 						// transmission function of the next slice
+			};
+
+			bool b_pipeline;
+			Slice_Pipeline pipe;
+
+			// detector iDet from the radial histogram
+			T_r sum_det_radial_bins(const int &iDet, Vector<T_r, e_host> &hist)
+			{
+				T_r sum = 0;
+				if(detector.is_detector_circular())
+				{
+					for(auto ir = det_ir_0[iDet]; ir < det_ir_e[iDet]; ir++)
+					{
+						sum += hist[ir];
+					}
+				}
+				else
+				{
+					// radial sensitivity sampled at the centers of the det_radial_nr() bins (see the input reader)
+					int n_bin = min(static_cast<int>(det_fx[iDet].size()), static_cast<int>(hist.size()));
+					for(auto ir = 0; ir < n_bin; ir++)
+					{
+						sum += det_fx[iDet][ir]*hist[ir];
+					}
+				}
+				return sum;
+			}
+
+			/* radial bins of the circular detectors: the bin edges are the sorted inner and outer 
+			 * radii of all the detectors, pixels outside the edges are not binned (-1)
+			 */
+			void set_det_radial_bins(const Grid_2d<T_r> &grid_2d)
+			{
+				std::vector<T_r> g2_edge;
+				for(auto iDet = 0; iDet<detector.size(); iDet++)
+				{
+					T_r g2_min = pow(detector.g_inner[iDet], 2);
+					T_r g2_max = pow(detector.g_outer[iDet], 2);
+					g2_edge.push_back(g2_min);
+					g2_edge.push_back(g2_max);
+				}
+				std::sort(g2_edge.begin(), g2_edge.end());
+				g2_edge.erase(std::unique(g2_edge.begin(), g2_edge.end()), g2_edge.end());
+
+				const int n_edge = g2_edge.size();
+				det_n_bin = max(0, n_edge-1);
+
+				// detector iDet covers the bins [det_ir_0, det_ir_e)
+				det_ir_0.resize(detector.size());
+				det_ir_e.resize(detector.size());
+				for(auto iDet = 0; iDet<detector.size(); iDet++)
+				{
+					T_r g2_min = pow(detector.g_inner[iDet], 2);
+					T_r g2_max = pow(detector.g_outer[iDet], 2);
+					det_ir_0[iDet] = std::lower_bound(g2_edge.begin(), g2_edge.end(), g2_min) - g2_edge.begin();
+					det_ir_e[iDet] = std::lower_bound(g2_edge.begin(), g2_edge.end(), g2_max) - g2_edge.begin();
+				}
+
+				Vector<int, e_host> ir(grid_2d.nxy(), -1);
+				for(auto ix = 0; ix < grid_2d.nx; ix++)
+				{
+					for(auto iy = 0; iy < grid_2d.ny; iy++)
+					{
+						const auto g2 = grid_2d.g2_shift(ix, iy);
+						const int k = std::upper_bound(g2_edge.begin(), g2_edge.end(), g2) - g2_edge.begin();
+						if((0 < k) && (k < n_edge))
+						{
+							ir[grid_2d.ind_col(ix, iy)] = k-1;
+						}
+					}
+				}
+				det_ir.assign(ir.begin(), ir.end());
+			}
+
+			// radial detector: full profile of |psi|^2 on nr bins of width dg
+			void set_det_radial_profile(const Grid_2d<T_r> &grid_2d, const int &nr, const T_r &dg)
+			{
+				det_n_bin = nr;
+
+				det_fx.resize(detector.size());
+				for(auto iDet = 0; iDet<detector.size(); iDet++)
+				{
+					det_fx[iDet].assign(detector.fx[iDet].begin(), detector.fx[iDet].end());
+				}
+
+				Vector<int, e_host> ir(grid_2d.nxy(), -1);
+				for(auto ix = 0; ix < grid_2d.nx; ix++)
+				{
+					for(auto iy = 0; iy < grid_2d.ny; iy++)
+					{
+						const int k = static_cast<int>(floor(sqrt(grid_2d.g2_shift(ix, iy))/dg));
+						if(k < nr)
+						{
+							ir[grid_2d.ind_col(ix, iy)] = k;
+						}
+					}
+				}
+				det_ir.assign(ir.begin(), ir.end());
+			}
+
+			Vector<int, dev> det_ir; 				// radial bin of each pixel
+			Vector<int, e_host> det_ir_0; 			// first bin of each detector
+			Vector<int, e_host> det_ir_e; 			// last bin (exclusive) of each detector
+			int det_n_bin;
+
+			Vector<Vector<T_r, e_host>, e_host> det_fx; 	// radial sensitivities
+
+			Vector<T_r, e_host> det_hist; 			// radial histogram
+			Vector<T_r, e_host> det_int; 			// integrated intensities
 	};
 
 } // namespace mt